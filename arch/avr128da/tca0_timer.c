@@ -26,7 +26,7 @@ u32 timer_ticks(void) {
 
 void timer_delay(u32 ms) {
     u32 end = timer_ticks() + ms;
-    while (timer_ticks() < end);
+    while ((s32)(timer_ticks() - end) < 0);
 }
 
 void tca0_tick_handler(void) {
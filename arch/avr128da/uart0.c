@@ -13,11 +13,8 @@ void uart_early_init(void) {
     USART0.CTRLC = (3<<UCSZ00); // 8N1
 }
 
-void uart_putc(char c) {
+// polled; kernel/uart.c queues and calls this (no TX IRQ here yet)
+void uart_hw_putc(char c) {
     while (!(USART0.STATUS & (1<<DRE0)));
     USART0.TXDATAL = c;
 }
-
-void uart_puts(const char* s) {
-    while (*s) uart_putc(*s++);
-}
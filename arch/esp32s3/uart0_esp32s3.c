@@ -29,7 +29,8 @@ void uart_early_init(void) {
     UART->CONF1  = 0;
 }
 
-void uart_putc(char c) {
+// polled; kernel/uart.c queues and calls this (no TX IRQ here yet)
+void uart_hw_putc(char c) {
     while (!(UART->INT_RAW & (1<<1))); // TXFIFO_EMPTY
     UART->FIFO = c;
 }
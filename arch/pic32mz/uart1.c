@@ -23,11 +23,8 @@ void uart_early_init(void) {
     UART1->UxSTA  = (1<<10); // UTXEN
 }
 
-void uart_putc(char c) {
+// polled; kernel/uart.c queues and calls this (no TX IRQ here yet)
+void uart_hw_putc(char c) {
     while (!(UART1->UxSTA & (1<<9))); // UTXBF
     UART1->UxTXREG = c;
 }
-
-void uart_puts(const char* s) {
-    while (*s) uart_putc(*s++);
-}
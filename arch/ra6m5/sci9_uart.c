@@ -25,11 +25,8 @@ void uart_early_init(void) {
     SCI9->SCR  = (1<<5) | (1<<4);      // TE + RE
 }
 
-void uart_putc(char c) {
+// polled; kernel/uart.c queues and calls this (no TX IRQ here yet)
+void uart_hw_putc(char c) {
     while (!(SCI9->SSR & (1<<7)));     // TDRE
     SCI9->TDR = c;
 }
-
-void uart_puts(const char* s) {
-    while (*s) uart_putc(*s++);
-}
@@ -5,7 +5,7 @@
 #include "kernel/types.h"
 #include "pio_driver.h"
 
-extern void timer_delay(u32 ms);
+extern void task_sleep(u32 ms);
 extern u8 multicore_launch_core1(void (*entry)(void));
 extern void multicore_fifo_push(u32 data);
 extern u32 multicore_fifo_pop(void);
@@ -19,7 +19,7 @@ static void pio_blink_task(void) {
     pio_load_blink(25);
     
     while (1) {
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -34,7 +34,7 @@ static void pio_uart_task(void) {
         pio_uart_tx_byte(msg[i]);
         i++;
         if (msg[i] == 0) i = 0;
-        timer_delay(100);
+        task_sleep(100);
     }
 }
 
@@ -47,7 +47,7 @@ static void pio_spi_task(void) {
     while (1) {
         u8 response = pio_spi_xfer(test_data);
         test_data = response + 1;
-        timer_delay(500);
+        task_sleep(500);
     }
 }
 
@@ -71,7 +71,7 @@ static void pio_ws2812_task(void) {
     while (1) {
         pio_ws2812_put_pixel(colors[color_idx]);
         color_idx = (color_idx + 1) % 8;
-        timer_delay(250);
+        task_sleep(250);
     }
 }
 
@@ -89,7 +89,7 @@ static void pwm_task(void) {
         if (duty >= 65000) direction = -1;
         if (duty <= 1000) direction = 1;
         
-        timer_delay(10);
+        task_sleep(10);
     }
 }
 
@@ -108,7 +108,7 @@ static void adc_task(void) {
         (void)ch0;
         (void)ch1;
         
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -117,7 +117,7 @@ static void watchdog_task(void) {
     
     while (1) {
         watchdog_feed();
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -139,7 +139,7 @@ static void rtc_task(void) {
         (void)sec; (void)min; (void)hour;
         (void)day; (void)month; (void)year;
         
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -176,7 +176,7 @@ static void flash_task(void) {
         }
         
         (void)verify_ok;
-        timer_delay(10000);
+        task_sleep(10000);
     }
 }
 
@@ -193,7 +193,7 @@ static void core1_task(void) {
                 /* Blink LED faster */
                 for (u8 i = 0; i < 10; i++) {
                     gpio_toggle(24);
-                    timer_delay(50);
+                    task_sleep(50);
                 }
                 
                 /* Send response */
@@ -203,7 +203,7 @@ static void core1_task(void) {
         
         /* Normal LED blink */
         gpio_toggle(24);
-        timer_delay(500);
+        task_sleep(500);
     }
 }
 
@@ -221,7 +221,7 @@ static void multicore_demo_task(void) {
                 /* Core 1 responded correctly */
             }
             
-            timer_delay(2000);
+            task_sleep(2000);
         }
     }
 }
@@ -238,7 +238,7 @@ static void timer_precision_task(void) {
         u32 actual_delay = end_us - start_us;
         (void)actual_delay; /* Should be ~1000 us */
         
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -3,6 +3,8 @@
  */
 
 #include "kernel/types.h"
+#include "kernel/clocksource.h"
+#include "kernel/hrtimer.h"
 
 #define TIMER_BASE 0x40054000UL
 #define RESETS_BASE 0x4000C000UL
@@ -27,6 +29,8 @@ typedef volatile struct {
     u32 INTS;
 } TIMER_TypeDef;
 
+extern void sched_tick(u32 now);
+
 static TIMER_TypeDef* const TIMER = (TIMER_TypeDef*)TIMER_BASE;
 static volatile u32 sys_ticks = 0;
 
@@ -37,10 +41,10 @@ void timer_init(void) {
     *(u32*)(RESETS_BASE + 0x4) |= (1<<21);
     while (!(*(u32*)(RESETS_BASE + 0x8) & (1<<21)));
     
-    /* Set alarm 0 for 1 kHz tick (1000 us) */
+    /* Set alarm 0 for 1 kHz tick (1000 us); writing ALARMn arms it,
+       writing 1 to ARMED disarms */
     TIMER->ALARM0 = TIMER->TIMERAWL + 1000;
     TIMER->INTE |= (1<<0);
-    TIMER->ARMED |= (1<<0);
 }
 
 u32 timer_ticks(void) {
@@ -53,12 +57,13 @@ u32 timer_ticks(void) {
 
 void timer_delay(u32 ms) {
     u32 end = timer_ticks() + ms;
-    while (timer_ticks() < end);
+    while ((s32)(timer_ticks() - end) < 0);
 }
 
 u64 timer_us(void) {
-    u32 hi = TIMER->TIMEHR;
+    /* TIMELR must be read first: it latches TIMEHR */
     u32 lo = TIMER->TIMELR;
+    u32 hi = TIMER->TIMEHR;
     return ((u64)hi << 32) | lo;
 }
 
@@ -70,12 +75,17 @@ void timer_delay_us(u32 us) {
 void timer_irq_handler(void) {
     if (TIMER->INTS & (1<<0)) {
         sys_ticks++;
+        clocksource_update();
         TIMER->INTR = (1<<0);
         TIMER->ALARM0 = TIMER->TIMERAWL + 1000;
-        TIMER->ARMED |= (1<<0);
+        hrtimer_tick();
+        sched_tick(sys_ticks);
     }
 }
 
+/* hrtimers expire from hrtimer_tick() above: TIMER_IRQ_1 is its own
+   NVIC line and boot.S has no external vectors to give ALARM1 */
+
 /* Watchdog timer */
 #define WATCHDOG_BASE 0x40058000UL
 
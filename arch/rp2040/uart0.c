@@ -34,11 +34,8 @@ void uart_early_init(void) {
     UART->CR   = (1<<0) | (1<<8) | (1<<9);
 }
 
-void uart_putc(char c) {
+// polled; kernel/uart.c queues and calls this (no TX IRQ here yet)
+void uart_hw_putc(char c) {
     while (UART->FR & (1<<5));   // TXFF
     UART->DR = c;
 }
-
-void uart_puts(const char* s) {
-    while (*s) uart_putc(*s++);
-}
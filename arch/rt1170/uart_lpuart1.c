@@ -21,11 +21,8 @@ void uart_early_init(void) {
     LPUART1->CTRL = (1<<19) | (1<<18); // TE + RE
 }
 
-void uart_putc(char c) {
+// polled; kernel/uart.c queues and calls this (no TX IRQ here yet)
+void uart_hw_putc(char c) {
     while (!(LPUART1->STAT & (1<<23))); // TDRE
     LPUART1->DATA = c;
 }
-
-void uart_puts(const char* s) {
-    while (*s) uart_putc(*s++);
-}
@@ -5,7 +5,7 @@
 #include "kernel/types.h"
 #include "canfd.h"
 
-extern void timer_delay(u32 ms);
+extern void task_sleep(u32 ms);
 extern void qspi_init(void);
 extern u32 qspi_read_id(void);
 extern void eth_phy_init(void);
@@ -38,7 +38,7 @@ static void canfd_demo_task(void) {
             /* Process received frame */
         }
         
-        timer_delay(100);
+        task_sleep(100);
     }
 }
 
@@ -54,7 +54,7 @@ static void eth_demo_task(void) {
             /* Link is up - could send/receive packets */
         }
         
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -81,7 +81,7 @@ static void qspi_demo_task(void) {
         /* Read back and verify */
         qspi_read(0x0000, read_data, 256);
         
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -94,7 +94,7 @@ static void usb_demo_task(void) {
             /* USB is configured - can communicate */
         }
         
-        timer_delay(100);
+        task_sleep(100);
     }
 }
 
@@ -13,7 +13,8 @@ void uart_early_init(void) {
     *(volatile u32*)(USART3_BASE + 0x08) = (1<<13) | (1<<3) | (1<<2);
 }
 
-void uart_putc(char c) {
+// polled; kernel/uart.c queues and calls this (no TX IRQ here yet)
+void uart_hw_putc(char c) {
     while (!(*(volatile u32*)(USART3_BASE + 0x1C) & (1<<7)));
     *(volatile u32*)(USART3_BASE + 0x28) = c;
 }
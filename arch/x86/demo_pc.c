@@ -81,7 +81,7 @@
 #include "drivers/memory_subsys.h"
 #include "drivers/hw_transactional.h"
 
-extern void timer_delay(u32 ms);
+extern void task_sleep(u32 ms);
 
 static void vga_demo_task(void) {
     vga_init();
@@ -188,7 +188,7 @@ static void vga_demo_task(void) {
     vga_puts_at("Press any key to test keyboard...", 24, 2, VGA_BLACK | (VGA_LGRAY << 4));
     
     while (1) {
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -226,7 +226,7 @@ static void keyboard_demo_task(void) {
             vga_puts_at(mod_str, 23, 60, VGA_CYAN | (VGA_BLACK << 4));
         }
         
-        timer_delay(10);
+        task_sleep(10);
     }
 }
 
@@ -260,7 +260,7 @@ static void pci_demo_task(void) {
     }
     
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -297,7 +297,7 @@ static void ata_demo_task(void) {
     }
     
     while (1) {
-        timer_delay(10000);
+        task_sleep(10000);
     }
 }
 
@@ -325,7 +325,7 @@ static void timer_demo_task(void) {
             }
         }
         
-        timer_delay(100);
+        task_sleep(100);
     }
 }
 
@@ -350,7 +350,7 @@ static void cpu_info_task(void) {
     vga_puts("\n");
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -364,7 +364,7 @@ static void memory_info_task(void) {
         sprintf(mem_str, "Memory: %u/%u KB free", free_mem / 1024, total_mem / 1024);
         vga_puts_at(mem_str, 22, 0, VGA_CYAN | (VGA_BLACK << 4));
 
-        timer_delay(2000);
+        task_sleep(2000);
     }
 }
 
@@ -381,7 +381,7 @@ static void interrupt_test_task(void) {
         static volatile u32 atomic_test = 0;
         atomic_inc(&atomic_test);
 
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -408,7 +408,7 @@ static void rtc_demo_task(void) {
         sprintf(mem_str, "CMOS: %u KB base, %u KB ext", base_mem, ext_mem);
         vga_puts_at(mem_str, 14, 40, VGA_LGRAY | (VGA_BLACK << 4));
 
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -430,7 +430,7 @@ static void serial_demo_task(void) {
             vga_puts_at(echo_str, 15, 40, VGA_GREEN | (VGA_BLACK << 4));
         }
 
-        timer_delay(2000);
+        task_sleep(2000);
     }
 }
 
@@ -469,7 +469,7 @@ static void floppy_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -497,7 +497,7 @@ static void acpi_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -518,7 +518,7 @@ static void apic_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -543,7 +543,7 @@ static void usb_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(2000);
+        task_sleep(2000);
     }
 }
 
@@ -573,7 +573,7 @@ static void audio_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -614,7 +614,7 @@ static void network_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -646,7 +646,7 @@ static void dma_demo_task(void) {
     vga_puts_at(status_str, 22, 40, VGA_YELLOW | (VGA_BLACK << 4));
 
     while (1) {
-        timer_delay(2000);
+        task_sleep(2000);
     }
 }
 
@@ -675,7 +675,7 @@ static void hpet_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(100);
+        task_sleep(100);
     }
 }
 
@@ -705,7 +705,7 @@ static void msr_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(2000);
+        task_sleep(2000);
     }
 }
 
@@ -750,7 +750,7 @@ static void smbios_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -786,7 +786,7 @@ static void thermal_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(2000);
+        task_sleep(2000);
     }
 }
 
@@ -818,7 +818,7 @@ static void power_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -853,7 +853,7 @@ static void iommu_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -884,7 +884,7 @@ static void cache_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -915,7 +915,7 @@ static void vmx_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -963,7 +963,7 @@ static void perfmon_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(2000);
+        task_sleep(2000);
     }
 }
 
@@ -992,7 +992,7 @@ static void longmode_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -1021,7 +1021,7 @@ static void microcode_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -1060,7 +1060,7 @@ static void x2apic_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -1100,7 +1100,7 @@ static void topology_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -1130,7 +1130,7 @@ static void xsave_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -1172,7 +1172,7 @@ static void numa_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -1203,7 +1203,7 @@ static void security_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -1238,7 +1238,7 @@ static void debug_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -1285,7 +1285,7 @@ static void errata_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -1326,7 +1326,7 @@ static void cpufreq_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -1363,7 +1363,7 @@ static void ioapic_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -1406,7 +1406,7 @@ static void cpuid_ext_demo_task(void) {
     vga_puts_at(feat_str, 17, 40, VGA_WHITE | (VGA_BLACK << 4));
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -1450,7 +1450,7 @@ static void cache_mgmt_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -1490,7 +1490,7 @@ static void memory_mgmt_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -1535,7 +1535,7 @@ static void cpu_features_demo_task(void) {
     vga_puts_at(xd_str, 18, 0, VGA_LGRAY | (VGA_BLACK << 4));
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -1572,7 +1572,7 @@ static void simd_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -1608,7 +1608,7 @@ static void interrupt_mgmt_demo_task(void) {
     vga_puts_at(nest_str, 24, 40, VGA_LGRAY | (VGA_BLACK << 4));
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -1657,7 +1657,7 @@ static void atomic_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -1702,7 +1702,7 @@ static void power_mgmt_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -1744,7 +1744,7 @@ static void memory_protection_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -1790,7 +1790,7 @@ static void virt_ext_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -1831,7 +1831,7 @@ static void debug_hw_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -1868,7 +1868,7 @@ static void pmu_ext_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -1920,7 +1920,7 @@ static void trace_hw_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -1957,7 +1957,7 @@ static void exception_mgmt_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -1999,7 +1999,7 @@ static void memory_adv_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -2045,7 +2045,7 @@ static void security_ext_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -2086,7 +2086,7 @@ static void freq_scaling_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -2132,7 +2132,7 @@ static void system_ctrl_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -2178,7 +2178,7 @@ static void cpu_ext_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -2217,7 +2217,7 @@ static void microarch_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -2257,7 +2257,7 @@ static void apic_ext_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -2311,7 +2311,7 @@ static void timing_sync_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -2353,7 +2353,7 @@ static void cache_coherency_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -2396,7 +2396,7 @@ static void memory_ordering_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -2448,7 +2448,7 @@ static void power_states_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -2494,7 +2494,7 @@ static void cpu_topology_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -2540,7 +2540,7 @@ static void interrupt_routing_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -2584,7 +2584,7 @@ static void cpu_errata_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -2637,7 +2637,7 @@ static void virtualization_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -2678,7 +2678,7 @@ static void iommu_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -2727,7 +2727,7 @@ static void performance_monitoring_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(2000);
+        task_sleep(2000);
     }
 }
 
@@ -2780,7 +2780,7 @@ static void cpu_security_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -2826,7 +2826,7 @@ static void memory_protection_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -2874,7 +2874,7 @@ static void cpu_debug_ext_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(5000);
+        task_sleep(5000);
     }
 }
 
@@ -2924,7 +2924,7 @@ static void cpu_instruction_ext_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -2971,7 +2971,7 @@ static void system_mgmt_mode_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -3018,7 +3018,7 @@ static void thermal_mgmt_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(2000);
+        task_sleep(2000);
     }
 }
 
@@ -3076,7 +3076,7 @@ static void hwcrypto_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3000);
+        task_sleep(3000);
     }
 }
 
@@ -3146,7 +3146,7 @@ static void memory_subsys_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(4000);
+        task_sleep(4000);
     }
 }
 
@@ -3209,7 +3209,7 @@ static void hw_transactional_demo_task(void) {
     }
 
     while (1) {
-        timer_delay(3500);
+        task_sleep(3500);
     }
 }
 
@@ -3223,7 +3223,7 @@ static void system_info_task(void) {
         sprintf(stats, "Ticks: %u  Freq: %u Hz", ticks, freq);
         vga_puts_at(stats, 24, 0, VGA_YELLOW | (VGA_BLACK << 4));
 
-        timer_delay(1000);
+        task_sleep(1000);
     }
 }
 
@@ -3,6 +3,8 @@
  */
 
 #include "kernel/types.h"
+#include "kernel/smp.h"
+#include "kernel/mem.h"
 
 const char *arch_name(void) { return "x86-32"; }
 const char *mcu_name(void)  { return "QEMU-i686"; }
@@ -86,6 +88,7 @@ void thermal_mgmt_init(void);
 void hwcrypto_init(void);
 void memory_subsys_init(void);
 void hw_transactional_init(void);
+void spin_elision_init(void);
 void x86_pc_demo_init(void);
 
 void clock_init(void) {
@@ -96,8 +99,9 @@ void clock_init(void) {
     idt_init();
     pic_init();
 
-    /* Initialize memory management */
-    paging_init(64 * 1024 * 1024); /* 64MB default */
+    /* Initialize memory management: the boot map, else 64MB */
+    detect_memory_x86(boot_mbi);
+    paging_init(64 * 1024 * 1024);
 
     /* Initialize MSR support */
     msr_init();
@@ -263,6 +267,7 @@ void clock_init(void) {
 
     /* Initialize hardware transactional memory */
     hw_transactional_init();
+    spin_elision_init();        /* elided spinlocks need RTM, found above */
 
     /* Initialize ACPI */
     acpi_init();
@@ -353,5 +358,6 @@ void gpio_init(void) {
 }
 
 void ipc_init(void) {
-    /* Single core for now */
+    /* Bring up the APs; they wait in sched_start() */
+    smp_init();
 }
@@ -0,0 +1,148 @@
+/*
+ * arch/x86/smp.c – AP bring-up (INIT-SIPI-SIPI) and CPU numbering
+ *
+ * CPUs come from the MADT; each AP gets a boot stack, turns on paging
+ * with the BSP's tables, loads the shared IDT, enables its LAPIC and
+ * parks in sched_start() until the BSP starts scheduling. The BSP
+ * switches to the trampoline GDT as well so every CPU can find its
+ * number in %fs.
+ */
+
+#include "kernel/types.h"
+#include "kernel/smp.h"
+#include "kernel/sched.h"
+
+#define AP_STACK_SIZE    1024
+#define AP_BOOT_WAIT_MS  100
+
+extern u8 ap_trampoline_start[], ap_trampoline_end[];
+extern u8 ap_gdt_ptr[], ap_boot_cpu[], ap_boot_stack[];
+
+extern void paging_ap_init(void);
+extern u8 apic_is_enabled(void);
+extern u8 apic_get_id(void);
+extern void apic_init_ap(void);
+extern void apic_send_ipi(u8 dest_apic_id, u8 vector);
+extern void apic_send_init_ipi(u8 dest_apic_id);
+extern void apic_send_startup_ipi(u8 dest_apic_id, u8 vector);
+extern u8 acpi_get_cpu_count(void);
+extern u8 acpi_get_cpu_apic_id(u8 index);
+extern u8 cpu_topology_add_cpu(u32 apic_id);
+extern u8 cpu_topology_is_same_core(u32 apic_id1, u32 apic_id2);
+extern u8 cpu_topology_shares_cache(u32 apic_id1, u32 apic_id2, u8 cache_level);
+extern void idt_load(void);
+extern void timer_delay(u32 ms);
+extern void uart_puts(const char* s);
+
+static u8 cpu_apic[SMP_MAX_CPUS];
+static u8 steal_order[SMP_MAX_CPUS][SMP_MAX_CPUS];
+static u32 num_cpus = 1;
+static volatile u32 cpus_online = 1;
+static u8 ap_stacks[SMP_MAX_CPUS][AP_STACK_SIZE] __attribute__((aligned(16)));
+
+#define AP_PARAM(sym) \
+    ((volatile u32*)(SMP_TRAMPOLINE + ((u32)(sym) - (u32)ap_trampoline_start)))
+
+u32 smp_num_cpus(void) {
+    return num_cpus;
+}
+
+const u8* smp_steal_order(u32 cpu) {
+    return steal_order[cpu];
+}
+
+void smp_send_ipi(u32 cpu, u8 vector) {
+    if (cpu < num_cpus && cpu != smp_cpu_id()) {
+        apic_send_ipi(cpu_apic[cpu], vector);
+    }
+}
+
+void smp_send_resched(u32 cpu) {
+    smp_send_ipi(cpu, SMP_RESCHED_VECTOR);
+}
+
+void smp_ap_entry(void) {
+    paging_ap_init();
+    idt_load();
+    apic_init_ap();
+    __sync_fetch_and_add(&cpus_online, 1);
+    sched_start();      // parks until the BSP calls sched_start()
+}
+
+// 0 = SMT sibling, 1 = shared L2, 2 = shared L3, 3 = nothing shared
+static u8 cpu_distance(u32 a, u32 b) {
+    if (cpu_topology_is_same_core(cpu_apic[a], cpu_apic[b])) return 0;
+    if (cpu_topology_shares_cache(cpu_apic[a], cpu_apic[b], 2)) return 1;
+    if (cpu_topology_shares_cache(cpu_apic[a], cpu_apic[b], 3)) return 2;
+    return 3;
+}
+
+static void build_steal_order(void) {
+    for (u32 c = 0; c < num_cpus; c++) {
+        u32 n = 0;
+        for (u8 d = 0; d <= 3; d++) {
+            for (u32 o = 0; o < num_cpus; o++) {
+                if (o != c && cpu_distance(c, o) == d) steal_order[c][n++] = o;
+            }
+        }
+    }
+}
+
+// switch the BSP onto the trampoline GDT and take selector 0 for %fs
+static void bsp_load_gdt(void) {
+    __asm__ volatile(
+        "lgdt (%0)\n"
+        "ljmp $0x08, $1f\n"
+        "1:\n"
+        "mov $0x10, %%ax\n"
+        "mov %%ax, %%ds\n"
+        "mov %%ax, %%es\n"
+        "mov %%ax, %%ss\n"
+        "mov %%ax, %%gs\n"
+        "mov %1, %%ax\n"
+        "mov %%ax, %%fs\n"
+        : : "r"(AP_PARAM(ap_gdt_ptr)), "i"(SMP_CPU_SEL(0)) : "eax", "memory");
+}
+
+static u8 boot_ap(u32 cpu, u8 apic_id) {
+    *AP_PARAM(ap_boot_cpu) = cpu;
+    *AP_PARAM(ap_boot_stack) = (u32)&ap_stacks[cpu][AP_STACK_SIZE];
+    cpu_apic[cpu] = apic_id;
+
+    apic_send_init_ipi(apic_id);            // asserts, waits 10 ms, deasserts
+    for (u8 sipi = 0; sipi < 2; sipi++) {
+        apic_send_startup_ipi(apic_id, SMP_TRAMPOLINE >> 12);
+        for (u32 ms = 0; ms < AP_BOOT_WAIT_MS; ms++) {
+            if (cpus_online > cpu) return 1;
+            timer_delay(1);
+        }
+    }
+    return 0;
+}
+
+void smp_init(void) {
+    u32 n = acpi_get_cpu_count();
+    if (!apic_is_enabled() || n < 2) return;
+
+    u32 len = (u32)(ap_trampoline_end - ap_trampoline_start);
+    u8* dst = (u8*)SMP_TRAMPOLINE;
+    for (u32 i = 0; i < len; i++) dst[i] = ap_trampoline_start[i];
+
+    bsp_load_gdt();
+    u8 bsp = apic_get_id();
+    cpu_apic[0] = bsp;
+
+    for (u32 i = 0; i < n && num_cpus < SMP_MAX_CPUS; i++) {
+        u8 id = acpi_get_cpu_apic_id(i);
+        if (id == bsp) continue;
+        if (!boot_ap(num_cpus, id)) {
+            uart_puts("SMP: AP did not start\r\n");
+            continue;
+        }
+        cpu_topology_add_cpu(id);
+        num_cpus++;
+    }
+
+    build_steal_order();
+    uart_puts("SMP: APs online\r\n");
+}
@@ -20,6 +20,7 @@ void acpi_reboot(void);
 /* Hardware information */
 u32 acpi_get_local_apic_base(void);
 u8 acpi_get_cpu_count(void);
+u8 acpi_get_cpu_apic_id(u8 index);
 u32 acpi_get_pm_timer(void);
 
 /* MADT enumeration */
@@ -9,6 +9,7 @@
 
 /* Core functions */
 void apic_init(u32 lapic_addr, u32 ioapic_addr);
+void apic_init_ap(void);
 u8 apic_is_enabled(void);
 
 /* Local APIC functions */
@@ -26,6 +27,7 @@ void apic_broadcast_ipi(u8 vector);
 
 /* Local APIC timer */
 void apic_timer_init(u32 frequency);
+void apic_timer_tsc_deadline(u8 vector);
 void apic_timer_stop(void);
 
 /* I/O APIC functions */
@@ -24,6 +24,8 @@ u64 hpet_get_timestamp_us(void);
 /* Timer functions */
 u8 hpet_setup_timer(u8 timer_num, u32 period_us, u8 periodic, u8 irq);
 void hpet_disable_timer(u8 timer_num);
+u8 hpet_set_comparator(u8 timer_num, u64 counter, u8 gsi);  /* one-shot, absolute */
+u32 hpet_get_route_cap(u8 timer_num);
 
 /* Information functions */
 u8 hpet_get_num_timers(void);
@@ -7,8 +7,11 @@
 
 #include "kernel/types.h"
 
+#define IDT_PROBE_VECTOR 49     /* no device: latency probe (irq_probe_handler) */
+
 /* Core functions */
 void idt_init(void);
+void idt_load(void);
 
 /* Interrupt control */
 void enable_interrupts(void);
@@ -31,5 +34,6 @@ void write_barrier(void);
 /* Handlers */
 void isr_handler(u32 int_no, u32 err_code, u32 eip, u32 cs, u32 eflags);
 void irq_handler(u32 irq_no);
+void irq_probe_handler(void);
 
 #endif
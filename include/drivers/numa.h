@@ -47,6 +47,6 @@ void numa_free(void* ptr, u32 size);
 
 /* Page management */
 u8 numa_get_page_node(void* page_addr);
-void numa_migrate_pages(void* start_addr, u32 page_count, u8 target_node);
+u32 numa_migrate_pages(void* start_addr, u32 page_count, u8 target_node);  /* pages moved */
 
 #endif
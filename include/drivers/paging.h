@@ -6,6 +6,23 @@
 #define PAGING_H
 
 #include "kernel/types.h"
+#include "kernel/buddy.h"
+
+/* 1: 64-bit PAE entries, 2MB large pages, NX and physical addresses
+   above 4GB in paging_map_region(); 0: classic tables, 4MB PSE pages */
+#ifndef PAGING_PAE
+#define PAGING_PAE 0
+#endif
+
+#if PAGING_PAE
+#define PAGE_LARGE_SIZE 0x200000
+#else
+#define PAGE_LARGE_SIZE 0x400000
+#endif
+
+/* paging_alloc_pages() and paging_map_frames() map in here */
+#define PAGING_HEAP_BASE 0xD0000000
+#define PAGING_HEAP_SIZE 0x10000000
 
 /* Page flags */
 #define PAGE_PRESENT    0x001
@@ -17,18 +34,44 @@
 #define PAGE_DIRTY      0x040
 #define PAGE_SIZE_4MB   0x080
 #define PAGE_GLOBAL     0x100
+#define PAGE_NX         0x800   /* no-execute; ignored without PAE + NX */
+
+typedef struct {
+    u32 invlpg;             /* single-page invalidations, all CPUs */
+    u32 full_flushes;
+    u32 shootdowns;         /* rounds that had to reach other CPUs */
+    u32 ipis;
+} paging_tlb_stats_t;
 
 /* Core functions */
 void paging_init(u32 memory_size);
+void paging_ap_init(void);              /* each AP, before touching the heap */
+u8 paging_large_pages(void);            /* 1 when PSE or PAE large pages are on */
 
 /* Page mapping */
 u32 paging_map_page(u32 virtual_addr, u32 physical_addr, u32 flags);
 void paging_unmap_page(u32 virtual_addr);
+void paging_unmap_range(u32 virtual_addr, u32 count);  /* frees the frames, one flush */
 u32 paging_get_physical_addr(u32 virtual_addr);
 
+/* Regions: largest page size that fits, caller keeps the memory */
+u32 paging_map_region(u32 virtual_addr, u64 physical_addr, u32 size, u32 flags);
+void paging_unmap_region(u32 virtual_addr, u32 size);
+
 /* Memory allocation */
 void* paging_alloc_pages(u32 count);
 void paging_free_pages(void* ptr, u32 count);
+void* paging_map_frames(u32 physical_addr, u32 count);  /* into the heap window */
+u32 paging_alloc_frames(u8 order);    /* 2^order identity-mapped pages */
+void paging_free_frames(u32 addr, u8 order);
+
+/* NUMA: per-node zones are carved out of the direct map */
+u32 paging_move_frames(buddy_zone_t* to, u32 addr, u32 size);
+u32 paging_direct_map_end(void);
+
+/* TLB maintenance: unmapping needs interrupts on (shootdown IPIs) */
+void paging_shootdown_handler(void);    /* SMP_TLB_VECTOR */
+void paging_get_tlb_stats(paging_tlb_stats_t* out);
 
 /* Fault handling */
 void paging_handle_page_fault(u32 error_code, u32 virtual_addr);
@@ -36,5 +79,6 @@ void paging_handle_page_fault(u32 error_code, u32 virtual_addr);
 /* Statistics */
 u32 paging_get_free_memory(void);
 u32 paging_get_used_memory(void);
+u32 paging_get_largest_free_block(void);   /* bytes, contiguous */
 
 #endif
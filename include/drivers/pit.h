@@ -13,6 +13,7 @@ void pit_irq_handler(void);
 
 /* Timing functions */
 u32 pit_get_ticks(void);
+void pit_add_ticks(u32 n);
 u32 pit_get_frequency(void);
 void pit_delay(u32 ms);
 void pit_delay_us(u32 us);
@@ -15,6 +15,12 @@ u8 rtl8139_is_initialized(void);
 u8 rtl8139_send_packet(const void* data, u16 length);
 u16 rtl8139_receive_packet(void* buffer, u16 max_length);
 
+/* Zero-copy: fill/read the packet in the driver's DMA buffers */
+void* rtl8139_tx_reserve(void);
+u8 rtl8139_tx_commit(u16 length);
+const void* rtl8139_rx_borrow(u16* length);
+void rtl8139_rx_release(void);
+
 /* Status functions */
 void rtl8139_get_mac_address(u8* mac);
 u8 rtl8139_is_link_up(void);
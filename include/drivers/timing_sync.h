@@ -15,12 +15,14 @@ u8 timing_sync_is_supported(void);
 u8 timing_sync_is_tsc_supported(void);
 u8 timing_sync_is_hpet_supported(void);
 u8 timing_sync_is_tsc_invariant(void);
+u8 timing_sync_is_tsc_deadline_supported(void);
 u8 timing_sync_is_rdtscp_supported(void);
 
 /* TSC operations */
 u64 timing_sync_get_tsc(void);
 u64 timing_sync_get_tsc_with_cpu_id(u32* cpu_id);
 u64 timing_sync_get_tsc_frequency(void);
+void timing_sync_set_tsc_frequency(u64 frequency);
 void timing_sync_set_tsc_deadline(u64 deadline);
 
 /* HPET operations */
@@ -36,6 +36,7 @@ u8 topology_get_cache_sharing_level3(void);
 u8 topology_get_num_numa_nodes(void);
 u64 topology_get_numa_memory_base(u8 node_id);
 u64 topology_get_numa_memory_size(u8 node_id);
+u32 topology_get_numa_proximity_domain(u8 node_id);  /* SRAT, one per range */
 u8 topology_is_numa_node_enabled(u8 node_id);
 
 #endif
@@ -39,6 +39,7 @@ u32 xsave_get_area_size(void);
 u32 xsave_get_feature_offset(u32 feature_bit);
 u32 xsave_get_feature_size(u32 feature_bit);
 void* xsave_alloc_area(void);
+void xsave_free_area(void* xsave_area);
 void xsave_init_area(void* xsave_area);
 
 /* State save/restore */
@@ -0,0 +1,32 @@
+/*
+ * atomic.h - memory ordering for lock-free kernel code
+ * Portable across ports (GCC __atomic builtins); the x86-only
+ * drivers/atomic.h is the out-of-line driver API.
+ */
+
+#ifndef _BLOOD_ATOMIC_H
+#define _BLOOD_ATOMIC_H
+
+#include "kernel/types.h"
+
+static inline u32 atomic_load_rlx(const volatile u32* p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+// later loads/stores stay after this load
+static inline u32 atomic_load_acq(const volatile u32* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+// earlier loads/stores are visible before this store
+static inline void atomic_store_rel(volatile u32* p, u32 v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// on failure *expected is reloaded with the current value
+static inline u8 atomic_cas_u32(volatile u32* p, u32* expected, u32 desired) {
+    return __atomic_compare_exchange_n(p, expected, desired, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+#endif
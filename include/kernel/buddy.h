@@ -0,0 +1,90 @@
+/*
+ * buddy.h - binary buddy page allocator
+ *
+ * A zone manages pages [base, base + pages * BUDDY_PAGE_SIZE). Free
+ * blocks are 2^order pages, aligned to their size relative to base,
+ * and kept on one list per order; the list links live in the free
+ * pages themselves, so the zone's memory must be directly addressable.
+ * The only other state is one byte per page (order and a free flag on
+ * the first page of each free block). Allocation takes the smallest
+ * non-empty order and splits it down; free merges with the buddy for
+ * as long as the buddy is a free block of the same order. Both are
+ * O(BUDDY_MAX_ORDER).
+ *
+ * buddy_alloc_pages() hands out exactly count contiguous pages by
+ * rounding up and giving the tail back; buddy_free_pages() takes any
+ * run of allocated pages, so a block may be freed piecemeal.
+ *
+ * Single pages go through a per-CPU cache: buddy_alloc_page() and
+ * buddy_free_page() touch only this CPU's list, with kernel IRQs
+ * masked, and take the zone lock once per BUDDY_PCP_BATCH pages to
+ * refill an empty list or drain one past BUDDY_PCP_HIGH. Cached pages
+ * count as allocated to the zone (free_pages leaves them out, and the
+ * cached path has no double-free check). A buddy_alloc() that finds
+ * nothing drains this CPU's list and retries; other CPUs' lists are
+ * only drained by their owners.
+ */
+
+#ifndef _BLOOD_BUDDY_H
+#define _BLOOD_BUDDY_H
+
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/smp.h"
+
+#define BUDDY_PAGE_SHIFT 12
+#define BUDDY_PAGE_SIZE  (1u << BUDDY_PAGE_SHIFT)
+#define BUDDY_MAX_ORDER  11         // blocks of 1 .. 1024 pages (4 MB)
+#define BUDDY_PCP_BATCH  16         // pages per refill or drain
+#define BUDDY_PCP_HIGH   (4 * BUDDY_PCP_BATCH)
+
+typedef struct buddy_block {
+    struct buddy_block* next;
+    struct buddy_block* prev;
+} buddy_block_t;
+
+// one CPU's page cache, on its own line
+typedef struct {
+    buddy_block_t* head;            // linked through next
+    u32 count;
+    u32 allocs;
+    u32 hits;                       // allocs served without the zone lock
+    u32 refills;
+    u32 drains;
+} __attribute__((aligned(64))) buddy_pcp_t;
+
+typedef struct {
+    u32 base;                       // address of page 0
+    u32 pages;
+    u8* meta;                       // one byte per page
+    buddy_block_t* free[BUDDY_MAX_ORDER];
+    u32 nr_free[BUDDY_MAX_ORDER];   // blocks per order
+    u32 free_mask;                  // bit o: free[o] not empty
+    u32 free_pages;
+    spinlock_t lock;
+    buddy_pcp_t pcp[SMP_MAX_CPUS];
+} buddy_zone_t;
+
+// every page starts out reserved; meta holds pages bytes
+void buddy_init(buddy_zone_t* z, u32 base, u32 pages, u8* meta);
+// hand [addr, addr + size) to the allocator, trimmed to whole pages
+void buddy_add_range(buddy_zone_t* z, u32 addr, u32 size);
+
+u32 buddy_alloc(buddy_zone_t* z, u8 order);             // 0 when none
+void buddy_free(buddy_zone_t* z, u32 addr, u8 order);
+u32 buddy_alloc_pages(buddy_zone_t* z, u32 count);      // contiguous, 0 when none
+void buddy_free_pages(buddy_zone_t* z, u32 addr, u32 count);
+
+u32 buddy_alloc_page(buddy_zone_t* z);                  // per-CPU cache first
+void buddy_free_page(buddy_zone_t* z, u32 addr);
+void buddy_drain(buddy_zone_t* z);                      // this CPU's cache
+u32 buddy_cached_pages(buddy_zone_t* z);                // all CPUs, racy
+
+// every free page of from in [addr, addr + size) becomes free in to,
+// which must cover the range; pages in per-CPU caches stay behind
+u32 buddy_move_range(buddy_zone_t* from, buddy_zone_t* to, u32 addr, u32 size);
+
+u8 buddy_order_for(u32 count);      // smallest order holding count pages
+u32 buddy_largest_free(buddy_zone_t* z);                // pages, 0 if empty
+
+#endif
@@ -26,6 +26,12 @@ typedef enum {
 void can_init(u32 baud);
 can_err_t can_send(const can_frame_t* frame);
 can_err_t can_recv(can_frame_t* frame);
+const can_frame_t* can_recv_borrow(void);     // in place; 0 when empty
+void can_recv_release(const can_frame_t* frame);
+// block up to timeout_ms for a frame (WAIT_FOREVER, or 0 to poll)
+can_err_t can_recv_timeout(can_frame_t* frame, u32 timeout_ms);
+const can_frame_t* can_recv_borrow_timeout(u32 timeout_ms);
+u32 can_rx_drop_count(void);
 void can_set_filter(u32 id, u32 mask);
 u8 can_tx_mailbox_free(void);
 void can_irq_handler(void);
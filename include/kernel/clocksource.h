@@ -0,0 +1,32 @@
+/*
+ * clocksource.h - one 64-bit monotonic nanosecond clock for everyone
+ *
+ * clock_now_ns() reads the best free-running counter the core has and
+ * scales it: invariant TSC calibrated against the HPET or ACPI PM
+ * timer on x86 (else the HPET, the PM timer or the tick), the DWT
+ * cycle counter on Cortex-M3/M4/M7/M33, the 64-bit TIMER on RP2040,
+ * the millisecond tick anywhere else. Counters narrower than 64 bits
+ * are extended by clocksource_update(), which the tick calls; it must
+ * run at least once per wrap (DWT: 2^32 cycles) and per
+ * CLOCK_MAX_DELTA_S, which tickless idle never exceeds.
+ *
+ * Readers take no lock: a seqlock snapshot of (last count, ns, mult,
+ * shift), one counter read and one multiply, so it is fine in ISRs,
+ * drivers and the tracer's hot path. 0 until clocksource_init().
+ */
+
+#ifndef _BLOOD_CLOCKSOURCE_H
+#define _BLOOD_CLOCKSOURCE_H
+
+#include "kernel/types.h"
+
+#define CLOCK_MAX_DELTA_S 60    // longest gap between updates that scales exactly
+
+void clocksource_init(void);    // after the arch clock_init() found its timers
+void clocksource_update(void);  // from the tick
+u64  clock_now_ns(void);
+
+const char* clocksource_name(void);
+u64  clocksource_hz(void);      // counter rate, 0 before init
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * fpu.h - lazy FPU/SIMD context per task
+ */
+
+#ifndef _BLOOD_FPU_H
+#define _BLOOD_FPU_H
+
+#include "kernel/types.h"
+
+struct task;
+
+void fpu_init(void);                    // once, boot CPU
+void fpu_cpu_init(void);                // every CPU before its first task
+void fpu_attach(struct task* t, u32 slot);
+void fpu_switch(struct task* prev, struct task* next);
+void fpu_trap(void);                    // x86 #NM
+u32 fpu_trap_count(void);
+u32 fpu_save_count(void);
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * hrtimer.h - one-shot timers at clock_now_ns() resolution
+ *
+ * Each CPU keeps its pending timers in a binary min-heap keyed by
+ * expiry, and only the earliest is ever in hardware: the LAPIC
+ * TSC-deadline timer (per CPU) or else an HPET comparator on x86, the
+ * TIMER alarm on RP2040. The hrtimer_arch_*() hooks take other compare
+ * units; without one the tick runs expired timers, so precision drops
+ * to 1 ms but nothing is lost. The tick also checks when hardware is
+ * there, in case an IRQ went missing.
+ *
+ * Callbacks run in IRQ context on the CPU that queued the timer (CPU 0
+ * when the hardware is global), with no lock held. A callback may
+ * re-arm its own timer with hrtimer_start() for periodic work; adding
+ * the period to t->expires rather than to the current time keeps the
+ * phase. hrtimer_cancel() does not wait for a callback already running
+ * on another CPU.
+ */
+
+#ifndef _BLOOD_HRTIMER_H
+#define _BLOOD_HRTIMER_H
+
+#include "kernel/types.h"
+
+#define HRTIMER_MAX      32             // queued timers per CPU
+#define HRTIMER_MAX_ARM  1000000000ULL  // ns; longer waits re-arm on the way
+#define HRTIMER_IDLE     0xFFFFFFFF     // index of a timer not queued
+
+// what hrtimer_arch_setup() found
+#define HRTIMER_HW_NONE   0             // tick only
+#define HRTIMER_HW_GLOBAL 1             // one compare unit, CPU 0 takes the IRQ
+#define HRTIMER_HW_PERCPU 2             // each CPU arms its own
+
+struct hrtimer;
+typedef void (*hrtimer_fn_t)(struct hrtimer* t);
+
+typedef struct hrtimer {
+    u64 expires;                // clock_now_ns() deadline
+    hrtimer_fn_t fn;
+    void* arg;
+    u32 index;                  // heap slot, or HRTIMER_IDLE
+    u8 cpu;                     // whose heap
+} hrtimer_t;
+
+void hrtimer_setup(void);       // after clocksource_init()
+void hrtimer_init(hrtimer_t* t, hrtimer_fn_t fn, void* arg);
+u8 hrtimer_start(hrtimer_t* t, u64 expires_ns);     // 0: heap full
+u8 hrtimer_start_in(hrtimer_t* t, u64 delay_ns);
+u8 hrtimer_cancel(hrtimer_t* t);                    // 1 if it was queued
+u8 hrtimer_active(const hrtimer_t* t);
+
+void hrtimer_interrupt(void);   // compare IRQ: run what is due, re-arm
+void hrtimer_tick(void);        // from the tick, fallback and safety net
+u8 hrtimer_hw(void);            // HRTIMER_HW_*
+
+// arch (weak defaults: no hardware): pick a compare unit, then arm a
+// one-shot IRQ at clock_now_ns() == ns on this CPU; ns == 0 disarms
+u8 hrtimer_arch_setup(void);
+void hrtimer_arch_program(u64 ns);
+
+#endif
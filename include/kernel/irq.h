@@ -0,0 +1,84 @@
+/*
+ * irq.h - interrupt masking that nests
+ *
+ * irq_save() masks everything and returns the previous state for
+ * irq_restore(), so it is safe inside ISRs and other masked sections.
+ * irq_save_kernel() masks only kernel-priority IRQs: on Cortex-M with
+ * BASEPRI, anything configured above IRQ_KERNEL_PRIO (numerically
+ * lower) keeps running. Such control ISRs must not touch kernel
+ * objects. Cores without BASEPRI fall back to the full mask.
+ */
+
+#ifndef _BLOOD_IRQ_H
+#define _BLOOD_IRQ_H
+
+#include "kernel/types.h"
+
+#if defined(__arm__) && (defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || \
+                         defined(__ARM_ARCH_8M_MAIN__))
+#define IRQ_HAVE_BASEPRI 1
+#endif
+
+#define IRQ_KERNEL_PRIO 0x40    // NVIC priority byte of every kernel IRQ
+
+static inline u32 irq_save(void) {
+    u32 flags = 0;
+#ifdef __x86_64__
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+#elif defined(__arm__)
+    __asm__ volatile("mrs %0, primask; cpsid i" : "=r"(flags) :: "memory");
+#endif
+    return flags;
+}
+
+static inline void irq_restore(u32 flags) {
+#ifdef __x86_64__
+    if (flags & 0x200) __asm__ volatile("sti" ::: "memory");  // EFLAGS.IF
+#elif defined(__arm__)
+    __asm__ volatile("msr primask, %0" :: "r"(flags) : "memory");
+#endif
+}
+
+static inline u32 irq_save_kernel(void) {
+#ifdef IRQ_HAVE_BASEPRI
+    u32 flags;
+    // basepri_max only ever raises the mask, so nesting is free
+    __asm__ volatile("mrs %0, basepri\n msr basepri_max, %1"
+                     : "=&r"(flags) : "r"(IRQ_KERNEL_PRIO) : "memory");
+    return flags;
+#else
+    return irq_save();
+#endif
+}
+
+static inline void irq_restore_kernel(u32 flags) {
+#ifdef IRQ_HAVE_BASEPRI
+    __asm__ volatile("msr basepri, %0" :: "r"(flags) : "memory");
+#else
+    irq_restore(flags);
+#endif
+}
+
+// 1 outside any ISR with nothing masked: the caller may block
+static inline u8 irq_can_sleep(void) {
+#ifdef __x86_64__
+    u32 flags;      // ISRs run with IF clear
+    __asm__ volatile("pushf; pop %0" : "=r"(flags));
+    return (flags & 0x200) != 0;
+#elif defined(__arm__)
+    u32 ipsr, primask, basepri = 0;
+    __asm__ volatile("mrs %0, ipsr" : "=r"(ipsr));
+    __asm__ volatile("mrs %0, primask" : "=r"(primask));
+#ifdef IRQ_HAVE_BASEPRI
+    __asm__ volatile("mrs %0, basepri" : "=r"(basepri));
+#endif
+    return !ipsr && !primask && !basepri;
+#else
+    return 0;
+#endif
+}
+
+void irq_prio_init(void);                   // every IRQ to IRQ_KERNEL_PRIO
+void irq_set_prio(s32 irqn, u8 prio);       // < 0: system handlers
+
+#endif
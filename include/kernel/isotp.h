@@ -19,5 +19,6 @@ typedef struct {
 void isotp_init(void);
 u8   isotp_send(const isotp_msg_t* msg);
 u8   isotp_recv(isotp_msg_t* msg);
+u8   isotp_recv_timeout(isotp_msg_t* msg, u32 timeout_ms);
 
 #endif
@@ -0,0 +1,64 @@
+/*
+ * klog.h - deferred binary logging
+ *
+ * KLOG("fmt", a, b) costs a ring slot, a timestamp and a few stores:
+ * no formatting, no UART, no lock, so it is fine in ISRs and the
+ * scheduler. The record holds the format string's address (its ID),
+ * up to KLOG_MAX_ARGS raw 32-bit arguments and clock_now_ns(); the
+ * string itself goes to the .klog_fmt section. Each CPU has its own
+ * MPSC ring (ISRs preempting a task on the same CPU are the other
+ * producers); a full ring drops the record and the next one carries
+ * the count.
+ *
+ * klog_task() drains the rings in timestamp order at low priority and
+ * prints them with the kprintf formats, or with KLOG_RAW=1 sends the
+ * records as they are and tools/klog_decode.py formats them on the
+ * host from the ELF. %s arguments are stored as pointers, so they must
+ * outlive the record: string literals and other static text only.
+ */
+
+#ifndef _BLOOD_KLOG_H
+#define _BLOOD_KLOG_H
+
+#include "kernel/types.h"
+
+#ifndef KLOG_RAW
+#define KLOG_RAW 0
+#endif
+
+#define KLOG_RING      64       // records per CPU, power of two
+#define KLOG_MAX_ARGS  4
+#define KLOG_DRAIN_MS  20
+#define KLOG_SYNC      0x474F4C4B   // "KLOG", ahead of each raw record
+
+typedef struct {
+    u32 fmt;                    // address in .klog_fmt
+    u8  nargs;
+    u8  cpu;
+    u16 lost;                   // dropped on this CPU just before this one
+    u64 ts;                     // clock_now_ns()
+    u32 args[KLOG_MAX_ARGS];
+} klog_rec_t;                   // 32 bytes; tools/klog_decode.py reads this
+
+void klog_init(void);
+void klog_write(const char* fmt, u32 nargs, u32 a0, u32 a1, u32 a2, u32 a3);
+u32  klog_drain(void);          // records output
+void klog_task(void);
+
+#define KLOG_FMT_(f) ({                                                 \
+    static const char klog_fmt_[] __attribute__((section(".klog_fmt"))) = f; \
+    klog_fmt_; })
+#define KLOG_A_(a) ((u32)(unsigned long)(a))     // pointers too (%s)
+
+#define KLOG_0_(f)             klog_write(KLOG_FMT_(f), 0, 0, 0, 0, 0)
+#define KLOG_1_(f, a)          klog_write(KLOG_FMT_(f), 1, KLOG_A_(a), 0, 0, 0)
+#define KLOG_2_(f, a, b)       klog_write(KLOG_FMT_(f), 2, KLOG_A_(a), KLOG_A_(b), 0, 0)
+#define KLOG_3_(f, a, b, c)    klog_write(KLOG_FMT_(f), 3, KLOG_A_(a), KLOG_A_(b), KLOG_A_(c), 0)
+#define KLOG_4_(f, a, b, c, d) klog_write(KLOG_FMT_(f), 4, KLOG_A_(a), KLOG_A_(b), KLOG_A_(c), KLOG_A_(d))
+#define KLOG_PICK_(_0, _1, _2, _3, _4, name, ...) name
+
+// the format must be a string literal
+#define KLOG(...) \
+    KLOG_PICK_(__VA_ARGS__, KLOG_4_, KLOG_3_, KLOG_2_, KLOG_1_, KLOG_0_, 0)(__VA_ARGS__)
+
+#endif
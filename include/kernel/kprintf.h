@@ -5,6 +5,9 @@
 #ifndef _BLOOD_KPRINTF_H
 #define _BLOOD_KPRINTF_H
 
+#include "kernel/types.h"
+
 void kprintf(const char* fmt, ...);
+void kprintf_args(const char* fmt, const u32* args, u32 nargs);
 
 #endif
@@ -7,7 +7,18 @@
 
 #include "kernel/types.h"
 
-void detect_memory_x86(u32 mbi_addr);
+#define MEM_MAX_REGIONS 16
+
+// usable RAM, below 4 GB
+typedef struct {
+    u32 base;
+    u32 size;
+} mem_region_t;
+
+extern u32 boot_mbi;                        // x86: multiboot info, 0 if none
+
+void detect_memory_x86(u32 mbi_addr);       // prints and records the map
+u32 mem_regions(const mem_region_t** regions);  // count, 0 before detect
 void detect_memory_arm(void);
 
 #endif
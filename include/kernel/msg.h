@@ -6,24 +6,28 @@
 #define _BLOOD_MSG_H
 
 #include "kernel/types.h"
+#include "kernel/ring.h"
+#include "kernel/sched.h"
 
 #define MSG_SIZE 16          // bytes per message
-#define MSG_DEPTH 8          // messages per queue
+#define MSG_DEPTH 8          // messages per queue, power of two
 
 typedef struct {
     u8 data[MSG_SIZE];
 } msg_t;
 
+// lock-free: any task or ISR may send, one task receives
 typedef struct {
     msg_t buf[MSG_DEPTH];
-    u8 head;
-    u8 tail;
-    u8 count;
-    spinlock_t lock;
+    volatile u32 seq[MSG_DEPTH];
+    mpsc_ring_t ring;
+    wait_queue_t rx_wq;     // the receiver, while blocked
 } msg_queue_t;
 
 void msg_init(msg_queue_t* q);
 u8 msg_send(msg_queue_t* q, const msg_t* msg);
 u8 msg_recv(msg_queue_t* q, msg_t* msg);
+// blocks up to timeout_ms (WAIT_FOREVER, or 0 to poll); 0 on timeout
+u8 msg_recv_timeout(msg_queue_t* q, msg_t* msg, u32 timeout_ms);
 
 #endif
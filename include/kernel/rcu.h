@@ -0,0 +1,35 @@
+/*
+ * rcu.h - publish/grace-period for read-mostly tables
+ *
+ * Quiescent-state based: the scheduler calls rcu_qs() every time it
+ * runs on a CPU, and nothing may be held across schedule(), so a CPU
+ * that has scheduled since an update can no longer be reading the old
+ * version. Readers cost nothing at run time: rcu_read_lock/unlock only
+ * stop the compiler moving loads out of the section, and
+ * rcu_dereference() is a plain (dependency-ordered) load. A read
+ * section must not sleep or yield; ISRs are read sections by nature.
+ *
+ * Writers build the new version off to the side, publish it with
+ * rcu_assign_pointer() and call synchronize_rcu() before freeing or
+ * reusing the old one. synchronize_rcu() yields, so task context only,
+ * and never with a spinlock held. Before sched_start() there are no
+ * other readers and it returns at once.
+ */
+
+#ifndef _BLOOD_RCU_H
+#define _BLOOD_RCU_H
+
+#include "kernel/types.h"
+
+#define rcu_read_lock()   __asm__ volatile("" ::: "memory")
+#define rcu_read_unlock() __asm__ volatile("" ::: "memory")
+
+// every store to *v is visible before p is
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define rcu_dereference(p)       __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+void rcu_qs(void);              // scheduler only
+void synchronize_rcu(void);     // every CPU has passed rcu_qs() since the call
+u32 rcu_grace_periods(void);
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * ring.h - lock-free ring queues for ISR-to-task paths
+ *
+ * spsc_ring_t: one producer, one consumer; head and tail are each
+ * written by one side only, so no atomic read-modify-write at all.
+ * mpsc_ring_t: any number of producers (ISRs at different priorities,
+ * other CPUs) claim slots with a CAS; each slot carries a sequence
+ * number that says whose turn it is, so a producer preempted between
+ * reserve and commit only delays its own slot, never blocks another.
+ *
+ * Sizes are powers of two; indexes run free and are masked. Slots are
+ * filled and read in place: reserve/commit and peek/consume, with
+ * push/pop as copying wrappers.
+ */
+
+#ifndef _BLOOD_RING_H
+#define _BLOOD_RING_H
+
+#include "kernel/types.h"
+
+typedef struct {
+    u8* buf;
+    u32 mask;               // slots - 1
+    u16 elem_size;
+    volatile u32 head;      // producer only
+    volatile u32 tail;      // consumer only
+} spsc_ring_t;
+
+typedef struct {
+    u8* buf;
+    volatile u32* seq;      // per slot: pos when free, pos + 1 when full
+    u32 mask;
+    u16 elem_size;
+    volatile u32 head;      // producers, by CAS
+    volatile u32 tail;      // consumer only
+} mpsc_ring_t;
+
+#define RING_CHECK_SIZE(n) \
+    _Static_assert((n) && !((n) & ((n) - 1)), "ring size must be a power of two")
+
+#define SPSC_RING_DEFINE(name, type, n)                                 \
+    RING_CHECK_SIZE(n);                                                 \
+    static type name##_buf[n];                                          \
+    static spsc_ring_t name = { (u8*)name##_buf, (n) - 1, sizeof(type), 0, 0 }
+
+#define MPSC_RING_DEFINE(name, type, n)                                 \
+    RING_CHECK_SIZE(n);                                                 \
+    static type name##_buf[n];                                          \
+    static volatile u32 name##_seq[n];                                  \
+    static mpsc_ring_t name = { (u8*)name##_buf, name##_seq, (n) - 1, sizeof(type), 0, 0 }
+
+void spsc_init(spsc_ring_t* r);
+void* spsc_reserve(spsc_ring_t* r);             // 0 when full
+void spsc_commit(spsc_ring_t* r);
+const void* spsc_peek(spsc_ring_t* r);          // 0 when empty
+void spsc_consume(spsc_ring_t* r);
+u8 spsc_push(spsc_ring_t* r, const void* elem);
+u8 spsc_pop(spsc_ring_t* r, void* elem);
+u32 spsc_count(spsc_ring_t* r);
+
+void mpsc_init(mpsc_ring_t* r);                 // required: seeds seq[]
+void* mpsc_reserve(mpsc_ring_t* r);             // 0 when full
+void mpsc_commit(mpsc_ring_t* r, void* slot);
+const void* mpsc_peek(mpsc_ring_t* r);          // 0 when empty
+void mpsc_consume(mpsc_ring_t* r);
+u8 mpsc_push(mpsc_ring_t* r, const void* elem);
+u8 mpsc_pop(mpsc_ring_t* r, void* elem);
+
+#endif
@@ -1,33 +1,119 @@
 /*
- * sched.h - minimal round-robin scheduler with safety
+ * sched.h - O(1) priority scheduler with safety
  */
 
 #ifndef _BLOOD_SCHED_H
 #define _BLOOD_SCHED_H
 
 #include "kernel/types.h"
+#include "kernel/spinlock.h"
 
+#ifndef MAX_TASKS
 #define MAX_TASKS 32
+#endif
 #define KERNEL_STACK_SIZE 512
 #define STACK_CANARY 0xDEADBEEF
 
+/* 0 = most urgent; one ready-bitmap bit per level */
+#define SCHED_PRIO_LEVELS  32
+#define SCHED_PRIO_DEFAULT 16
+#define SCHED_PRIO_IDLE    (SCHED_PRIO_LEVELS - 1)
+
+/* level 0 is the periodic class: EDF, or rate-monotonic with SCHED_RT_RM */
+#define SCHED_PRIO_RT      0
+#ifndef SCHED_RT_RM
+#define SCHED_RT_RM        0
+#endif
+
+/* affinity: bit n = may run on CPU n */
+#define SCHED_CPU_ALL 0xFFFFFFFFu
+
+/* hashed timer wheel for task_sleep(); power of two */
+#define TIMER_WHEEL_SLOTS 64
+
+#define TASK_READY   0
+#define TASK_RUNNING 1
+#define TASK_BLOCKED 2
+#define TASK_SLEEPING 3
+#define TASK_WAITING 4              // on a wait queue, maybe also the wheel
+#define TASK_WAKING  5              // claimed by one waker, not yet queued
+
+#define WAIT_FOREVER 0xFFFFFFFFu
+
 typedef void (*task_entry_t)(void);
 
+/*
+ * Wait queue: tasks block on it, producers (tasks or ISRs) wake the
+ * most urgent waiter. seq counts wake-ups; take wq_prepare() before
+ * checking your condition and hand it to wq_wait(), which returns at
+ * once if anything was signalled in between, so no wake-up is lost.
+ * ISR wakers must not be able to preempt the tick interrupt.
+ */
+typedef struct wait_queue {
+    spinlock_t lock;
+    struct task* head;          // by priority, FIFO among equals
+    volatile u32 seq;
+} wait_queue_t;
+
 struct task {
     u32* sp;                    // current stack pointer
     u32 stack_base;             // bottom of stack
     u32 stack_size;
     u32 canary;                 // stack overflow detection
-    u8  state;                  // 0=ready, 1=running, 2=blocked
-    u8  priority;
+    u8  state;                  // TASK_READY / RUNNING / BLOCKED / SLEEPING
+    u8  priority;               // 0..SCHED_PRIO_LEVELS-1
     u32 pid;
+    struct task* next;          // ready list / timer wheel link
+    struct task* prev;
+    u32 wake_tick;              // valid while sleeping
+    u32 affinity;               // CPUs this task may run on
+    u8  cpu;                    // run queue it belongs to
+    u8  on_cpu;                 // running, or switched out but not yet saved
+
+    /* periodic class; period == 0 for normal tasks (all in ticks) */
+    task_entry_t job;           // run once per release
+    u32 period;
+    u32 wcet;
+    u32 deadline;               // relative to release, <= period
+    u32 release_tick;           // current job
+    u32 deadline_tick;          // current job, absolute
+    u32 jobs;                   // completed
+    u32 misses;                 // finished late, or release skipped by overrun
+
+    /* wait queue state; wq stays set until unlinked, even if killed */
+    struct wait_queue* wq;
+    struct task* wq_next;
+    u8  wq_timed;               // also in the timer wheel
+    u8  wq_woken;               // 1: woken by a producer, 0: timed out
+
+    /* lazy FPU/SIMD state, see fpu.c */
+    void* fpu_area;
+    u8  fpu_used;               // fpu_area holds a saved state
+    u8  fpu_cpu;                // CPU whose registers hold it live
 };
 
 void sched_init(void);
 void sched_start(void);
 u32 task_create(task_entry_t entry, void* arg, u32 stack_size);
+u32 task_create_prio(task_entry_t entry, void* arg, u32 stack_size, u8 prio);
+u32 task_create_affinity(task_entry_t entry, void* arg, u32 stack_size, u8 prio,
+                         u32 cpus);
+u8 task_set_affinity(u32 pid, u32 cpus);
+u32 task_create_periodic(task_entry_t entry, u32 period, u32 wcet, u32 deadline);
+u8 task_rt_stats(u32 pid, u32* jobs, u32* misses);
 void task_yield(void);
 void task_exit(void);
+void task_sleep(u32 ms);
+void sched_tick(u32 now);
+u32 sched_next_wake(void);
+u8 sched_balance(void);
 void task_stack_check(void);
+struct task* task_current(void);
+
+void wq_init(wait_queue_t* wq);
+u32 wq_prepare(wait_queue_t* wq);
+u8 wq_wait(wait_queue_t* wq, u32 snap, u32 timeout_ms);    // 0: timed out
+u8 wq_wake_one(wait_queue_t* wq);                          // task or ISR
+u8 wq_wake_all(wait_queue_t* wq);
 
 #endif
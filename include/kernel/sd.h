@@ -12,6 +12,8 @@
 void sd_init(void);
 u8   sd_read(u32 block, u8* buf);
 u8   sd_write(u32 block, const u8* buf);
+// count consecutive blocks: ACMD23 pre-erase, one CMD25, one busy wait each
+u8   sd_write_multi(u32 block, const u8* buf, u32 count);
 u32  sd_capacity(void);
 
 #endif
@@ -0,0 +1,54 @@
+/*
+ * seqlock.h - sequence locks for small, read-mostly records
+ *
+ * Writers serialise on an irqsave spinlock and bump seq before and after
+ * the update, so it is odd while a write is in flight. Readers take no
+ * lock and write nothing: they copy the record out between
+ * read_seqbegin() and read_seqretry() and go round again if a writer
+ * got in. Readers must copy, not keep pointers, and must not sleep in
+ * the loop. Fits records too big to update atomically (u64 counters on
+ * a 32-bit core, a row of a table) whose writers are rare.
+ */
+
+#ifndef _BLOOD_SEQLOCK_H
+#define _BLOOD_SEQLOCK_H
+
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+
+typedef struct {
+    volatile u32 seq;       // odd while a writer is inside
+    spinlock_t lock;        // writers only
+} seqlock_t;
+
+static inline void seqlock_init(seqlock_t* sl) {
+    sl->seq = 0;
+    sl->lock.lock = 0;
+}
+
+static inline u32 read_seqbegin(const seqlock_t* sl) {
+    u32 s;
+    while ((s = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1) {
+    }
+    return s;
+}
+
+// 1 if a writer ran since read_seqbegin() returned s: read again
+static inline u8 read_seqretry(const seqlock_t* sl, u32 s) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != s;
+}
+
+static inline u32 write_seqlock(seqlock_t* sl) {
+    u32 flags = spin_lock_irqsave_kernel(&sl->lock);
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return flags;
+}
+
+static inline void write_sequnlock(seqlock_t* sl, u32 flags) {
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore_kernel(&sl->lock, flags);
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * slab.h - object caches for fixed-size kernel objects
+ *
+ * A cache hands out objects of one size and alignment, carved from
+ * slabs: naturally aligned runs of SLAB_PAGE_SIZE << order bytes with
+ * a header at the front, so free() finds an object's slab by masking.
+ * Successive slabs start their objects one cache line further in
+ * (colouring), so equal offsets in different slabs do not all land in
+ * the same cache sets.
+ *
+ * Each CPU keeps a magazine of up to SLAB_MAG_SIZE free objects; alloc
+ * and free touch only that, with kernel IRQs masked, and go to the
+ * shared slab lists under the cache lock half a magazine at a time.
+ *
+ * With a constructor, objects are constructed once when their slab is
+ * made and must be freed back in constructed state; alloc does not
+ * call it again. Without one, the free-list link lives in the object.
+ *
+ * Slabs come from the page allocator on x86. Elsewhere they come from
+ * SLAB_POOL_SIZE bytes reserved in .bss.slab_pool, so nothing is ever
+ * taken from a heap; a linker script may place that section itself.
+ * Cache descriptors are caller-provided statics.
+ */
+
+#ifndef _BLOOD_SLAB_H
+#define _BLOOD_SLAB_H
+
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/smp.h"
+
+#ifdef __x86_64__
+#define SLAB_PAGE_SIZE  4096
+#define SLAB_MAX_ORDER  3               // slabs up to 32 KB
+#define SLAB_LINE       64
+#else
+#define SLAB_PAGE_SIZE  1024
+#define SLAB_MAX_ORDER  0               // the pool hands out single pages
+#define SLAB_LINE       32
+#ifndef SLAB_POOL_SIZE
+#define SLAB_POOL_SIZE  (8 * SLAB_PAGE_SIZE)
+#endif
+#endif
+
+#define SLAB_MAG_SIZE   8               // objects per CPU magazine
+
+typedef void (*slab_ctor_t)(void* obj);
+
+typedef struct slab {
+    struct slab* next;
+    struct slab* prev;
+    void* free;                 // first free object
+    u32 inuse;
+} slab_t;
+
+typedef struct {
+    u32 count;
+    void* objs[SLAB_MAG_SIZE];
+    u32 allocs;
+    u32 frees;
+    u32 hits;                   // allocs served from the magazine
+    u32 fails;
+} __attribute__((aligned(SLAB_LINE))) slab_mag_t;
+
+typedef struct {
+    u32 obj_size;               // stride, padding included
+    u32 per_slab;
+    u32 slabs;
+    u32 active;                 // handed out and not freed
+    u32 cached;                 // sitting in magazines
+    u32 allocs;
+    u32 frees;
+    u32 hits;
+    u32 fails;
+} slab_stats_t;
+
+typedef struct kmem_cache {
+    const char* name;
+    u32 size;
+    u32 stride;
+    u32 link;                   // offset of the free-list word
+    u32 first;                  // offset of the first object, colour 0
+    u32 per_slab;
+    u32 color_max;
+    u32 color_step;
+    u32 color_next;
+    u8 order;
+    slab_ctor_t ctor;
+    spinlock_t lock;            // lists, colour and slabs
+    slab_t* partial;
+    slab_t* empty;
+    u32 nempty;
+    u32 slabs;
+    struct kmem_cache* next;    // for slab_stats_dump()
+    slab_mag_t mag[SMP_MAX_CPUS];
+} kmem_cache_t;
+
+// 0 if an object cannot fit a slab; align is a power of two, 0 for 4
+u8 kmem_cache_init(kmem_cache_t* c, const char* name, u32 size, u32 align, slab_ctor_t ctor);
+void* kmem_cache_alloc(kmem_cache_t* c);       // 0 when out of memory
+void kmem_cache_free(kmem_cache_t* c, void* obj);
+// empty this CPU's magazine and give empty slabs back
+void kmem_cache_shrink(kmem_cache_t* c);
+
+void kmem_cache_stats(kmem_cache_t* c, slab_stats_t* out);
+void slab_stats_dump(void);                     // one line per cache
+
+#endif
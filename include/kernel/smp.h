@@ -0,0 +1,48 @@
+/*
+ * smp.h - CPU numbering for the scheduler
+ *
+ * Only x86 brings up secondary CPUs; every other port is one CPU and
+ * gets compile-time constants, so the scheduler's per-CPU arrays
+ * collapse to a single entry.
+ */
+
+#ifndef _BLOOD_SMP_H
+#define _BLOOD_SMP_H
+
+#ifdef __x86_64__
+#define SMP_MAX_CPUS       8            // affinity masks are u32
+#define SMP_RESCHED_VECTOR 48           // IPI: "look at your run queue"
+#define SMP_TLB_VECTOR     50           // IPI: flush the range in paging.c
+#define SMP_TRAMPOLINE     0x7000       // AP real-mode entry, below task stacks
+#define SMP_CPU_SEL(c)     ((3 + (c)) << 3)  // per-CPU %fs selector
+#else
+#define SMP_MAX_CPUS       1
+#endif
+
+#ifndef __ASSEMBLER__
+#include "kernel/types.h"
+
+#ifdef __x86_64__
+void smp_init(void);
+u32 smp_num_cpus(void);
+void smp_send_resched(u32 cpu);
+void smp_send_ipi(u32 cpu, u8 vector);  // any online CPU but this one
+const u8* smp_steal_order(u32 cpu);     // other CPUs, nearest cache first
+
+// %fs selector index is the CPU number: no memory access, no LAPIC read
+static inline u32 smp_cpu_id(void) {
+    u16 sel;
+    __asm__ volatile("mov %%fs, %0" : "=r"(sel));
+    return sel >= SMP_CPU_SEL(0) ? (u32)(sel >> 3) - 3 : 0;
+}
+#else
+static inline void smp_init(void) { }
+static inline u32 smp_num_cpus(void) { return 1; }
+static inline void smp_send_resched(u32 cpu) { (void)cpu; }
+static inline void smp_send_ipi(u32 cpu, u8 vector) { (void)cpu; (void)vector; }
+static inline const u8* smp_steal_order(u32 cpu) { (void)cpu; return 0; }
+static inline u32 smp_cpu_id(void) { return 0; }
+#endif
+#endif
+
+#endif
@@ -1,5 +1,26 @@
 /*
  * spinlock.h - bare-metal spinlocks
+ *
+ * spinlock_t: test-and-set, smallest and cheapest uncontended.
+ * ticket_lock_t: FIFO; waiters spin on one shared word.
+ * mcs_lock_t: FIFO; each waiter spins on its own node, so a release
+ * touches only the next waiter's cache line. The caller provides the
+ * node (usually on its stack) and passes the same one to unlock.
+ *
+ * Elision (x86 RTM): a spinlock_t marked with spin_lock_set_elision()
+ * first runs its critical section as a transaction that only reads
+ * the lock word, so holders that touch disjoint data run in parallel.
+ * After the retry policy's number of aborts it takes the lock for
+ * real, which aborts every elided holder. Meant for read-mostly data;
+ * sections that do I/O, mask IRQs or sleep always abort. Off until
+ * spin_elision_init() finds RTM, and a no-op elsewhere. Opt-in: no
+ * kernel lock sets it today, since the shared tables are read without
+ * a lock and their locks only serialize IRQ-masked updates.
+ *
+ * With LOCK_STATS every lock counts acquisitions, contended
+ * acquisitions and the longest spin in cycles (0 where the core has no
+ * cycle counter), plus elided and fallback acquisitions and aborts.
+ * LOCK_STAT_NAME() enlists a lock for lock_stats_dump().
  */
 
 #ifndef _BLOOD_SPINLOCK_H
@@ -7,13 +28,80 @@
 
 #include "kernel/types.h"
 
+#ifndef LOCK_STATS
+#define LOCK_STATS 0
+#endif
+
+typedef struct lock_stat {
+    const char* name;
+    u32 acquired;
+    u32 contended;
+    u32 max_spin;
+    u32 elided;             // committed without taking the lock
+    u32 elide_fallbacks;    // gave up eliding and took it
+    u32 elide_aborts;
+    struct lock_stat* next;
+} lock_stat_t;
+
 typedef struct {
     volatile u32 lock;
+    u8 elide;
+#if LOCK_STATS
+    lock_stat_t stat;
+#endif
 } spinlock_t;
 
+typedef struct {
+    volatile u32 next;      // ticket for the next arrival
+    volatile u32 owner;     // ticket now being served
+#if LOCK_STATS
+    lock_stat_t stat;
+#endif
+} ticket_lock_t;
+
+typedef struct mcs_node {
+    struct mcs_node* volatile next;
+    volatile u32 locked;
+} mcs_node_t;
+
+typedef struct {
+    mcs_node_t* volatile tail;  // last waiter, 0 when free
+#if LOCK_STATS
+    lock_stat_t stat;
+#endif
+} mcs_lock_t;
+
 void spin_lock(spinlock_t* lock);
 void spin_unlock(spinlock_t* lock);
+// task context with irqs on only: unlock always unmasks
 void spin_lock_irq(spinlock_t* lock);
 void spin_unlock_irq(spinlock_t* lock);
+// nest anywhere, ISRs included; unlock puts back what lock found
+u32 spin_lock_irqsave(spinlock_t* lock);
+void spin_unlock_irqrestore(spinlock_t* lock, u32 flags);
+// the same, masking only kernel-priority IRQs (BASEPRI, see irq.h)
+u32 spin_lock_irqsave_kernel(spinlock_t* lock);
+void spin_unlock_irqrestore_kernel(spinlock_t* lock, u32 flags);
+
+void spin_elision_init(void);                   // after hw_transactional_init()
+void spin_elision_policy(u8 policy);            // TX_RETRY_*, default adaptive
+void spin_lock_set_elision(spinlock_t* lock, u8 on);   // opt-in, no kernel users yet
+
+void ticket_lock(ticket_lock_t* lock);
+void ticket_unlock(ticket_lock_t* lock);
+u8 ticket_trylock(ticket_lock_t* lock);         // 1 if taken
+
+void mcs_lock(mcs_lock_t* lock, mcs_node_t* node);
+void mcs_unlock(mcs_lock_t* lock, mcs_node_t* node);
+
+#if LOCK_STATS
+#define LOCK_STAT_NAME(l, n) lock_stat_register(&(l)->stat, (n))
+#else
+#define LOCK_STAT_NAME(l, n) ((void)(l), (void)(n))
+#endif
+
+void lock_stat_register(lock_stat_t* stat, const char* name);
+void lock_stats_dump(void);                     // one UART line per lock
+void lock_stats_reset(void);
 
 #endif
@@ -5,8 +5,17 @@
 #ifndef _BLOOD_TIMER_H
 #define _BLOOD_TIMER_H
 
+#include "kernel/types.h"
+
+/* 0 = keep the periodic tick running through idle */
+#ifndef TICKLESS_IDLE
+#define TICKLESS_IDLE 1
+#endif
+
 void timer_init(void);
 void timer_delay(u32 ms);
 u32  timer_ticks(void);
+void timer_idle(void);
+u32  timer_irq_count(void);
 
 #endif
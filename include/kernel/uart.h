@@ -1,13 +1,46 @@
 /*
  * uart.h - bare-metal UART0 for x86 COM1 and ARM USART1
+ *
+ * Output goes into a TX ring that the port drains from its TX-empty
+ * interrupt or by DMA, so a writer pays for a copy, not for the baud
+ * rate. uart_putc()/uart_puts() block only while the ring is full;
+ * uart_write() lets the caller drop instead. A blocked task sleeps
+ * until the port makes room; an ISR, or a writer with IRQs masked,
+ * drives the port itself (uart_hw_tx_poll()), one step at a time with
+ * the ring unlocked, so it never waits for an interrupt that can't come.
+ *
+ * Ports without a TX interrupt keep the weak defaults, which send the
+ * queued bytes polled right away: same output, old cost.
  */
 
 #ifndef _BLOOD_UART_H
 #define _BLOOD_UART_H
 
+#include "kernel/types.h"
+
+#define UART_TX_DEPTH 1024      // bytes, power of two
+#define UART_TX_DROP  0         // full: queue what fits, count the rest
+#define UART_TX_BLOCK 1         // full: wait for room
+
 void uart_early_init(void);
 void uart_putc(char c);
+s32 uart_getc(void);            // -1 when nothing received
 void uart_puts(const char* s);
 void uart_hex(u32 val);
+u32  uart_write(const void* buf, u32 len, u8 policy);    // bytes queued
+void uart_flush(void);          // until the ring is empty (panics, reset)
+u32  uart_tx_dropped(void);
+
+// port side (arch/*/uart*.c; x86 and STM32F4 are in uart.c, weak polled defaults elsewhere)
+void uart_hw_putc(char c);      // polled, one byte
+void uart_hw_tx_start(void);    // bytes queued: arm the TX IRQ or DMA
+void uart_hw_tx_poll(void);     // what the TX IRQ does, callable with IRQs off
+
+// the port's TX IRQ/DMA side, between begin and end
+u32  uart_tx_begin(void);
+u32  uart_tx_chunk(const u8** p);   // contiguous queued bytes, 0 when empty
+void uart_tx_consume(u32 n);        // n of them are in the hardware
+void uart_tx_end(u32 flags);
+void uart_tx_drain(void);           // all of it, polled, from outside begin/end
 
 #endif
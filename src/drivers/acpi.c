@@ -12,6 +12,8 @@
 #define ACPI_HPET_SIGNATURE "HPET"
 #define ACPI_MCFG_SIGNATURE "MCFG"
 
+#define ACPI_MAX_CPUS 255
+
 /* ACPI table headers */
 typedef struct {
     char signature[4];
@@ -134,6 +136,7 @@ static acpi_fadt_t* acpi_fadt = 0;
 static acpi_madt_t* acpi_madt = 0;
 static u32 local_apic_base = 0;
 static u8 cpu_count = 0;
+static u8 cpu_apic_ids[ACPI_MAX_CPUS];
 
 static u8 acpi_checksum(void* ptr, u32 length) {
     u8* data = (u8*)ptr;
@@ -217,8 +220,8 @@ void acpi_init(void) {
         while (entry < end) {
             if (entry[0] == MADT_TYPE_LOCAL_APIC) {
                 madt_local_apic_t* lapic = (madt_local_apic_t*)entry;
-                if (lapic->flags & 1) {
-                    cpu_count++;
+                if ((lapic->flags & 1) && cpu_count < ACPI_MAX_CPUS) {
+                    cpu_apic_ids[cpu_count++] = lapic->apic_id;
                 }
             }
             entry += entry[1];
@@ -238,6 +241,10 @@ u8 acpi_get_cpu_count(void) {
     return cpu_count;
 }
 
+u8 acpi_get_cpu_apic_id(u8 index) {
+    return index < cpu_count ? cpu_apic_ids[index] : 0xFF;
+}
+
 void acpi_enable(void) {
     if (!acpi_fadt || !acpi_fadt->smi_command_port) {
         return;
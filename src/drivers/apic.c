@@ -136,6 +136,21 @@ void apic_init(u32 lapic_addr, u32 ioapic_addr) {
     apic_enabled = 1;
 }
 
+/* Secondary CPUs: BSP already found the base, just enable our LAPIC */
+void apic_init_ap(void) {
+    if (!apic_enabled) return;
+    
+    lapic_write(LAPIC_SVR, lapic_read(LAPIC_SVR) | 0x100);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_TIMER, 0x10000);   /* Masked */
+    lapic_write(LAPIC_LVT_LINT0, 0x10000);   /* ExtINT stays on the BSP */
+    lapic_write(LAPIC_LVT_LINT1, 0x400);     /* NMI */
+    lapic_write(LAPIC_LVT_ERROR, 0x10000);   /* Masked */
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_EOI, 0);
+}
+
 void apic_send_eoi(void) {
     if (apic_enabled) {
         lapic_write(LAPIC_EOI, 0);
@@ -223,6 +238,13 @@ void apic_timer_init(u32 frequency) {
     lapic_write(LAPIC_TIMER_ICR, initial_count);
 }
 
+void apic_timer_tsc_deadline(u8 vector) {
+    if (!apic_enabled) return;
+    
+    /* One-shot at IA32_TSC_DEADLINE; writing the MSR arms it */
+    lapic_write(LAPIC_LVT_TIMER, vector | 0x40000); /* TSC-deadline mode */
+}
+
 void apic_timer_stop(void) {
     if (!apic_enabled) return;
     lapic_write(LAPIC_LVT_TIMER, 0x10000); /* Masked */
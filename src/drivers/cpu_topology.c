@@ -3,6 +3,7 @@
  */
 
 #include "kernel/types.h"
+#include "kernel/spinlock.h"
 
 /* APIC ID extraction masks */
 #define APIC_ID_MASK                    0xFF000000
@@ -67,6 +68,11 @@ typedef struct {
 
 static cpu_topology_info_t cpu_topology_info;
 
+/* Serialises cpu_topology_add_cpu(). Readers take nothing: an entry's
+   enabled flag is stored with release after the rest of it, so whoever
+   sees it set sees the whole entry. Entries are never reused. */
+static spinlock_t topology_lock;
+
 extern u32 apic_get_id(void);
 extern u8 apic_is_bsp(void);
 
@@ -300,7 +306,8 @@ u32 cpu_topology_get_cores_per_package(void) {
 }
 
 const cpu_info_t* cpu_topology_get_cpu_info(u32 cpu_index) {
-    if (cpu_index >= 256 || !cpu_topology_info.cpus[cpu_index].enabled) return 0;
+    if (cpu_index >= 256) return 0;
+    if (!__atomic_load_n(&cpu_topology_info.cpus[cpu_index].enabled, __ATOMIC_ACQUIRE)) return 0;
     return &cpu_topology_info.cpus[cpu_index];
 }
 
@@ -330,14 +337,20 @@ u32 cpu_topology_get_cache_alignment(void) {
 }
 
 u8 cpu_topology_add_cpu(u32 apic_id) {
-    if (cpu_topology_info.num_threads >= 256) return 0;
+    u32 flags = spin_lock_irqsave_kernel(&topology_lock);
+    if (cpu_topology_info.num_threads >= 256) {
+        spin_unlock_irqrestore_kernel(&topology_lock, flags);
+        return 0;
+    }
     
     cpu_info_t* cpu = &cpu_topology_info.cpus[cpu_topology_info.num_threads];
-    cpu->enabled = 1;
     cpu->is_bsp = (apic_id == cpu_topology_info.bsp_apic_id);
     cpu_topology_parse_apic_id(apic_id, cpu);
     
-    cpu_topology_info.num_threads++;
+    /* Publish: entry first, then the flag and count readers go by */
+    __atomic_store_n(&cpu->enabled, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&cpu_topology_info.num_threads,
+                     cpu_topology_info.num_threads + 1, __ATOMIC_RELEASE);
     
     /* Update package/core counts */
     u32 max_package = 0, max_core = 0;
@@ -355,6 +368,7 @@ u8 cpu_topology_add_cpu(u32 apic_id) {
     cpu_topology_info.num_packages = max_package + 1;
     cpu_topology_info.num_cores = max_core + 1;
     cpu_topology_info.cores_per_package = cpu_topology_info.num_cores / cpu_topology_info.num_packages;
+    spin_unlock_irqrestore_kernel(&topology_lock, flags);
     
     return 1;
 }
@@ -211,6 +211,41 @@ u8 hpet_setup_timer(u8 timer_num, u32 period_us, u8 periodic, u8 irq) {
     return 1;
 }
 
+/* One-shot, edge-triggered, at an absolute counter value; returns 0 if
+   the counter had already passed it (the caller picks a later one) */
+u8 hpet_set_comparator(u8 timer_num, u64 counter, u8 gsi) {
+    if (!hpet_info.initialized || timer_num >= hpet_info.num_timers || timer_num >= 3) {
+        return 0;
+    }
+    
+    u32 timer_offset = HPET_TIMER0_CONFIG + (timer_num * 0x20);
+    u64 timer_config = ((u64)gsi << 9) & HPET_TN_ROUTE;
+    if (hpet_info.counter_size == 32) {
+        timer_config |= HPET_TN_32BIT;
+        counter &= 0xFFFFFFFF;
+    }
+    
+    hpet_write64(timer_offset, timer_config);
+    hpet_write64(timer_offset + 8, counter);
+    hpet_write64(timer_offset, timer_config | HPET_TN_INT_ENB);
+    
+    /* The match is on equality: a value already behind us never fires */
+    u64 now = hpet_get_counter();
+    if (hpet_info.counter_size == 32) {
+        return (s32)((u32)counter - (u32)now) > 0;
+    }
+    return (s64)(counter - now) > 0;
+}
+
+/* I/O APIC inputs this timer can be routed to, one bit per GSI */
+u32 hpet_get_route_cap(u8 timer_num) {
+    if (!hpet_info.initialized || timer_num >= hpet_info.num_timers || timer_num >= 3) {
+        return 0;
+    }
+    
+    return (u32)(hpet_read64(HPET_TIMER0_CONFIG + (timer_num * 0x20)) >> 32);
+}
+
 void hpet_disable_timer(u8 timer_num) {
     if (!hpet_info.initialized || timer_num >= hpet_info.num_timers || timer_num >= 3) {
         return;
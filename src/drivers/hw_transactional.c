@@ -100,13 +100,13 @@ u32 hw_transactional_begin(void) {
 		return TX_STATUS_UNSUPPORTED;
 	}
 	
-	u32 status;
+	u32 status = RTM_STARTED;	/* xbegin leaves EAX alone on start */
 	tsx_stats.total_attempts++;
 	
 	__asm__ volatile(
 		".byte 0xC7, 0xF8\n\t"		/* xbegin */
 		".long 0\n\t"			/* fallback offset */
-		: "=a"(status)
+		: "+a"(status)
 		:
 		: "memory"
 	);
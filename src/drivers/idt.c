@@ -69,6 +69,10 @@ extern void irq12(void);  /* PS/2 mouse */
 extern void irq13(void);  /* FPU */
 extern void irq14(void);  /* Primary ATA */
 extern void irq15(void);  /* Secondary ATA */
+extern void irq16(void);  /* SMP reschedule IPI */
+extern void irq17(void);  /* Latency probe */
+extern void irq18(void);  /* TLB shootdown IPI */
+extern void irq19(void);  /* hrtimer expiry */
 
 static void idt_set_gate(u8 num, u32 base, u16 sel, u8 flags) {
     idt[num].offset_low = base & 0xFFFF;
@@ -78,6 +82,11 @@ static void idt_set_gate(u8 num, u32 base, u16 sel, u8 flags) {
     idt[num].type_attr = flags;
 }
 
+/* Every CPU shares the one table; APs load it on the way up */
+void idt_load(void) {
+    __asm__ volatile("lidt %0" : : "m"(idt_ptr));
+}
+
 void idt_init(void) {
     idt_ptr.limit = sizeof(idt) - 1;
     idt_ptr.base = (u32)&idt;
@@ -125,8 +134,20 @@ void idt_init(void) {
     idt_set_gate(46, (u32)irq14, 0x08, IDT_PRESENT | IDT_INT_GATE);
     idt_set_gate(47, (u32)irq15, 0x08, IDT_PRESENT | IDT_INT_GATE);
     
+    /* SMP reschedule IPI */
+    idt_set_gate(48, (u32)irq16, 0x08, IDT_PRESENT | IDT_INT_GATE);
+    
+    /* Latency probe: self-IPI or int $49 from the bench suite */
+    idt_set_gate(49, (u32)irq17, 0x08, IDT_PRESENT | IDT_INT_GATE);
+    
+    /* TLB shootdown IPI */
+    idt_set_gate(50, (u32)irq18, 0x08, IDT_PRESENT | IDT_INT_GATE);
+    
+    /* hrtimer expiry: LAPIC TSC deadline or HPET comparator */
+    idt_set_gate(51, (u32)irq19, 0x08, IDT_PRESENT | IDT_INT_GATE);
+    
     /* Load IDT */
-    __asm__ volatile("lidt %0" : : "m"(idt_ptr));
+    idt_load();
 }
 
 /* Exception names */
@@ -193,19 +214,24 @@ void isr_handler(u32 int_no, u32 err_code, u32 eip, u32 cs, u32 eflags) {
     while (1);
 }
 
+/* Overridden by the bench suite */
+__attribute__((weak)) void irq_probe_handler(void) { }
+
 void irq_handler(u32 irq_no) {
-    extern void pit_irq_handler(void);
+    extern void timer_irq_handler(void);
     extern void ps2_kbd_irq_handler(void);
     extern void rtc_irq_handler(void);
     extern void serial_irq_handler(u8 port);
     extern void floppy_irq_handler(void);
     extern void ac97_irq_handler(void);
     extern void rtl8139_irq_handler(void);
+    extern void paging_shootdown_handler(void);
+    extern void hrtimer_interrupt(void);
 
     /* Handle specific IRQs */
     switch (irq_no) {
-        case 0: /* PIT timer */
-            pit_irq_handler();
+        case 0: /* PIT timer + sleep wheel */
+            timer_irq_handler();
             break;
         case 1: /* Keyboard */
             ps2_kbd_irq_handler();
@@ -228,6 +254,17 @@ void irq_handler(u32 irq_no) {
         case 11: /* Network card (RTL8139) */
             rtl8139_irq_handler();
             break;
+        case 16: /* SMP reschedule IPI: waking from hlt is the point */
+            break;
+        case 17: /* Latency probe */
+            irq_probe_handler();
+            break;
+        case 18: /* TLB shootdown IPI */
+            paging_shootdown_handler();
+            break;
+        case 19: /* hrtimer expiry */
+            hrtimer_interrupt();
+            break;
         case 14: /* Primary ATA */
         case 15: /* Secondary ATA */
             /* ATA interrupt handling */
@@ -243,8 +280,8 @@ void irq_handler(u32 irq_no) {
 
     if (apic_is_enabled()) {
         apic_send_eoi();
-    } else {
-        /* Send EOI to PIC */
+    } else if (irq_no < 16) {
+        /* Send EOI to PIC; vectors 48+ never come from it */
         if (irq_no >= 8) {
             /* Secondary PIC */
             __asm__ volatile("outb %0, $0xA0" : : "a"((u8)0x20));
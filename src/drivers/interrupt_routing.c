@@ -3,6 +3,9 @@
  */
 
 #include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/smp.h"
+#include "kernel/rcu.h"
 
 /* I/O APIC registers */
 #define IOAPIC_REGSEL                   0x00
@@ -93,14 +96,48 @@ typedef struct {
     u32 num_msi_entries;
     u32 num_msix_entries;
     u32 total_interrupts_routed;
-    u32 msi_interrupts;
-    u32 msix_interrupts;
-    u32 ioapic_interrupts;
-    u64 last_interrupt_time;
 } interrupt_routing_info_t;
 
 static interrupt_routing_info_t interrupt_routing_info;
 
+/* Dispatch never scans the tables above: it indexes a vector -> source
+   map published through RCU. Writers change interrupt_routing_info under
+   route_lock, rebuild the spare map and publish it; before the next
+   writer may overwrite that spare (the old live map) a grace period must
+   pass since it was unpublished. route_gen counts publishes so a writer
+   can tell whether its grace period still covers the spare. */
+#define ROUTE_NONE      0
+#define ROUTE_IOAPIC    1
+#define ROUTE_MSI       2
+#define ROUTE_MSIX      3
+
+typedef struct {
+    u8 kind;
+    u8 ioapic;
+    u8 pin;
+} route_t;
+
+typedef struct {
+    route_t vec[256];
+} route_table_t;
+
+static route_table_t route_tables[2];
+static route_table_t* route_live;
+static volatile u32 route_gen;
+static spinlock_t route_lock;
+
+/* Dispatch counters, one cache line set per CPU: an interrupt writes
+   only its own CPU's lines. Readers add them up. */
+typedef struct {
+    u64 last_interrupt_time;
+    u32 ioapic_interrupts;
+    u32 msi_interrupts;
+    u32 msix_interrupts;
+    u32 pin_count[8][24];
+} __attribute__((aligned(64))) route_stats_t;
+
+static route_stats_t route_stats[SMP_MAX_CPUS];
+
 extern u32 inl(u16 port);
 extern void outl(u16 port, u32 value);
 extern u32 pci_config_read(u8 bus, u8 device, u8 function, u8 offset);
@@ -119,6 +156,66 @@ static void ioapic_write_reg(u32 ioapic_base, u8 reg, u32 value) {
     ioapic[IOAPIC_REGWIN] = value;
 }
 
+static void route_stats_clear(void) {
+    for (u32 c = 0; c < SMP_MAX_CPUS; c++) {
+        route_stats_t* st = &route_stats[c];
+        st->last_interrupt_time = 0;
+        st->ioapic_interrupts = 0;
+        st->msi_interrupts = 0;
+        st->msix_interrupts = 0;
+        for (u8 i = 0; i < 8; i++) {
+            for (u8 j = 0; j < 24; j++) st->pin_count[i][j] = 0;
+        }
+    }
+}
+
+/* Returns with route_lock held and the spare map free to overwrite */
+static u32 route_update_begin(void) {
+    for (;;) {
+        u32 gen = route_gen;
+        synchronize_rcu();
+        u32 flags = spin_lock_irqsave_kernel(&route_lock);
+        if (gen == route_gen) return flags;
+        spin_unlock_irqrestore_kernel(&route_lock, flags);
+    }
+}
+
+/* Rebuilds the spare map from interrupt_routing_info, publishes it and
+   drops route_lock. First match wins, in the order dispatch used to
+   scan: I/O APIC pins, then MSI, then MSI-X. */
+static void route_update_end(u32 flags) {
+    route_table_t* t = &route_tables[route_live == &route_tables[0] ? 1 : 0];
+    
+    for (u32 v = 0; v < 256; v++) t->vec[v].kind = ROUTE_NONE;
+    
+    for (u8 i = 0; i < interrupt_routing_info.num_ioapics; i++) {
+        ioapic_info_t* ioapic = &interrupt_routing_info.ioapics[i];
+        for (u8 j = 0; j < ioapic->max_redirection_entries && j < 24; j++) {
+            route_t* r = &t->vec[ioapic->entries[j].vector & 0xFF];
+            if (ioapic->entries[j].mask || r->kind != ROUTE_NONE) continue;
+            r->kind = ROUTE_IOAPIC;
+            r->ioapic = i;
+            r->pin = j;
+        }
+    }
+    for (u32 i = 0; i < interrupt_routing_info.num_msi_entries; i++) {
+        msi_entry_t* e = &interrupt_routing_info.msi_entries[i];
+        if (e->enabled && t->vec[e->vector].kind == ROUTE_NONE) {
+            t->vec[e->vector].kind = ROUTE_MSI;
+        }
+    }
+    for (u32 i = 0; i < interrupt_routing_info.num_msix_entries; i++) {
+        msix_entry_t* e = &interrupt_routing_info.msix_entries[i];
+        if (!e->masked && t->vec[e->data & 0xFF].kind == ROUTE_NONE) {
+            t->vec[e->data & 0xFF].kind = ROUTE_MSIX;
+        }
+    }
+    
+    rcu_assign_pointer(route_live, t);
+    route_gen++;
+    spin_unlock_irqrestore_kernel(&route_lock, flags);
+}
+
 static void interrupt_routing_detect_ioapic(void) {
     /* Assume standard I/O APIC base address */
     u32 ioapic_base = 0xFEC00000;
@@ -185,6 +282,8 @@ static void interrupt_routing_detect_msi(void) {
 }
 
 void interrupt_routing_init(void) {
+    u32 flags = route_update_begin();
+    
     interrupt_routing_info.interrupt_routing_supported = 0;
     interrupt_routing_info.ioapic_supported = 0;
     interrupt_routing_info.msi_supported = 0;
@@ -193,10 +292,6 @@ void interrupt_routing_init(void) {
     interrupt_routing_info.num_msi_entries = 0;
     interrupt_routing_info.num_msix_entries = 0;
     interrupt_routing_info.total_interrupts_routed = 0;
-    interrupt_routing_info.msi_interrupts = 0;
-    interrupt_routing_info.msix_interrupts = 0;
-    interrupt_routing_info.ioapic_interrupts = 0;
-    interrupt_routing_info.last_interrupt_time = 0;
     
     for (u8 i = 0; i < 8; i++) {
         interrupt_routing_info.ioapics[i].base_address = 0;
@@ -240,6 +335,9 @@ void interrupt_routing_init(void) {
         interrupt_routing_info.msix_supported) {
         interrupt_routing_info.interrupt_routing_supported = 1;
     }
+    
+    route_update_end(flags);
+    route_stats_clear();
 }
 
 u8 interrupt_routing_is_supported(void) {
@@ -264,7 +362,17 @@ u8 interrupt_routing_get_num_ioapics(void) {
 
 const ioapic_info_t* interrupt_routing_get_ioapic_info(u8 ioapic_index) {
     if (ioapic_index >= interrupt_routing_info.num_ioapics) return 0;
-    return &interrupt_routing_info.ioapics[ioapic_index];
+    
+    /* Fold the per-CPU pin counts in for the caller */
+    ioapic_info_t* ioapic = &interrupt_routing_info.ioapics[ioapic_index];
+    for (u8 j = 0; j < 24; j++) {
+        u32 count = 0;
+        for (u32 c = 0; c < SMP_MAX_CPUS; c++) {
+            count += route_stats[c].pin_count[ioapic_index][j];
+        }
+        ioapic->interrupt_count[j] = count;
+    }
+    return ioapic;
 }
 
 u8 interrupt_routing_setup_ioapic_entry(u8 ioapic_index, u8 pin, u8 vector, 
@@ -274,6 +382,7 @@ u8 interrupt_routing_setup_ioapic_entry(u8 ioapic_index, u8 pin, u8 vector,
     if (pin >= interrupt_routing_info.ioapics[ioapic_index].max_redirection_entries) return 0;
     
     ioapic_info_t* ioapic = &interrupt_routing_info.ioapics[ioapic_index];
+    u32 flags = route_update_begin();
     
     /* Configure redirection table entry */
     u32 low = vector | (delivery_mode << 8) | (dest_mode << 11) | 
@@ -293,6 +402,7 @@ u8 interrupt_routing_setup_ioapic_entry(u8 ioapic_index, u8 pin, u8 vector,
     ioapic->entries[pin].destination = destination;
     
     interrupt_routing_info.total_interrupts_routed++;
+    route_update_end(flags);
     return 1;
 }
 
@@ -301,12 +411,14 @@ u8 interrupt_routing_mask_ioapic_entry(u8 ioapic_index, u8 pin) {
     if (pin >= interrupt_routing_info.ioapics[ioapic_index].max_redirection_entries) return 0;
     
     ioapic_info_t* ioapic = &interrupt_routing_info.ioapics[ioapic_index];
+    u32 flags = route_update_begin();
     
     u32 low = ioapic_read_reg(ioapic->base_address, IOAPIC_REDTBL_BASE + (pin * 2));
     low |= (1 << 16);  /* Set mask bit */
     ioapic_write_reg(ioapic->base_address, IOAPIC_REDTBL_BASE + (pin * 2), low);
     
     ioapic->entries[pin].mask = 1;
+    route_update_end(flags);
     return 1;
 }
 
@@ -315,12 +427,14 @@ u8 interrupt_routing_unmask_ioapic_entry(u8 ioapic_index, u8 pin) {
     if (pin >= interrupt_routing_info.ioapics[ioapic_index].max_redirection_entries) return 0;
     
     ioapic_info_t* ioapic = &interrupt_routing_info.ioapics[ioapic_index];
+    u32 flags = route_update_begin();
     
     u32 low = ioapic_read_reg(ioapic->base_address, IOAPIC_REDTBL_BASE + (pin * 2));
     low &= ~(1 << 16);  /* Clear mask bit */
     ioapic_write_reg(ioapic->base_address, IOAPIC_REDTBL_BASE + (pin * 2), low);
     
     ioapic->entries[pin].mask = 0;
+    route_update_end(flags);
     return 1;
 }
 
@@ -352,6 +466,11 @@ u8 interrupt_routing_setup_msi(u8 bus, u8 device, u8 function, u8 vector, u8 des
     pci_config_write(bus, device, function, cap_ptr + 2, control);
     
     /* Record MSI entry */
+    u32 flags = route_update_begin();
+    if (interrupt_routing_info.num_msi_entries >= 256) {
+        route_update_end(flags);
+        return 0;
+    }
     msi_entry_t* entry = &interrupt_routing_info.msi_entries[interrupt_routing_info.num_msi_entries];
     entry->address = msi_address;
     entry->data = msi_data;
@@ -362,41 +481,33 @@ u8 interrupt_routing_setup_msi(u8 bus, u8 device, u8 function, u8 vector, u8 des
     
     interrupt_routing_info.num_msi_entries++;
     interrupt_routing_info.total_interrupts_routed++;
+    route_update_end(flags);
     return 1;
 }
 
+/* Hot path: no lock, no scan, and stores only to this CPU's lines */
 void interrupt_routing_handle_interrupt(u8 vector) {
-    interrupt_routing_info.last_interrupt_time = timer_get_ticks();
+    route_stats_t* st = &route_stats[smp_cpu_id()];
+    st->last_interrupt_time = timer_get_ticks();
     
-    /* Update interrupt counters */
-    for (u8 i = 0; i < interrupt_routing_info.num_ioapics; i++) {
-        ioapic_info_t* ioapic = &interrupt_routing_info.ioapics[i];
-        for (u8 j = 0; j < ioapic->max_redirection_entries && j < 24; j++) {
-            if (ioapic->entries[j].vector == vector && !ioapic->entries[j].mask) {
-                ioapic->interrupt_count[j]++;
-                interrupt_routing_info.ioapic_interrupts++;
-                return;
-            }
-        }
-    }
-    
-    /* Check MSI entries */
-    for (u32 i = 0; i < interrupt_routing_info.num_msi_entries; i++) {
-        if (interrupt_routing_info.msi_entries[i].vector == vector && 
-            interrupt_routing_info.msi_entries[i].enabled) {
-            interrupt_routing_info.msi_interrupts++;
-            return;
-        }
-    }
-    
-    /* Check MSI-X entries */
-    for (u32 i = 0; i < interrupt_routing_info.num_msix_entries; i++) {
-        if ((interrupt_routing_info.msix_entries[i].data & 0xFF) == vector && 
-            !interrupt_routing_info.msix_entries[i].masked) {
-            interrupt_routing_info.msix_interrupts++;
-            return;
+    rcu_read_lock();
+    const route_table_t* t = rcu_dereference(route_live);
+    if (t) {
+        const route_t* r = &t->vec[vector];
+        switch (r->kind) {
+            case ROUTE_IOAPIC:
+                st->pin_count[r->ioapic][r->pin]++;
+                st->ioapic_interrupts++;
+                break;
+            case ROUTE_MSI:
+                st->msi_interrupts++;
+                break;
+            case ROUTE_MSIX:
+                st->msix_interrupts++;
+                break;
         }
     }
+    rcu_read_unlock();
 }
 
 u32 interrupt_routing_get_total_interrupts_routed(void) {
@@ -404,19 +515,29 @@ u32 interrupt_routing_get_total_interrupts_routed(void) {
 }
 
 u32 interrupt_routing_get_msi_interrupts(void) {
-    return interrupt_routing_info.msi_interrupts;
+    u32 n = 0;
+    for (u32 c = 0; c < SMP_MAX_CPUS; c++) n += route_stats[c].msi_interrupts;
+    return n;
 }
 
 u32 interrupt_routing_get_msix_interrupts(void) {
-    return interrupt_routing_info.msix_interrupts;
+    u32 n = 0;
+    for (u32 c = 0; c < SMP_MAX_CPUS; c++) n += route_stats[c].msix_interrupts;
+    return n;
 }
 
 u32 interrupt_routing_get_ioapic_interrupts(void) {
-    return interrupt_routing_info.ioapic_interrupts;
+    u32 n = 0;
+    for (u32 c = 0; c < SMP_MAX_CPUS; c++) n += route_stats[c].ioapic_interrupts;
+    return n;
 }
 
 u64 interrupt_routing_get_last_interrupt_time(void) {
-    return interrupt_routing_info.last_interrupt_time;
+    u64 last = 0;
+    for (u32 c = 0; c < SMP_MAX_CPUS; c++) {
+        if (route_stats[c].last_interrupt_time > last) last = route_stats[c].last_interrupt_time;
+    }
+    return last;
 }
 
 u32 interrupt_routing_get_num_msi_entries(void) {
@@ -439,9 +560,8 @@ const msix_entry_t* interrupt_routing_get_msix_entry(u32 index) {
 
 void interrupt_routing_clear_statistics(void) {
     interrupt_routing_info.total_interrupts_routed = 0;
-    interrupt_routing_info.msi_interrupts = 0;
-    interrupt_routing_info.msix_interrupts = 0;
-    interrupt_routing_info.ioapic_interrupts = 0;
+    
+    route_stats_clear();
     
     for (u8 i = 0; i < interrupt_routing_info.num_ioapics; i++) {
         for (u8 j = 0; j < 24; j++) {
@@ -3,6 +3,7 @@
  */
 
 #include "kernel/types.h"
+#include "kernel/slab.h"
 
 /* Intel VT-d registers */
 #define VTD_VER_REG         0x00
@@ -141,11 +142,13 @@ static void iommu_invalidate_context_cache(iommu_unit_t* unit) {
     iommu_wait_operation(unit->base_address, VTD_CCMD_REG, VTD_CCMD_ICC, 0);
 }
 
+/* Root, context and second-level tables: 4KB, 4KB aligned, and handed
+   to the hardware by address, so identity-mapped slab memory */
+static kmem_cache_t vtd_table_cache;
+
 static void iommu_setup_root_table(iommu_unit_t* unit) {
-    extern void* paging_alloc_pages(u32 count);
-    
     /* Allocate root table (4KB) */
-    unit->root_table = (vtd_root_entry_t*)paging_alloc_pages(1);
+    unit->root_table = (vtd_root_entry_t*)kmem_cache_alloc(&vtd_table_cache);
     if (!unit->root_table) return;
     
     /* Clear root table */
@@ -206,6 +209,8 @@ u8 iommu_add_unit(u32 base_address, u8 segment, u8 start_bus, u8 end_bus, u8 fla
 }
 
 void iommu_init(void) {
+    if (!kmem_cache_init(&vtd_table_cache, "vtd_table", 4096, 4096, 0)) return;
+    
     /* Initialize all IOMMU units */
     for (u8 i = 0; i < iommu_unit_count; i++) {
         iommu_unit_t* unit = &iommu_units[i];
@@ -239,8 +244,8 @@ u8 iommu_create_domain(u16 domain_id, u8 bus, u8 device, u8 function) {
     
     /* Allocate context table if not present */
     if (!unit->root_table[bus].present) {
-        extern void* paging_alloc_pages(u32 count);
-        vtd_context_entry_t* context_table = (vtd_context_entry_t*)paging_alloc_pages(1);
+        vtd_context_entry_t* context_table =
+            (vtd_context_entry_t*)kmem_cache_alloc(&vtd_table_cache);
         if (!context_table) return 0;
         
         /* Clear context table */
@@ -259,8 +264,7 @@ u8 iommu_create_domain(u16 domain_id, u8 bus, u8 device, u8 function) {
     u8 devfn = (device << 3) | function;
     
     /* Allocate page table */
-    extern void* paging_alloc_pages(u32 count);
-    vtd_pte_t* page_table = (vtd_pte_t*)paging_alloc_pages(1);
+    vtd_pte_t* page_table = (vtd_pte_t*)kmem_cache_alloc(&vtd_table_cache);
     if (!page_table) return 0;
     
     /* Clear page table */
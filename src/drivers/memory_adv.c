@@ -7,6 +7,10 @@
 /* CR4 control bits */
 #define CR4_PCIDE                   (1 << 17)
 
+/* EFER: CR4.PCIDE can only be set with IA-32e mode active */
+#define MSR_EFER                    0xC0000080
+#define EFER_LMA                    (1 << 10)
+
 /* INVPCID types */
 #define INVPCID_TYPE_INDIVIDUAL     0
 #define INVPCID_TYPE_SINGLE_CONTEXT 1
@@ -80,9 +84,9 @@ static void memory_adv_detect_capabilities(void) {
     __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
     memory_adv_info.pat_supported = (edx & (1 << 16)) != 0;
     memory_adv_info.mtrr_supported = (edx & (1 << 12)) != 0;
+    memory_adv_info.pcid_supported = (ecx & (1 << 17)) != 0;
     
     __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
-    memory_adv_info.pcid_supported = (ecx & (1 << 17)) != 0;
     memory_adv_info.invpcid_supported = (ebx & (1 << 10)) != 0;
     
     if (memory_adv_info.pcid_supported || memory_adv_info.pat_supported || memory_adv_info.mtrr_supported) {
@@ -109,6 +113,8 @@ static void memory_adv_setup_pat(void) {
 
 static void memory_adv_enable_pcid(void) {
     if (!memory_adv_info.pcid_supported) return;
+    /* #GP in legacy protected mode; paging.c flushes without PCIDs */
+    if (!msr_is_supported() || !(msr_read(MSR_EFER) & EFER_LMA)) return;
     
     u64 cr4;
     __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
@@ -1,8 +1,19 @@
 /*
  * numa.c – x86 NUMA memory management and affinity
+ *
+ * Every node with RAM in the direct map gets a buddy zone of its own,
+ * carved out of the paging allocator at init from the node's SRAT
+ * ranges. Node allocations come from that zone and are mapped into the
+ * heap window, so numa_migrate_pages() can move a page by copying it to
+ * a frame on another node and remapping it in place. Without SRAT the
+ * single node is the paging allocator itself.
  */
 
 #include "kernel/types.h"
+#include "kernel/seqlock.h"
+#include "kernel/buddy.h"
+#include "drivers/paging.h"
+#include "string.h"
 
 /* NUMA distance matrix values */
 #define NUMA_LOCAL_DISTANCE     10
@@ -20,6 +31,7 @@ typedef struct {
 
 typedef struct {
     u8 node_id;
+    u32 proximity_domain;
     u32 processor_count;
     u32 processor_list[64];
     u64 total_memory;
@@ -41,14 +53,27 @@ typedef struct {
 
 static numa_info_t numa_info;
 
+/* Guards num_nodes, the distance matrix and the per-node free counters
+   (u64, so torn on a 32-bit core). Lookups retry instead of locking. */
+static seqlock_t numa_seq;
+
+/* Node-local frames; nodes past NUMA_ZONE_NODES or entirely above the
+   direct map have none and cannot satisfy a node allocation */
+#define NUMA_ZONE_NODES 8
+#define NUMA_FREE_BATCH 16      /* pages unmapped per TLB flush */
+
+static buddy_zone_t node_zones[NUMA_ZONE_NODES];
+static u8 node_zone_ready[NUMA_ZONE_NODES];
+
 /* NUMA allocation policies */
 #define NUMA_POLICY_DEFAULT     0
 #define NUMA_POLICY_BIND        1
 #define NUMA_POLICY_INTERLEAVE  2
 #define NUMA_POLICY_PREFERRED   3
 
-extern void* topology_get_numa_memory_base(u8 node_id);
+extern u64 topology_get_numa_memory_base(u8 node_id);
 extern u64 topology_get_numa_memory_size(u8 node_id);
+extern u32 topology_get_numa_proximity_domain(u8 node_id);
 extern u8 topology_is_numa_node_enabled(u8 node_id);
 extern u8 topology_get_num_numa_nodes(void);
 extern u8 topology_is_numa_supported(void);
@@ -75,33 +100,100 @@ static void numa_parse_slit_table(void) {
     u64 num_localities = *(u64*)(slit_data + 36);
     u8* distances = slit_data + 44;
     
-    for (u8 i = 0; i < numa_info.num_nodes && i < num_localities; i++) {
-        for (u8 j = 0; j < numa_info.num_nodes && j < num_localities; j++) {
-            numa_info.distance_matrix[i][j] = distances[i * num_localities + j];
+    /* SLIT is indexed by proximity domain */
+    for (u8 i = 0; i < numa_info.num_nodes; i++) {
+        u32 from = numa_info.nodes[i].proximity_domain;
+        for (u8 j = 0; j < numa_info.num_nodes; j++) {
+            u32 to = numa_info.nodes[j].proximity_domain;
+            if (from < num_localities && to < num_localities) {
+                numa_info.distance_matrix[i][j] = distances[from * num_localities + to];
+            } else {
+                numa_info.distance_matrix[i][j] = i == j ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+            }
         }
     }
 }
 
+/* Topology reports one entry per SRAT memory range; a node is every
+   range of one proximity domain (QEMU splits node 0 around the ISA hole) */
 static void numa_detect_memory_ranges(void) {
-    for (u8 node = 0; node < numa_info.num_nodes; node++) {
+    u8 entries = numa_info.num_nodes;
+    numa_info.num_nodes = 0;
+    
+    for (u8 entry = 0; entry < entries; entry++) {
+        u64 base = topology_get_numa_memory_base(entry);
+        u64 size = topology_get_numa_memory_size(entry);
+        u32 domain = topology_get_numa_proximity_domain(entry);
+        
+        if (!size || !topology_is_numa_node_enabled(entry)) continue;
+        
+        u8 node = 0;
+        while (node < numa_info.num_nodes && numa_info.nodes[node].proximity_domain != domain) {
+            node++;
+        }
         numa_node_info_t* node_info = &numa_info.nodes[node];
+        if (node == numa_info.num_nodes) {
+            node_info->node_id = node;
+            node_info->proximity_domain = domain;
+            node_info->memory_range_count = 0;
+            node_info->total_memory = 0;
+            node_info->free_memory = 0;
+            numa_info.num_nodes++;
+        }
+        if (node_info->memory_range_count == 16) continue;
         
-        u64 base = (u64)topology_get_numa_memory_base(node);
-        u64 size = topology_get_numa_memory_size(node);
+        numa_memory_range_t* range = &node_info->memory_ranges[node_info->memory_range_count++];
+        range->base_address = base;
+        range->size = size;
+        range->node_id = node;
+        range->enabled = 1;
+        range->hot_pluggable = 0;
+        range->non_volatile = 0;
         
-        if (size > 0) {
-            numa_memory_range_t* range = &node_info->memory_ranges[0];
-            range->base_address = base;
-            range->size = size;
-            range->node_id = node;
-            range->enabled = topology_is_numa_node_enabled(node);
-            range->hot_pluggable = 0;
-            range->non_volatile = 0;
-            
-            node_info->memory_range_count = 1;
-            node_info->total_memory = size;
-            node_info->free_memory = size;
+        node_info->total_memory += size;
+    }
+    
+    if (!numa_info.num_nodes) numa_info.num_nodes = 1;
+}
+
+/* Move each node's free frames from the paging allocator into its own
+   zone; free_memory is what the zone got, not what SRAT claims */
+static void numa_build_node_zones(void) {
+    u32 direct_end = paging_direct_map_end();
+    
+    for (u8 node = 0; node < numa_info.num_nodes && node < NUMA_ZONE_NODES; node++) {
+        numa_node_info_t* node_info = &numa_info.nodes[node];
+        u32 lo = 0xFFFFFFFF;
+        u32 hi = 0;
+        
+        for (u32 r = 0; r < node_info->memory_range_count; r++) {
+            numa_memory_range_t* range = &node_info->memory_ranges[r];
+            if (range->base_address >= direct_end) continue;
+            u64 end = range->base_address + range->size;
+            if (end > direct_end) end = direct_end;
+            if ((u32)range->base_address < lo) lo = (u32)range->base_address;
+            if ((u32)end > hi) hi = (u32)end;
+        }
+        lo &= ~(u32)4095;
+        if (lo >= hi) continue;
+        
+        u32 pages = (hi - lo + 4095) / 4096;
+        u8* meta = (u8*)paging_alloc_pages((pages + 4095) / 4096);
+        if (!meta) continue;
+        buddy_init(&node_zones[node], lo, pages, meta);
+        
+        u32 moved = 0;
+        for (u32 r = 0; r < node_info->memory_range_count; r++) {
+            numa_memory_range_t* range = &node_info->memory_ranges[r];
+            if (range->base_address >= direct_end) continue;
+            u64 end = range->base_address + range->size;
+            if (end > direct_end) end = direct_end;
+            moved += paging_move_frames(&node_zones[node], (u32)range->base_address,
+                                        (u32)(end - range->base_address));
         }
+        
+        node_info->free_memory = (u64)moved * 4096;
+        node_zone_ready[node] = 1;
     }
 }
 
@@ -123,7 +215,7 @@ static void numa_detect_processor_affinity(void) {
     }
 }
 
-void numa_init(void) {
+static void numa_init_locked(void) {
     numa_info.numa_enabled = 0;
     numa_info.num_nodes = 1;
     numa_info.current_node = 0;
@@ -150,15 +242,23 @@ void numa_init(void) {
     for (u8 i = 0; i < numa_info.num_nodes; i++) {
         numa_node_info_t* node = &numa_info.nodes[i];
         node->node_id = i;
+        node->proximity_domain = i;
         node->processor_count = 0;
         node->total_memory = 0;
         node->free_memory = 0;
         node->memory_range_count = 0;
     }
     
-    numa_parse_slit_table();
     numa_detect_memory_ranges();
+    numa_parse_slit_table();
     numa_detect_processor_affinity();
+    numa_build_node_zones();
+}
+
+void numa_init(void) {
+    u32 flags = write_seqlock(&numa_seq);
+    numa_init_locked();
+    write_sequnlock(&numa_seq, flags);
 }
 
 u8 numa_is_enabled(void) {
@@ -174,11 +274,19 @@ u8 numa_get_current_node(void) {
 }
 
 u8 numa_get_distance(u8 from_node, u8 to_node) {
-    if (from_node >= numa_info.num_nodes || to_node >= numa_info.num_nodes) {
-        return NUMA_UNREACHABLE;
-    }
+    u8 distance;
+    u32 seq;
     
-    return numa_info.distance_matrix[from_node][to_node];
+    do {
+        seq = read_seqbegin(&numa_seq);
+        if (from_node >= numa_info.num_nodes || to_node >= numa_info.num_nodes) {
+            distance = NUMA_UNREACHABLE;
+        } else {
+            distance = numa_info.distance_matrix[from_node][to_node];
+        }
+    } while (read_seqretry(&numa_seq, seq));
+    
+    return distance;
 }
 
 u64 numa_get_node_memory_size(u8 node_id) {
@@ -188,9 +296,15 @@ u64 numa_get_node_memory_size(u8 node_id) {
 }
 
 u64 numa_get_node_free_memory(u8 node_id) {
-    if (node_id >= numa_info.num_nodes) return 0;
+    u64 free;
+    u32 seq;
     
-    return numa_info.nodes[node_id].free_memory;
+    do {
+        seq = read_seqbegin(&numa_seq);
+        free = node_id < numa_info.num_nodes ? numa_info.nodes[node_id].free_memory : 0;
+    } while (read_seqretry(&numa_seq, seq));
+    
+    return free;
 }
 
 u32 numa_get_node_processor_count(u8 node_id) {
@@ -200,34 +314,49 @@ u32 numa_get_node_processor_count(u8 node_id) {
 }
 
 u8 numa_find_closest_node(u8 from_node) {
-    if (from_node >= numa_info.num_nodes) return 0;
-    
-    u8 closest_node = from_node;
-    u8 min_distance = NUMA_UNREACHABLE;
+    u8 closest_node;
+    u32 seq;
     
-    for (u8 i = 0; i < numa_info.num_nodes; i++) {
-        if (i == from_node) continue;
+    do {
+        seq = read_seqbegin(&numa_seq);
+        if (from_node >= numa_info.num_nodes) {
+            closest_node = 0;
+            continue;
+        }
+        
+        closest_node = from_node;
+        u8 min_distance = NUMA_UNREACHABLE;
         
-        u8 distance = numa_info.distance_matrix[from_node][i];
-        if (distance < min_distance && numa_info.nodes[i].free_memory > 0) {
-            min_distance = distance;
-            closest_node = i;
+        for (u8 i = 0; i < numa_info.num_nodes; i++) {
+            if (i == from_node) continue;
+            
+            u8 distance = numa_info.distance_matrix[from_node][i];
+            if (distance < min_distance && numa_info.nodes[i].free_memory > 0) {
+                min_distance = distance;
+                closest_node = i;
+            }
         }
-    }
+    } while (read_seqretry(&numa_seq, seq));
     
     return closest_node;
 }
 
 u8 numa_find_node_with_most_memory(void) {
-    u8 best_node = 0;
-    u64 max_memory = 0;
+    u8 best_node;
+    u32 seq;
     
-    for (u8 i = 0; i < numa_info.num_nodes; i++) {
-        if (numa_info.nodes[i].free_memory > max_memory) {
-            max_memory = numa_info.nodes[i].free_memory;
-            best_node = i;
+    do {
+        seq = read_seqbegin(&numa_seq);
+        best_node = 0;
+        u64 max_memory = 0;
+        
+        for (u8 i = 0; i < numa_info.num_nodes; i++) {
+            if (numa_info.nodes[i].free_memory > max_memory) {
+                max_memory = numa_info.nodes[i].free_memory;
+                best_node = i;
+            }
         }
-    }
+    } while (read_seqretry(&numa_seq, seq));
     
     return best_node;
 }
@@ -248,18 +377,80 @@ u8 numa_get_interleave_mask(void) {
     return numa_info.interleave_mask;
 }
 
-void* numa_alloc_on_node(u32 size, u8 node_id) {
-    if (node_id >= numa_info.num_nodes) return 0;
-    if (numa_info.nodes[node_id].free_memory < size) return 0;
+/* Take bytes off a node's free counter; 0 if it does not have them */
+static u8 numa_reserve(u8 node_id, u32 bytes) {
+    u8 ok = 0;
+    u32 flags = write_seqlock(&numa_seq);
+    if (node_id < numa_info.num_nodes && numa_info.nodes[node_id].free_memory >= bytes) {
+        numa_info.nodes[node_id].free_memory -= bytes;
+        ok = 1;
+    }
+    write_sequnlock(&numa_seq, flags);
+    return ok;
+}
+
+static void numa_unreserve(u8 node_id, u32 bytes) {
+    u32 flags = write_seqlock(&numa_seq);
+    numa_info.nodes[node_id].free_memory += bytes;
+    write_sequnlock(&numa_seq, flags);
+}
+
+/* Node whose ranges hold a physical address, NUMA_ZONE_NODES if none */
+static u8 numa_frame_node(u32 frame) {
+    for (u8 node = 0; node < numa_info.num_nodes; node++) {
+        numa_node_info_t* node_info = &numa_info.nodes[node];
+        
+        for (u32 range = 0; range < node_info->memory_range_count; range++) {
+            numa_memory_range_t* mem_range = &node_info->memory_ranges[range];
+            
+            if (frame >= mem_range->base_address &&
+                frame < mem_range->base_address + mem_range->size) {
+                return node;
+            }
+        }
+    }
+    
+    return NUMA_ZONE_NODES;
+}
+
+/* Back to the owning node's zone, or to the paging allocator when the
+   node has none; the mapping must already be gone everywhere */
+static void numa_release_frame(u32 frame) {
+    u8 node = numa_frame_node(frame);
     
-    extern void* paging_alloc_pages(u32 count);
+    if (node < NUMA_ZONE_NODES && node_zone_ready[node] &&
+        frame - node_zones[node].base < node_zones[node].pages * 4096) {
+        buddy_free_page(&node_zones[node], frame);
+        numa_unreserve(node, 4096);
+    } else {
+        paging_free_frames(frame, 0);
+    }
+}
+
+void* numa_alloc_on_node(u32 size, u8 node_id) {
     u32 pages = (size + 4095) / 4096;
-    void* ptr = paging_alloc_pages(pages);
+    if (!pages) return 0;
+    
+    /* Reserve first, so two allocators cannot both take the last pages */
+    if (!numa_reserve(node_id, pages * 4096)) return 0;
     
-    if (ptr) {
-        numa_info.nodes[node_id].free_memory -= pages * 4096;
+    void* ptr = 0;
+    if (!numa_info.numa_enabled) {
+        /* One node: the paging allocator is node-local */
+        ptr = paging_alloc_pages(pages);
+    } else if (node_id < NUMA_ZONE_NODES && node_zone_ready[node_id]) {
+        buddy_zone_t* zone = &node_zones[node_id];
+        u32 frames = pages == 1 ? buddy_alloc_page(zone) : buddy_alloc_pages(zone, pages);
+        
+        if (frames) {
+            ptr = paging_map_frames(frames, pages);
+            if (!ptr && pages == 1) buddy_free_page(zone, frames);
+            else if (!ptr) buddy_free_pages(zone, frames, pages);
+        }
     }
     
+    if (!ptr) numa_unreserve(node_id, pages * 4096);
+    
     return ptr;
 }
 
@@ -271,7 +462,7 @@ void* numa_alloc_preferred(u32 size, u8 preferred_node) {
     /* Try closest nodes */
     for (u8 distance = NUMA_LOCAL_DISTANCE + 1; distance < NUMA_UNREACHABLE; distance++) {
         for (u8 i = 0; i < numa_info.num_nodes; i++) {
-            if (numa_info.distance_matrix[preferred_node][i] == distance) {
+            if (numa_get_distance(preferred_node, i) == distance) {
                 ptr = numa_alloc_on_node(size, i);
                 if (ptr) return ptr;
             }
@@ -320,45 +511,69 @@ void* numa_alloc(u32 size) {
 void numa_free(void* ptr, u32 size) {
     if (!ptr) return;
     
-    extern void paging_free_pages(void* ptr, u32 count);
     u32 pages = (size + 4095) / 4096;
-    paging_free_pages(ptr, pages);
+    if (!numa_info.numa_enabled) {
+        paging_free_pages(ptr, pages);
+        numa_unreserve(0, pages * 4096);
+        return;
+    }
     
-    /* Update free memory counters */
-    for (u8 i = 0; i < numa_info.num_nodes; i++) {
-        numa_info.nodes[i].free_memory += pages * 4096;
+    /* Migration may have scattered the frames over several nodes */
+    u32 virtual_addr = (u32)ptr & ~4095;
+    u32 frames[NUMA_FREE_BATCH];
+    while (pages) {
+        u32 n = pages < NUMA_FREE_BATCH ? pages : NUMA_FREE_BATCH;
+        for (u32 i = 0; i < n; i++) {
+            frames[i] = paging_get_physical_addr(virtual_addr + i * 4096);
+        }
+        paging_unmap_region(virtual_addr, n * 4096);
+        for (u32 i = 0; i < n; i++) {
+            if (frames[i]) numa_release_frame(frames[i]);
+        }
+        virtual_addr += n * 4096;
+        pages -= n;
     }
 }
 
 u8 numa_get_page_node(void* page_addr) {
-    u64 addr = (u64)page_addr;
+    /* Heap pages live wherever their frame does */
+    u32 frame = paging_get_physical_addr((u32)page_addr);
+    u8 node = numa_frame_node(frame ? frame : (u32)page_addr);
     
-    for (u8 node = 0; node < numa_info.num_nodes; node++) {
-        numa_node_info_t* node_info = &numa_info.nodes[node];
+    return node < numa_info.num_nodes ? node : 0; /* Default to node 0 */
+}
+
+/* Copy each heap page that is not on target_node into a frame there
+   and remap it in place; returns the pages moved. Nothing may write
+   the range meanwhile. */
+u32 numa_migrate_pages(void* start_addr, u32 page_count, u8 target_node) {
+    if (target_node >= NUMA_ZONE_NODES || !node_zone_ready[target_node]) return 0;
+    
+    u32 virtual_addr = (u32)start_addr & ~4095;
+    u32 moved = 0;
+    
+    for (u32 i = 0; i < page_count; i++, virtual_addr += 4096) {
+        /* Only the heap window; moving the direct map would break it */
+        if (virtual_addr - PAGING_HEAP_BASE >= PAGING_HEAP_SIZE) continue;
         
-        for (u32 range = 0; range < node_info->memory_range_count; range++) {
-            numa_memory_range_t* mem_range = &node_info->memory_ranges[range];
-            
-            if (addr >= mem_range->base_address && 
-                addr < mem_range->base_address + mem_range->size) {
-                return node;
-            }
+        u32 old_frame = paging_get_physical_addr(virtual_addr);
+        if (!old_frame || numa_frame_node(old_frame) == target_node) continue;
+        
+        if (!numa_reserve(target_node, 4096)) break;
+        u32 new_frame = buddy_alloc_page(&node_zones[target_node]);
+        if (!new_frame) {
+            numa_unreserve(target_node, 4096);
+            break;
         }
+        
+        /* Node frames are identity mapped */
+        memcpy((void*)new_frame, (void*)virtual_addr, 4096);
+        paging_map_page(virtual_addr, new_frame, PAGE_PRESENT | PAGE_WRITABLE | PAGE_NX);
+        numa_release_frame(old_frame);
+        moved++;
     }
     
-    return 0; /* Default to node 0 */
-}
-
-void numa_migrate_pages(void* start_addr, u32 page_count, u8 target_node) {
-    /* Simplified page migration */
-    if (target_node >= numa_info.num_nodes) return;
-    
-    /* In a real implementation, this would involve:
-     * 1. Allocating pages on target node
-     * 2. Copying page contents
-     * 3. Updating page tables
-     * 4. Freeing old pages
-     */
+    return moved;
 }
 
 void numa_set_current_node(u8 node_id) {
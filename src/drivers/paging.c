@@ -1,51 +1,237 @@
 /*
- * paging.c – x86 memory management with 4KB pages
+ * paging.c – x86 memory management with 4KB and large pages
+ *
+ * Physical pages come from a buddy allocator seeded with the multiboot
+ * memory map (or [4MB, memory_size) without one). Everything below the
+ * boot allocator's high-water mark stays reserved. RAM is identity
+ * mapped, as the allocator keeps its free lists in the free pages.
+ *
+ * The identity map, the higher-half kernel alias and the local APIC /
+ * I/O APIC / HPET window use large pages (4MB with PSE, 2MB with PAE)
+ * wherever a region is aligned for them, so kernel code and data cost
+ * a handful of TLB entries. paging_map_region() does the same for
+ * drivers; mapping a single 4KB page inside a large one splits it.
+ *
+ * With PAGING_PAE the tables hold 64-bit entries: four page
+ * directories sit back to back, so one flat array indexed by va >> 21
+ * covers the whole 4GB, and the PDPT only points at them. RAM above
+ * the identity map is still not managed, but paging_map_region() can
+ * map physical addresses above 4GB, and PAGE_NX works when the CPU
+ * has NX. Everything above the large page holding the kernel image is
+ * mapped no-execute.
+ *
+ * TLB: unmapping clears a whole range first and invalidates once at
+ * the end, with invlpg up to TLB_FLUSH_MAX pages and a full flush past
+ * that. The kernel's own mappings are global (PGE), so a full flush
+ * keeps them; INVPCID does it without touching CR3 where the CPU has
+ * it. Other CPUs get one IPI per range, not per page, and frames are
+ * only freed once every CPU has flushed. Anything that unmaps must run
+ * with interrupts enabled, or the CPU it waits on may be waiting on it.
  */
 
 #include "kernel/types.h"
+#include "kernel/mem.h"
+#include "kernel/buddy.h"
+#include "kernel/smp.h"
+#include "kernel/irq.h"
+#include "drivers/paging.h"
 
 #define PAGE_SIZE 4096
-#define PAGE_ENTRIES 1024
-#define PAGE_DIR_SIZE (PAGE_ENTRIES * sizeof(u32))
-#define PAGE_TABLE_SIZE (PAGE_ENTRIES * sizeof(u32))
-
-/* Page flags */
-#define PAGE_PRESENT    0x001
-#define PAGE_WRITABLE   0x002
-#define PAGE_USER       0x004
-#define PAGE_WRITETHROUGH 0x008
-#define PAGE_CACHE_DISABLE 0x010
-#define PAGE_ACCESSED   0x020
-#define PAGE_DIRTY      0x040
-#define PAGE_SIZE_4MB   0x080
-#define PAGE_GLOBAL     0x100
+
+#if PAGING_PAE
+typedef u64 pte_t;
+#define PT_ENTRIES   512
+#define PD_SHIFT     21
+#define PD_ENTRIES   2048       /* four directories, one per GB */
+#define ENTRY_ADDR   0x000FFFFFFFFFF000ULL
+#define ENTRY_NX     (1ULL << 63)
+#else
+typedef u32 pte_t;
+#define PT_ENTRIES   1024
+#define PD_SHIFT     22
+#define PD_ENTRIES   1024
+#define ENTRY_ADDR   0xFFFFF000
+#endif
+#define LARGE_MASK   (PAGE_LARGE_SIZE - 1)
 
 /* Memory layout */
 #define KERNEL_VIRTUAL_BASE 0xC0000000
-#define KERNEL_PAGE_NUMBER  (KERNEL_VIRTUAL_BASE >> 22)
+#define KERNEL_ALIAS_SIZE   0x400000    /* low 4MB seen from the higher half */
+#define MMIO_WINDOW_BASE    0xFE000000  /* I/O APIC, HPET, local APIC */
+
+/* CR4 and EFER bits */
+#define CR4_PSE   0x010
+#define CR4_PAE   0x020
+#define CR4_PGE   0x080
+#define MSR_EFER  0xC0000080
+#define EFER_NXE  0x800
+
+/* TLB maintenance */
+#define TLB_FLUSH_MAX     32    /* invlpg up to here, then flush all */
+#define UNMAP_BATCH       16    /* physical runs held until the flush */
+#define INVPCID_ALL       2     /* everything, global entries too */
+#define INVPCID_NON_GLOBAL 3
 
-static u32* page_directory = 0;
-static u32* page_tables = 0;
+extern u8 kernel_end[];     /* linker.ld */
+
+static pte_t* page_directory = 0;
+#if PAGING_PAE
+static u64 page_dir_pointers[4] __attribute__((aligned(32)));
+#endif
 static u32 next_free_page = 0x400000; /* Start at 4MB */
 static u32 total_memory = 0;
+static u8 large_pages = 0;
+static u8 nx_enabled = 0;
+static u8 pge_enabled = 0;
+static u8 invpcid_ok = 0;
+
+/* Cleared mappings not yet flushed, and the frames behind them */
+typedef struct {
+    u32 start;
+    u32 pages;                  /* 4KB pages from start, 0 if none */
+    u8 global;
+    u32 nruns;
+    u32 run_start[UNMAP_BATCH];
+    u32 run_pages[UNMAP_BATCH];
+} unmap_batch_t;
+
+/*
+ * One shootdown round at a time; targets flush start..+pages. busy is
+ * taken with IRQs masked, and a CPU waiting for it acks the round in
+ * progress itself, since it can't take that round's IPI.
+ */
+static struct {
+    volatile u32 busy;
+    volatile u32 start;
+    volatile u32 pages;
+    volatile u8 global;
+    volatile u32 pending;       /* bit per CPU still to flush */
+} shootdown;
+
+static paging_tlb_stats_t tlb_stats;
 
-/* Bitmap for physical page allocation */
-static u32* page_bitmap = 0;
-static u32 bitmap_size = 0;
+/* Physical page allocator, once paging_init() has seeded it */
+static buddy_zone_t phys_zone;
+static u8 phys_ready = 0;
+
+/* Highest address paging_init() identity maps */
+#define DIRECT_MAP_LIMIT KERNEL_VIRTUAL_BASE
 
 static inline void invlpg(u32 addr) {
     __asm__ volatile("invlpg (%0)" : : "r"(addr) : "memory");
 }
 
-static inline void load_page_directory(u32 pd_phys) {
-    __asm__ volatile("mov %0, %%cr3" : : "r"(pd_phys));
+static inline void cpuid_regs(u32 leaf, u32* ebx, u32* ecx, u32* edx) {
+    u32 eax;
+    __asm__ volatile("cpuid" : "=a"(eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static inline u32 cpuid_max(u32 leaf) {
+    u32 eax, ebx, ecx, edx;
+    __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(leaf), "c"(0));
+    return eax;
 }
 
-static inline void enable_paging(void) {
-    u32 cr0;
+/* CR3 and CR4 first, then PG: the same on every CPU */
+static void enable_paging(void) {
+    u32 cr0, cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+#if PAGING_PAE
+    cr4 |= CR4_PAE;
+    if (nx_enabled) {
+        u32 lo, hi;
+        __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(MSR_EFER));
+        lo |= EFER_NXE;
+        __asm__ volatile("wrmsr" : : "a"(lo), "d"(hi), "c"(MSR_EFER));
+    }
+    __asm__ volatile("mov %0, %%cr3" : : "r"((u32)page_dir_pointers) : "memory");
+#else
+    if (large_pages) cr4 |= CR4_PSE;
+    __asm__ volatile("mov %0, %%cr3" : : "r"((u32)page_directory) : "memory");
+#endif
+    if (pge_enabled) cr4 |= CR4_PGE;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
     __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
     cr0 |= 0x80000000; /* Set PG bit */
-    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+static inline void invpcid(u32 type) {
+    struct { u64 pcid; u64 addr; } desc = { 0, 0 };
+    __asm__ volatile("invpcid %0, %1" : : "m"(desc), "r"(type) : "memory");
+}
+
+/* Whole TLB of this CPU; global entries only when asked */
+static void flush_all_local(u8 global) {
+    u32 reg;
+    if (invpcid_ok) {
+        invpcid(global ? INVPCID_ALL : INVPCID_NON_GLOBAL);
+    } else if (global && pge_enabled) {
+        /* Toggling PGE drops global entries as well */
+        __asm__ volatile("mov %%cr4, %0" : "=r"(reg));
+        __asm__ volatile("mov %0, %%cr4" : : "r"(reg & ~CR4_PGE) : "memory");
+        __asm__ volatile("mov %0, %%cr4" : : "r"(reg) : "memory");
+    } else {
+        __asm__ volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(reg) : : "memory");
+    }
+    tlb_stats.full_flushes++;
+}
+
+static void flush_range_local(u32 start, u32 pages, u8 global) {
+    if (pages > TLB_FLUSH_MAX) {
+        flush_all_local(global);
+        return;
+    }
+    for (u32 i = 0; i < pages; i++) {
+        invlpg(start + i * PAGE_SIZE);
+    }
+    tlb_stats.invlpg += pages;
+}
+
+/* This CPU's part of the round in progress, if any */
+static void shootdown_ack(void) {
+    u32 bit = 1u << smp_cpu_id();
+    if (__atomic_load_n(&shootdown.pending, __ATOMIC_ACQUIRE) & bit) {
+        flush_range_local(shootdown.start, shootdown.pages, shootdown.global);
+        __atomic_fetch_and(&shootdown.pending, ~bit, __ATOMIC_RELEASE);
+    }
+}
+
+/* Flush here and on every other online CPU, one IPI each */
+static void flush_range(u32 start, u32 pages, u8 global) {
+    flush_range_local(start, pages, global);
+    
+    u32 cpus = smp_num_cpus();
+    if (cpus < 2) return;
+    
+    u32 flags = irq_save();
+    u32 idle = 0;
+    while (!__atomic_compare_exchange_n(&shootdown.busy, &idle, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        shootdown_ack();
+        idle = 0;
+        __asm__ volatile("pause");
+    }
+    shootdown.start = start;
+    shootdown.pages = pages;
+    shootdown.global = global;
+    u32 others = ((1u << cpus) - 1) & ~(1u << smp_cpu_id());
+    __atomic_store_n(&shootdown.pending, others, __ATOMIC_RELEASE);
+    for (u32 c = 0; c < cpus; c++) {
+        smp_send_ipi(c, SMP_TLB_VECTOR);
+    }
+    while (__atomic_load_n(&shootdown.pending, __ATOMIC_ACQUIRE)) {
+        __asm__ volatile("pause");
+    }
+    tlb_stats.shootdowns++;
+    tlb_stats.ipis += cpus - 1;
+    __atomic_store_n(&shootdown.busy, 0, __ATOMIC_RELEASE);
+    irq_restore(flags);
+}
+
+/* SMP_TLB_VECTOR */
+void paging_shootdown_handler(void) {
+    shootdown_ack();
 }
 
 static inline u32 get_cr2(void) {
@@ -54,164 +240,378 @@ static inline u32 get_cr2(void) {
     return addr;
 }
 
-static u32 alloc_physical_page(void) {
-    if (!page_bitmap) {
-        /* Simple allocator before bitmap is set up */
+/* Contiguous physical pages; 0 when out of memory */
+static u32 alloc_physical_pages(u32 count) {
+    if (!phys_ready) {
+        /* Simple allocator before the buddy zone is set up */
         u32 page = next_free_page;
-        next_free_page += PAGE_SIZE;
+        next_free_page += count * PAGE_SIZE;
         return page;
     }
     
-    /* Find free page in bitmap */
-    for (u32 i = 0; i < bitmap_size; i++) {
-        if (page_bitmap[i] != 0xFFFFFFFF) {
-            for (u8 bit = 0; bit < 32; bit++) {
-                if (!(page_bitmap[i] & (1 << bit))) {
-                    page_bitmap[i] |= (1 << bit);
-                    return (i * 32 + bit) * PAGE_SIZE;
-                }
-            }
-        }
-    }
-    
-    return 0; /* Out of memory */
+    /* Single pages come from this CPU's cache */
+    if (count == 1) return buddy_alloc_page(&phys_zone);
+    return buddy_alloc_pages(&phys_zone, count);
+}
+
+static u32 alloc_physical_page(void) {
+    return alloc_physical_pages(1);
+}
+
+static void free_physical_pages(u32 addr, u32 count) {
+    if (!phys_ready) return;
+    if (count == 1) buddy_free_page(&phys_zone, addr);
+    else buddy_free_pages(&phys_zone, addr, count);
 }
 
 static void free_physical_page(u32 addr) {
-    if (!page_bitmap) return;
-    
-    u32 page_num = addr / PAGE_SIZE;
-    u32 bitmap_index = page_num / 32;
-    u8 bit_index = page_num % 32;
+    free_physical_pages(addr, 1);
+}
+
+static void batch_init(unmap_batch_t* b) {
+    b->pages = 0;
+    b->global = 0;
+    b->nruns = 0;
+}
+
+/* Invalidate everything cleared so far, then free the frames */
+static void batch_flush(unmap_batch_t* b) {
+    if (b->pages) flush_range(b->start, b->pages, b->global);
+    for (u32 i = 0; i < b->nruns; i++) {
+        free_physical_pages(b->run_start[i], b->run_pages[i]);
+    }
+    b->pages = 0;
+    b->global = 0;
+    b->nruns = 0;
+}
+
+/* Note a cleared entry covering pages 4KB pages from virtual_addr */
+static void batch_add(unmap_batch_t* b, u32 virtual_addr, u32 pages, u8 global) {
+    if (b->pages && virtual_addr != b->start + b->pages * PAGE_SIZE) batch_flush(b);
+    if (!b->pages) b->start = virtual_addr;
+    b->pages += pages;
+    b->global |= global;
+}
+
+/* Frames to free after the flush; contiguous runs merge in the buddy */
+static void batch_free(unmap_batch_t* b, u32 frame, u32 pages) {
+    u32 n = b->nruns;
+    if (n && frame == b->run_start[n - 1] + b->run_pages[n - 1] * PAGE_SIZE) {
+        b->run_pages[n - 1] += pages;
+        return;
+    }
+    if (n == UNMAP_BATCH) {
+        /* Flushing covers every entry cleared so far, this one too */
+        batch_flush(b);
+        n = 0;
+    }
+    b->run_start[n] = frame;
+    b->run_pages[n] = pages;
+    b->nruns = n + 1;
+}
+
+/* PAGE_NX is a software flag: bit 63 in PAE mode, dropped otherwise */
+static inline pte_t make_entry(u64 physical_addr, u32 flags) {
+    pte_t entry = (pte_t)physical_addr | (flags & 0xFFF & ~PAGE_NX);
+#if PAGING_PAE
+    if ((flags & PAGE_NX) && nx_enabled) entry |= ENTRY_NX;
+#endif
+    return entry;
+}
+
+static inline pte_t* pde_of(u32 virtual_addr) {
+    return &page_directory[virtual_addr >> PD_SHIFT];
+}
+
+static pte_t* table_new(void) {
+    pte_t* table = (pte_t*)alloc_physical_page();
+    if (!table) return 0;
+    for (u32 i = 0; i < PT_ENTRIES; i++) {
+        table[i] = 0;
+    }
+    return table;
+}
+
+/* Replace a large page by a table of the same 4KB mappings */
+static u8 split_large(pte_t* pde, u32 virtual_addr) {
+    pte_t* table = table_new();
+    if (!table) return 0;
+    
+    pte_t base = *pde & (ENTRY_ADDR & ~(pte_t)LARGE_MASK);
+    pte_t attrs = *pde & ~(ENTRY_ADDR | PAGE_SIZE_4MB);
+    for (u32 i = 0; i < PT_ENTRIES; i++) {
+        table[i] = (base + i * PAGE_SIZE) | attrs;
+    }
+    *pde = (pte_t)(u32)table | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+    invlpg(virtual_addr & ~LARGE_MASK);
+    return 1;
+}
+
+/* The 4KB entry for virtual_addr, splitting a large page on the way;
+   with create, a missing table is allocated, else 0 comes back */
+static pte_t* pte_of(u32 virtual_addr, u8 create) {
+    pte_t* pde = pde_of(virtual_addr);
+    
+    if (!(*pde & PAGE_PRESENT)) {
+        if (!create) return 0;
+        pte_t* table = table_new();
+        if (!table) return 0;
+        *pde = (pte_t)(u32)table | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+    } else if (*pde & PAGE_SIZE_4MB) {
+        if (!split_large(pde, virtual_addr)) return 0;
+    }
     
-    if (bitmap_index < bitmap_size) {
-        page_bitmap[bitmap_index] &= ~(1 << bit_index);
+    pte_t* table = (pte_t*)(u32)(*pde & ENTRY_ADDR);
+    return &table[(virtual_addr >> 12) & (PT_ENTRIES - 1)];
+}
+
+static void detect_page_features(void) {
+    u32 ebx, ecx, edx;
+    cpuid_regs(1, &ebx, &ecx, &edx);
+    pge_enabled = (edx >> 13) & 1;
+    /* PCID proper needs IA-32e mode; INVPCID alone still works here */
+    if (cpuid_max(0) >= 7) {
+        u32 leaf1_edx = edx;
+        cpuid_regs(7, &ebx, &ecx, &edx);
+        invpcid_ok = (ebx >> 10) & 1;
+        edx = leaf1_edx;
+    }
+#if PAGING_PAE
+    /* PAE directories always take large pages */
+    large_pages = 1;
+    if (cpuid_max(0x80000000) >= 0x80000001) {
+        cpuid_regs(0x80000001, &ebx, &ecx, &edx);
+        nx_enabled = (edx >> 20) & 1;
     }
+#else
+    large_pages = (edx >> 3) & 1;     /* PSE */
+#endif
 }
 
 void paging_init(u32 memory_size) {
-    total_memory = memory_size;
-    
-    /* Allocate page directory */
-    page_directory = (u32*)alloc_physical_page();
-    
-    /* Clear page directory */
-    for (u32 i = 0; i < PAGE_ENTRIES; i++) {
-        page_directory[i] = 0;
+    const mem_region_t* regions;
+    u32 nregions = mem_regions(&regions);
+    mem_region_t fallback = { next_free_page, memory_size - next_free_page };
+    if (!nregions) {
+        regions = &fallback;
+        nregions = 1;
     }
     
-    /* Identity map first 4MB (kernel space) */
-    u32* first_page_table = (u32*)alloc_physical_page();
-    page_directory[0] = (u32)first_page_table | PAGE_PRESENT | PAGE_WRITABLE;
-    
-    for (u32 i = 0; i < PAGE_ENTRIES; i++) {
-        first_page_table[i] = (i * PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITABLE;
+    /* Top of usable RAM, as far as we can map it */
+    u32 ram_top = 0;
+    total_memory = 0;
+    for (u32 r = 0; r < nregions; r++) {
+        u32 end = regions[r].base + regions[r].size;
+        if (end < regions[r].base || end > DIRECT_MAP_LIMIT) end = DIRECT_MAP_LIMIT;
+        if (end > ram_top) ram_top = end;
+        total_memory += regions[r].size;
     }
     
-    /* Map kernel to higher half */
-    page_directory[KERNEL_PAGE_NUMBER] = (u32)first_page_table | PAGE_PRESENT | PAGE_WRITABLE;
-    
-    /* Set up page bitmap */
-    u32 total_pages = memory_size / PAGE_SIZE;
-    bitmap_size = (total_pages + 31) / 32; /* Round up to nearest 32 */
-    page_bitmap = (u32*)alloc_physical_page();
+    detect_page_features();
     
-    /* Mark used pages in bitmap */
-    for (u32 i = 0; i < bitmap_size; i++) {
-        page_bitmap[i] = 0;
+    /* Allocate and clear the page directory (all four with PAE) */
+    page_directory = (pte_t*)alloc_physical_pages(PD_ENTRIES * sizeof(pte_t) / PAGE_SIZE);
+    for (u32 i = 0; i < PD_ENTRIES; i++) {
+        page_directory[i] = 0;
     }
+#if PAGING_PAE
+    for (u32 i = 0; i < 4; i++) {
+        page_dir_pointers[i] = ((u32)page_directory + i * PAGE_SIZE) | PAGE_PRESENT;
+    }
+#endif
     
-    /* Mark kernel pages as used */
-    u32 kernel_pages = next_free_page / PAGE_SIZE;
-    for (u32 i = 0; i < kernel_pages; i++) {
-        u32 bitmap_index = i / 32;
-        u8 bit_index = i % 32;
-        if (bitmap_index < bitmap_size) {
-            page_bitmap[bitmap_index] |= (1 << bit_index);
-        }
+    /* Identity map RAM: executable up to the end of the large page
+       holding the kernel image, no-execute above */
+    u32 text_top = ((u32)kernel_end + LARGE_MASK) & ~LARGE_MASK;
+    if (text_top > ram_top) text_top = ram_top;
+    paging_map_region(0, 0, text_top, PAGE_PRESENT | PAGE_WRITABLE | PAGE_GLOBAL);
+    paging_map_region(text_top, text_top, ram_top - text_top,
+                      PAGE_PRESENT | PAGE_WRITABLE | PAGE_GLOBAL | PAGE_NX);
+    
+    /* Map kernel to higher half */
+    paging_map_region(KERNEL_VIRTUAL_BASE, 0, KERNEL_ALIAS_SIZE,
+                      PAGE_PRESENT | PAGE_WRITABLE | PAGE_GLOBAL);
+    
+    /* APIC, I/O APIC and HPET registers, uncached */
+    paging_map_region(MMIO_WINDOW_BASE, MMIO_WINDOW_BASE, 0 - MMIO_WINDOW_BASE,
+                      PAGE_PRESENT | PAGE_WRITABLE | PAGE_CACHE_DISABLE | PAGE_GLOBAL | PAGE_NX);
+    
+    /* One byte of buddy state per page up to ram_top */
+    u32 pages = ram_top / PAGE_SIZE;
+    u8* meta = (u8*)alloc_physical_pages((pages + PAGE_SIZE - 1) / PAGE_SIZE);
+    buddy_init(&phys_zone, 0, pages, meta);
+    
+    /* Hand over the map, minus everything handed out so far */
+    for (u32 r = 0; r < nregions; r++) {
+        u32 base = regions[r].base;
+        u32 end = base + regions[r].size;
+        if (end < base || end > ram_top) end = ram_top;
+        if (base < next_free_page) base = next_free_page;
+        if (base < end) buddy_add_range(&phys_zone, base, end - base);
     }
+    phys_ready = 1;
     
     /* Load page directory and enable paging */
-    load_page_directory((u32)page_directory);
     enable_paging();
 }
 
+/* Secondary CPUs: the BSP's tables and paging mode */
+void paging_ap_init(void) {
+    if (page_directory) enable_paging();
+}
+
+u8 paging_large_pages(void) {
+    return large_pages;
+}
+
 u32 paging_map_page(u32 virtual_addr, u32 physical_addr, u32 flags) {
-    u32 page_dir_index = virtual_addr >> 22;
-    u32 page_table_index = (virtual_addr >> 12) & 0x3FF;
-    
-    /* Check if page table exists */
-    if (!(page_directory[page_dir_index] & PAGE_PRESENT)) {
-        /* Allocate new page table */
-        u32* page_table = (u32*)alloc_physical_page();
-        if (!page_table) return 0;
-        
-        /* Clear page table */
-        for (u32 i = 0; i < PAGE_ENTRIES; i++) {
-            page_table[i] = 0;
-        }
-        
-        page_directory[page_dir_index] = (u32)page_table | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+    pte_t* pte = pte_of(virtual_addr, 1);
+    if (!pte) return 0;
+    
+    /* Map the page; only a replaced entry can be in some TLB */
+    pte_t old = *pte;
+    *pte = make_entry(physical_addr, flags);
+    if (old & PAGE_PRESENT) {
+        flush_range(virtual_addr, 1, (old & PAGE_GLOBAL) != 0);
     }
     
-    /* Get page table */
-    u32* page_table = (u32*)(page_directory[page_dir_index] & 0xFFFFF000);
-    
-    /* Map the page */
-    page_table[page_table_index] = physical_addr | flags;
-    
-    /* Invalidate TLB entry */
-    invlpg(virtual_addr);
-    
     return 1;
 }
 
-void paging_unmap_page(u32 virtual_addr) {
-    u32 page_dir_index = virtual_addr >> 22;
-    u32 page_table_index = (virtual_addr >> 12) & 0x3FF;
-    
-    if (!(page_directory[page_dir_index] & PAGE_PRESENT)) {
-        return; /* Page table doesn't exist */
-    }
-    
-    u32* page_table = (u32*)(page_directory[page_dir_index] & 0xFFFFF000);
-    
-    if (page_table[page_table_index] & PAGE_PRESENT) {
-        /* Free physical page */
-        u32 physical_addr = page_table[page_table_index] & 0xFFFFF000;
-        free_physical_page(physical_addr);
+/* Clear [virtual_addr, +left) and flush once; frames go back to the
+   allocator only with free_frames, after every CPU has flushed */
+static void unmap_pages(u32 virtual_addr, u32 left, u8 free_frames) {
+    unmap_batch_t batch;
+    batch_init(&batch);
+    
+    while (left) {
+        pte_t* pde = pde_of(virtual_addr);
+        u32 step = PAGE_LARGE_SIZE - (virtual_addr & LARGE_MASK);
+        if (step > left) step = left;
         
-        /* Clear page table entry */
-        page_table[page_table_index] = 0;
+        if (!(*pde & PAGE_PRESENT)) {
+            /* No table: nothing mapped up to the next one */
+        } else if ((*pde & PAGE_SIZE_4MB) && step == PAGE_LARGE_SIZE) {
+            pte_t old = *pde;
+            *pde = 0;
+            batch_add(&batch, virtual_addr, PAGE_LARGE_SIZE / PAGE_SIZE, (old & PAGE_GLOBAL) != 0);
+            if (free_frames) {
+                batch_free(&batch, (u32)(old & ENTRY_ADDR & ~(pte_t)LARGE_MASK),
+                           PAGE_LARGE_SIZE / PAGE_SIZE);
+            }
+        } else {
+            step = PAGE_SIZE;
+            pte_t* pte = pte_of(virtual_addr, 0);
+            if (pte && (*pte & PAGE_PRESENT)) {
+                pte_t old = *pte;
+                *pte = 0;
+                batch_add(&batch, virtual_addr, 1, (old & PAGE_GLOBAL) != 0);
+                if (free_frames) batch_free(&batch, (u32)(old & ENTRY_ADDR), 1);
+            }
+        }
+        virtual_addr += step;
+        left -= step;
+    }
+    batch_flush(&batch);
+}
+
+void paging_unmap_page(u32 virtual_addr) {
+    unmap_pages(virtual_addr & ~(PAGE_SIZE - 1), PAGE_SIZE, 1);
+}
+
+void paging_unmap_range(u32 virtual_addr, u32 count) {
+    unmap_pages(virtual_addr & ~(PAGE_SIZE - 1), count * PAGE_SIZE, 1);
+}
+
+/* Map [virtual_addr, +size) to [physical_addr, +size) with the largest
+   pages both alignments allow; the memory stays the caller's */
+u32 paging_map_region(u32 virtual_addr, u64 physical_addr, u32 size, u32 flags) {
+    u32 offset = virtual_addr & (PAGE_SIZE - 1);
+    u32 left = (size + offset + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    virtual_addr -= offset;
+    physical_addr &= ~(u64)(PAGE_SIZE - 1);
+#if !PAGING_PAE
+    if (physical_addr + left > 0x100000000ULL) return 0;
+#endif
+    
+    /* Fresh entries need no invalidation, replaced ones do */
+    unmap_batch_t batch;
+    batch_init(&batch);
+    u32 ok = 1;
+    
+    while (left) {
+        if (large_pages && !(virtual_addr & LARGE_MASK) &&
+            !(physical_addr & LARGE_MASK) && left >= PAGE_LARGE_SIZE) {
+            pte_t* pde = pde_of(virtual_addr);
+            pte_t old = *pde;
+            *pde = make_entry(physical_addr, flags | PAGE_SIZE_4MB);
+            if (old & PAGE_PRESENT) {
+                /* The large page replaces whatever 4KB mappings were here */
+                batch_add(&batch, virtual_addr, PAGE_LARGE_SIZE / PAGE_SIZE, 1);
+                if (!(old & PAGE_SIZE_4MB)) batch_free(&batch, (u32)(old & ENTRY_ADDR), 1);
+            }
+            virtual_addr += PAGE_LARGE_SIZE;
+            physical_addr += PAGE_LARGE_SIZE;
+            left -= PAGE_LARGE_SIZE;
+            continue;
+        }
         
-        /* Invalidate TLB entry */
-        invlpg(virtual_addr);
+        pte_t* pte = pte_of(virtual_addr, 1);
+        if (!pte) {
+            ok = 0;
+            break;
+        }
+        pte_t old = *pte;
+        *pte = make_entry(physical_addr, flags);
+        if (old & PAGE_PRESENT) batch_add(&batch, virtual_addr, 1, (old & PAGE_GLOBAL) != 0);
+        virtual_addr += PAGE_SIZE;
+        physical_addr += PAGE_SIZE;
+        left -= PAGE_SIZE;
     }
+    batch_flush(&batch);
+    return ok;
+}
+
+/* Drop a paging_map_region() mapping; frees no memory */
+void paging_unmap_region(u32 virtual_addr, u32 size) {
+    u32 offset = virtual_addr & (PAGE_SIZE - 1);
+    unmap_pages(virtual_addr - offset, (size + offset + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1), 0);
+}
+
+void paging_get_tlb_stats(paging_tlb_stats_t* out) {
+    *out = tlb_stats;
 }
 
 u32 paging_get_physical_addr(u32 virtual_addr) {
-    u32 page_dir_index = virtual_addr >> 22;
-    u32 page_table_index = (virtual_addr >> 12) & 0x3FF;
-    u32 offset = virtual_addr & 0xFFF;
+    pte_t pde = *pde_of(virtual_addr);
     
-    if (!(page_directory[page_dir_index] & PAGE_PRESENT)) {
+    if (!(pde & PAGE_PRESENT)) {
         return 0; /* Page not mapped */
     }
     
-    u32* page_table = (u32*)(page_directory[page_dir_index] & 0xFFFFF000);
+    if (pde & PAGE_SIZE_4MB) {
+        return (u32)(pde & ENTRY_ADDR & ~(pte_t)LARGE_MASK) + (virtual_addr & LARGE_MASK);
+    }
     
-    if (!(page_table[page_table_index] & PAGE_PRESENT)) {
+    pte_t* page_table = (pte_t*)(u32)(pde & ENTRY_ADDR);
+    pte_t pte = page_table[(virtual_addr >> 12) & (PT_ENTRIES - 1)];
+    
+    if (!(pte & PAGE_PRESENT)) {
         return 0; /* Page not mapped */
     }
     
-    return (page_table[page_table_index] & 0xFFFFF000) + offset;
+    return (u32)(pte & ENTRY_ADDR) + (virtual_addr & 0xFFF);
 }
 
-void* paging_alloc_pages(u32 count) {
-    u32 virtual_addr = 0xD0000000; /* Start of heap */
+/* Map count physically contiguous frames at the first free heap
+   address; 0 when the heap window is full. The frames stay the
+   caller's if it fails. */
+void* paging_map_frames(u32 physical_addr, u32 count) {
+    u32 virtual_addr = PAGING_HEAP_BASE;
+    if (!count) return 0;
     
     /* Find free virtual address range */
-    for (u32 i = 0; i < 0x10000000; i += PAGE_SIZE) {
+    for (u32 i = 0; i < PAGING_HEAP_SIZE; i += PAGE_SIZE) {
         u8 found = 1;
         for (u32 j = 0; j < count; j++) {
             if (paging_get_physical_addr(virtual_addr + i + j * PAGE_SIZE)) {
@@ -221,19 +621,15 @@ void* paging_alloc_pages(u32 count) {
         }
         
         if (found) {
-            /* Allocate and map pages */
+            /* Map the run */
             for (u32 j = 0; j < count; j++) {
-                u32 physical_addr = alloc_physical_page();
-                if (!physical_addr) {
-                    /* Clean up partial allocation */
-                    for (u32 k = 0; k < j; k++) {
-                        paging_unmap_page(virtual_addr + i + k * PAGE_SIZE);
-                    }
+                if (!paging_map_page(virtual_addr + i + j * PAGE_SIZE,
+                                     physical_addr + j * PAGE_SIZE,
+                                     PAGE_PRESENT | PAGE_WRITABLE | PAGE_NX)) {
+                    /* Clean up partial mapping, frames untouched */
+                    paging_unmap_region(virtual_addr + i, j * PAGE_SIZE);
                     return 0;
                 }
-                
-                paging_map_page(virtual_addr + i + j * PAGE_SIZE, physical_addr,
-                               PAGE_PRESENT | PAGE_WRITABLE);
             }
             
             return (void*)(virtual_addr + i);
@@ -243,12 +639,20 @@ void* paging_alloc_pages(u32 count) {
     return 0; /* Out of virtual memory */
 }
 
-void paging_free_pages(void* ptr, u32 count) {
-    u32 virtual_addr = (u32)ptr;
+void* paging_alloc_pages(u32 count) {
+    if (!count) return 0;
     
-    for (u32 i = 0; i < count; i++) {
-        paging_unmap_page(virtual_addr + i * PAGE_SIZE);
-    }
+    /* One physically contiguous run */
+    u32 physical_addr = alloc_physical_pages(count);
+    if (!physical_addr) return 0;
+    
+    void* ptr = paging_map_frames(physical_addr, count);
+    if (!ptr) free_physical_pages(physical_addr, count);
+    return ptr;
+}
+
+void paging_free_pages(void* ptr, u32 count) {
+    paging_unmap_range((u32)ptr, count);
 }
 
 void paging_handle_page_fault(u32 error_code, u32 virtual_addr) {
@@ -262,13 +666,14 @@ void paging_handle_page_fault(u32 error_code, u32 virtual_addr) {
         vga_printf("Page not present\n");
         
         /* Try to handle demand paging */
-        if (virtual_addr >= 0xD0000000 && virtual_addr < 0xE0000000) {
+        if (virtual_addr >= PAGING_HEAP_BASE &&
+            virtual_addr < PAGING_HEAP_BASE + PAGING_HEAP_SIZE) {
             /* Heap area - allocate page on demand */
             u32 physical_addr = alloc_physical_page();
             if (physical_addr) {
                 u32 page_aligned = virtual_addr & 0xFFFFF000;
                 paging_map_page(page_aligned, physical_addr,
-                               PAGE_PRESENT | PAGE_WRITABLE);
+                               PAGE_PRESENT | PAGE_WRITABLE | PAGE_NX);
                 return; /* Page fault handled */
             }
         }
@@ -277,19 +682,45 @@ void paging_handle_page_fault(u32 error_code, u32 virtual_addr) {
     /* Unhandled page fault - system will halt */
 }
 
+/* Identity-mapped physical block of 2^order pages, aligned to its
+   size; for allocators that carve it up themselves (slab.c) */
+u32 paging_alloc_frames(u8 order) {
+    if (!phys_ready) return 0;
+    if (!order) return buddy_alloc_page(&phys_zone);
+    return buddy_alloc(&phys_zone, order);
+}
+
+void paging_free_frames(u32 addr, u8 order) {
+    if (!phys_ready) return;
+    if (!order) buddy_free_page(&phys_zone, addr);
+    else buddy_free(&phys_zone, addr, order);
+}
+
+/* Hand the free frames in [addr, addr + size) to another zone, e.g.
+   a NUMA node's; returns the number of pages moved */
+u32 paging_move_frames(buddy_zone_t* to, u32 addr, u32 size) {
+    if (!phys_ready) return 0;
+    
+    buddy_drain(&phys_zone);
+    return buddy_move_range(&phys_zone, to, addr, size);
+}
+
+/* End of the identity-mapped RAM the allocator manages */
+u32 paging_direct_map_end(void) {
+    return phys_ready ? phys_zone.pages * PAGE_SIZE : 0;
+}
+
 u32 paging_get_free_memory(void) {
-    if (!page_bitmap) return 0;
+    if (!phys_ready) return 0;
     
-    u32 free_pages = 0;
-    for (u32 i = 0; i < bitmap_size; i++) {
-        for (u8 bit = 0; bit < 32; bit++) {
-            if (!(page_bitmap[i] & (1 << bit))) {
-                free_pages++;
-            }
-        }
-    }
+    /* Pages sitting in per-CPU caches are free too */
+    return (phys_zone.free_pages + buddy_cached_pages(&phys_zone)) * PAGE_SIZE;
+}
+
+u32 paging_get_largest_free_block(void) {
+    if (!phys_ready) return 0;
     
-    return free_pages * PAGE_SIZE;
+    return buddy_largest_free(&phys_zone) * PAGE_SIZE;
 }
 
 u32 paging_get_used_memory(void) {
@@ -3,6 +3,7 @@
  */
 
 #include "kernel/types.h"
+#include "kernel/rcu.h"
 
 #define PCI_CONFIG_ADDR 0xCF8
 #define PCI_CONFIG_DATA 0xCFC
@@ -45,7 +46,13 @@ typedef struct {
 } pci_device_t;
 
 static pci_device_t pci_devices[256];
+/* Lookups take no lock: pci_device_count is published with release
+   once every entry below it is filled in, and readers load it with
+   acquire. A rescan unpublishes the table and waits out a grace period
+   before overwriting it, so pointers handed out before stay valid
+   until the next pci_init(). */
 static u16 pci_device_count = 0;
+static u16 pci_scanned;             /* pci_init() only */
 
 static inline void outl(u16 port, u32 val) {
     __asm__ volatile("outl %0, %1" : : "a"(val), "Nd"(port));
@@ -122,7 +129,7 @@ static void pci_scan_device(u8 bus, u8 device) {
     
     if (vendor_id == 0xFFFF) return; /* No device */
     
-    pci_device_t* dev = &pci_devices[pci_device_count++];
+    pci_device_t* dev = &pci_devices[pci_scanned++];
     
     dev->bus = bus;
     dev->device = device;
@@ -146,8 +153,8 @@ static void pci_scan_device(u8 bus, u8 device) {
     if (dev->header_type & 0x80) {
         for (u8 func = 1; func < 8; func++) {
             u16 func_vendor = pci_config_read16(bus, device, func, PCI_VENDOR_ID);
-            if (func_vendor != 0xFFFF && pci_device_count < 256) {
-                pci_device_t* func_dev = &pci_devices[pci_device_count++];
+            if (func_vendor != 0xFFFF && pci_scanned < 256) {
+                pci_device_t* func_dev = &pci_devices[pci_scanned++];
                 
                 func_dev->bus = bus;
                 func_dev->device = device;
@@ -171,47 +178,63 @@ static void pci_scan_device(u8 bus, u8 device) {
 }
 
 void pci_init(void) {
-    pci_device_count = 0;
+    /* Rescan: no reader may still be walking the old entries */
+    if (pci_device_count) {
+        __atomic_store_n(&pci_device_count, 0, __ATOMIC_RELEASE);
+        synchronize_rcu();
+    }
+    pci_scanned = 0;
     
     /* Scan all buses and devices */
     for (u16 bus = 0; bus < 256; bus++) {
         for (u8 device = 0; device < 32; device++) {
-            if (pci_device_count >= 256) break;
+            if (pci_scanned >= 256) break;
             pci_scan_device(bus, device);
         }
-        if (pci_device_count >= 256) break;
+        if (pci_scanned >= 256) break;
     }
+    __atomic_store_n(&pci_device_count, pci_scanned, __ATOMIC_RELEASE);
+}
+
+static inline u16 pci_published(void) {
+    return __atomic_load_n(&pci_device_count, __ATOMIC_ACQUIRE);
 }
 
 u16 pci_get_device_count(void) {
-    return pci_device_count;
+    return pci_published();
 }
 
 pci_device_t* pci_get_device(u16 index) {
-    if (index < pci_device_count) {
+    if (index < pci_published()) {
         return &pci_devices[index];
     }
     return 0;
 }
 
 pci_device_t* pci_find_device(u16 vendor_id, u16 device_id) {
-    for (u16 i = 0; i < pci_device_count; i++) {
+    pci_device_t* found = 0;
+    u16 n = pci_published();
+    for (u16 i = 0; i < n; i++) {
         if (pci_devices[i].vendor_id == vendor_id && 
             pci_devices[i].device_id == device_id) {
-            return &pci_devices[i];
+            found = &pci_devices[i];
+            break;
         }
     }
-    return 0;
+    return found;
 }
 
 pci_device_t* pci_find_class(u8 class_code, u8 subclass) {
-    for (u16 i = 0; i < pci_device_count; i++) {
+    pci_device_t* found = 0;
+    u16 n = pci_published();
+    for (u16 i = 0; i < n; i++) {
         if (pci_devices[i].class_code == class_code && 
             pci_devices[i].subclass == subclass) {
-            return &pci_devices[i];
+            found = &pci_devices[i];
+            break;
         }
     }
-    return 0;
+    return found;
 }
 
 void pci_enable_device(pci_device_t* dev) {
@@ -222,7 +245,7 @@ void pci_enable_device(pci_device_t* dev) {
 
 void pci_set_irq_line(pci_device_t* dev, u8 irq) {
     pci_config_write(dev->bus, dev->device, dev->function, PCI_INTERRUPT_LINE, irq);
-    dev->irq_line = irq;
+    dev->irq_line = irq;        /* one byte: readers see old or new */
 }
 
 const char* pci_get_class_name(u8 class_code) {
@@ -64,13 +64,18 @@ u32 pit_get_ticks(void) {
     return pit_ticks;
 }
 
+void pit_add_ticks(u32 n) {
+    /* Credit ticks skipped while IRQ0 was masked for tickless idle */
+    pit_ticks += n;
+}
+
 u32 pit_get_frequency(void) {
     return pit_frequency;
 }
 
 void pit_delay(u32 ms) {
     u32 target = pit_ticks + (ms * pit_frequency / 1000);
-    while (pit_ticks < target) {
+    while ((s32)(pit_ticks - target) < 0) {
         __asm__ volatile("hlt");
     }
 }
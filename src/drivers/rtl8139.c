@@ -3,6 +3,8 @@
  */
 
 #include "kernel/types.h"
+#include "string.h"
+#include "kernel/ring.h"
 
 /* RTL8139 registers */
 #define RTL8139_IDR0        0x00  /* MAC address */
@@ -96,6 +98,7 @@
 #define RTL8139_TSD_SIZE    0x00001FFF  /* Descriptor Size */
 
 #define RX_BUFFER_SIZE      8192
+#define RX_BUFFER_SLACK     (16 + 1536)  /* RCR.WRAP: a packet may run past the end */
 #define TX_BUFFER_SIZE      1536
 
 typedef struct {
@@ -104,13 +107,24 @@ typedef struct {
     u8 mac_addr[6];
     u8* rx_buffer;
     u8* tx_buffers[4];
-    u16 rx_offset;
+    u16 rx_scan;        /* next header the IRQ handler has not queued */
     u8 tx_current;
     u8 initialized;
 } rtl8139_device_t;
 
 static rtl8139_device_t rtl8139_dev;
 
+/* IRQ handler -> rx_borrow: where each packet sits in rx_buffer. A
+   minimum frame takes 68 bytes of ring, so the 8KB ring never holds
+   more than 128 packets and the descriptor ring cannot overflow. */
+typedef struct {
+    u16 offset;         /* packet header in rx_buffer */
+    u16 raw;            /* length incl. CRC, as the chip wrote it */
+} rtl8139_rx_desc_t;
+
+#define RX_DESC_COUNT       128
+SPSC_RING_DEFINE(rx_ring, rtl8139_rx_desc_t, RX_DESC_COUNT);
+
 static inline void outb(u16 port, u8 val) {
     __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"(port));
 }
@@ -166,7 +180,8 @@ u8 rtl8139_init(u16 io_base, u8 irq) {
     
     /* Allocate receive buffer */
     extern void* paging_alloc_pages(u32 count);
-    rtl8139_dev.rx_buffer = (u8*)paging_alloc_pages(2); /* 8KB */
+    rtl8139_dev.rx_buffer = (u8*)paging_alloc_pages(
+        (RX_BUFFER_SIZE + RX_BUFFER_SLACK + 4095) / 4096);
     if (!rtl8139_dev.rx_buffer) return 0;
     
     /* Allocate transmit buffers */
@@ -198,15 +213,20 @@ u8 rtl8139_init(u16 io_base, u8 irq) {
     /* Enable receiver and transmitter */
     outb(io_base + RTL8139_CR, RTL8139_CR_RE | RTL8139_CR_TE);
     
-    rtl8139_dev.rx_offset = 0;
+    rtl8139_dev.rx_scan = 0;
+    spsc_init(&rx_ring);
     rtl8139_dev.tx_current = 0;
     rtl8139_dev.initialized = 1;
     
     return 1;
 }
 
-u8 rtl8139_send_packet(const void* data, u16 length) {
-    if (!rtl8139_dev.initialized || length > TX_BUFFER_SIZE) return 0;
+/*
+ * Zero-copy TX: the caller builds the frame straight in the next
+ * descriptor's buffer, then commits it.
+ */
+void* rtl8139_tx_reserve(void) {
+    if (!rtl8139_dev.initialized) return 0;
     
     u8 tx_desc = rtl8139_dev.tx_current;
     
@@ -218,14 +238,14 @@ u8 rtl8139_send_packet(const void* data, u16 length) {
         return 0; /* Transmit descriptor not available */
     }
     
-    /* Copy data to transmit buffer */
-    const u8* src = (const u8*)data;
-    for (u16 i = 0; i < length; i++) {
-        rtl8139_dev.tx_buffers[tx_desc][i] = src[i];
-    }
+    return rtl8139_dev.tx_buffers[tx_desc];
+}
+
+u8 rtl8139_tx_commit(u16 length) {
+    if (!rtl8139_dev.initialized || length > TX_BUFFER_SIZE) return 0;
     
     /* Start transmission */
-    outl(rtl8139_dev.io_base + RTL8139_TSD0 + tx_desc * 4, length);
+    outl(rtl8139_dev.io_base + RTL8139_TSD0 + rtl8139_dev.tx_current * 4, length);
     
     /* Move to next transmit descriptor */
     rtl8139_dev.tx_current = (rtl8139_dev.tx_current + 1) % 4;
@@ -233,44 +253,77 @@ u8 rtl8139_send_packet(const void* data, u16 length) {
     return 1;
 }
 
-u16 rtl8139_receive_packet(void* buffer, u16 max_length) {
-    if (!rtl8139_dev.initialized) return 0;
+u8 rtl8139_send_packet(const void* data, u16 length) {
+    if (length > TX_BUFFER_SIZE) return 0;
     
-    u16 capr = inw(rtl8139_dev.io_base + RTL8139_CAPR);
-    u16 cbr = inw(rtl8139_dev.io_base + RTL8139_CBR);
+    u8* buf = rtl8139_tx_reserve();
+    if (!buf) return 0;
     
-    if (capr == cbr) {
-        return 0; /* No packets available */
-    }
+    memcpy(buf, data, length);
+    return rtl8139_tx_commit(length);
+}
+
+/*
+ * Zero-copy RX: RCR.WRAP makes the chip finish a packet past the end of
+ * the ring instead of wrapping, so each one is contiguous in rx_buffer
+ * and can be handed out in place. The IRQ handler queues a descriptor
+ * per packet; one reader borrows the oldest and releases it, which
+ * gives its ring space back to the chip.
+ */
+const void* rtl8139_rx_borrow(u16* length) {
+    const rtl8139_rx_desc_t* d = spsc_peek(&rx_ring);
+    if (!d) return 0; /* No packets available */
     
-    /* Packet header: status (2 bytes) + length (2 bytes) */
-    u16 offset = (capr + 16) % RX_BUFFER_SIZE;
-    u16 status = *(u16*)(rtl8139_dev.rx_buffer + offset);
-    u16 length = *(u16*)(rtl8139_dev.rx_buffer + offset + 2);
+    *length = d->raw - 4; /* Strip CRC */
+    return rtl8139_dev.rx_buffer + d->offset + 4;
+}
+
+void rtl8139_rx_release(void) {
+    const rtl8139_rx_desc_t* d = spsc_peek(&rx_ring);
+    if (!d) return;
     
-    if (!(status & 0x01)) {
-        return 0; /* Packet not valid */
-    }
+    /* Header + data + CRC, rounded up to a dword */
+    u16 next = (d->offset + ((d->raw + 4 + 3) & ~3)) % RX_BUFFER_SIZE;
+    spsc_consume(&rx_ring);
     
-    /* Remove CRC from length */
-    length -= 4;
+    /* CAPR trails the read pointer by 16 */
+    outw(rtl8139_dev.io_base + RTL8139_CAPR, next - 16);
+}
+
+/* Queue every packet the chip has finished since the last call */
+static void rtl8139_rx_scan(void) {
+    u16 cbr = inw(rtl8139_dev.io_base + RTL8139_CBR) % RX_BUFFER_SIZE;
+    
+    while (rtl8139_dev.rx_scan != cbr) {
+        u8* hdr = rtl8139_dev.rx_buffer + rtl8139_dev.rx_scan;
+        u16 status = *(u16*)hdr;
+        u16 raw = *(u16*)(hdr + 2);
+        
+        if (!(status & 0x01) || raw < 4) {
+            break; /* Packet not valid (or still being written) */
+        }
+        
+        rtl8139_rx_desc_t* d = spsc_reserve(&rx_ring);
+        if (!d) break;
+        d->offset = rtl8139_dev.rx_scan;
+        d->raw = raw;
+        spsc_commit(&rx_ring);
+        
+        rtl8139_dev.rx_scan = (rtl8139_dev.rx_scan + ((raw + 4 + 3) & ~3)) % RX_BUFFER_SIZE;
+    }
+}
+
+u16 rtl8139_receive_packet(void* buffer, u16 max_length) {
+    u16 length;
+    const void* pkt = rtl8139_rx_borrow(&length);
+    if (!pkt) return 0;
     
     if (length > max_length) {
         length = max_length;
     }
     
-    /* Copy packet data */
-    u8* dest = (u8*)buffer;
-    u16 data_offset = (offset + 4) % RX_BUFFER_SIZE;
-    
-    for (u16 i = 0; i < length; i++) {
-        dest[i] = rtl8139_dev.rx_buffer[(data_offset + i) % RX_BUFFER_SIZE];
-    }
-    
-    /* Update CAPR */
-    u16 packet_size = ((length + 4 + 3) & ~3) + 4; /* Align to 4 bytes + header */
-    capr = (capr + packet_size) % RX_BUFFER_SIZE;
-    outw(rtl8139_dev.io_base + RTL8139_CAPR, capr - 16);
+    memcpy(buffer, pkt, length);
+    rtl8139_rx_release();
     
     return length;
 }
@@ -285,6 +338,7 @@ void rtl8139_irq_handler(void) {
     
     if (status & RTL8139_INT_ROK) {
         /* Packet received */
+        rtl8139_rx_scan();
     }
     
     if (status & RTL8139_INT_TOK) {
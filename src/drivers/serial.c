@@ -3,6 +3,11 @@
  */
 
 #include "kernel/types.h"
+#include "kernel/ring.h"
+
+/* COM1 is the console: its TX goes through the ring in kernel/uart.c */
+extern void uart_putc(char c);
+extern void uart_tx_irq(void);
 
 /* Serial port base addresses */
 #define COM1_BASE 0x3F8
@@ -80,18 +85,17 @@ typedef struct {
     u8 stop_bits;
     u8 parity;
     u8 rx_buffer[256];
-    u8 rx_head;
-    u8 rx_tail;
+    spsc_ring_t rx_ring;   /* IRQ handler -> serial_getc, lock-free */
     u8 tx_buffer[256];
     u8 tx_head;
     u8 tx_tail;
 } serial_port_t;
 
 static serial_port_t serial_ports[4] = {
-    {COM1_BASE, 4, 0, 0, 0, 0, 0, {0}, 0, 0, {0}, 0, 0},
-    {COM2_BASE, 3, 0, 0, 0, 0, 0, {0}, 0, 0, {0}, 0, 0},
-    {COM3_BASE, 4, 0, 0, 0, 0, 0, {0}, 0, 0, {0}, 0, 0},
-    {COM4_BASE, 3, 0, 0, 0, 0, 0, {0}, 0, 0, {0}, 0, 0}
+    {COM1_BASE, 4, 0, 0, 0, 0, 0, {0}, {0, 0, 0, 0, 0}, {0}, 0, 0},
+    {COM2_BASE, 3, 0, 0, 0, 0, 0, {0}, {0, 0, 0, 0, 0}, {0}, 0, 0},
+    {COM3_BASE, 4, 0, 0, 0, 0, 0, {0}, {0, 0, 0, 0, 0}, {0}, 0, 0},
+    {COM4_BASE, 3, 0, 0, 0, 0, 0, {0}, {0, 0, 0, 0, 0}, {0}, 0, 0}
 };
 
 static inline void outb(u16 port, u8 val) {
@@ -175,7 +179,7 @@ u8 serial_init(u8 port, u32 baud_rate, u8 data_bits, u8 stop_bits, u8 parity) {
     outb(sp->base + UART_IER, IER_DATA_AVAILABLE | IER_LINE_STATUS);
     
     /* Clear buffers */
-    sp->rx_head = sp->rx_tail = 0;
+    sp->rx_ring = (spsc_ring_t){ sp->rx_buffer, sizeof(sp->rx_buffer) - 1, 1, 0, 0 };
     sp->tx_head = sp->tx_tail = 0;
     
     /* Store configuration */
@@ -193,6 +197,11 @@ void serial_putc(u8 port, char c) {
     
     serial_port_t* sp = &serial_ports[port];
     
+    if (port == 0) {
+        uart_putc(c);
+        return;
+    }
+    
     /* Wait for transmitter to be ready */
     while (!(inb(sp->base + UART_LSR) & LSR_THR_EMPTY));
     
@@ -213,12 +222,11 @@ u8 serial_getc(u8 port) {
     
     serial_port_t* sp = &serial_ports[port];
     
-    if (sp->rx_head == sp->rx_tail) {
+    u8 c;
+    if (!spsc_pop(&sp->rx_ring, &c)) {
         return 0; /* No data available */
     }
     
-    u8 c = sp->rx_buffer[sp->rx_tail];
-    sp->rx_tail = (sp->rx_tail + 1) % 256;
     return c;
 }
 
@@ -226,7 +234,7 @@ u8 serial_available(u8 port) {
     if (port >= 4 || !serial_ports[port].initialized) return 0;
     
     serial_port_t* sp = &serial_ports[port];
-    return sp->rx_head != sp->rx_tail;
+    return spsc_count(&sp->rx_ring) != 0;
 }
 
 char serial_getchar_blocking(u8 port) {
@@ -281,37 +289,37 @@ void serial_irq_handler(u8 port) {
     
     serial_port_t* sp = &serial_ports[port];
     
-    /* Read interrupt identification */
-    u8 iir = inb(sp->base + UART_IIR);
-    
-    if (iir & 0x01) return; /* No interrupt pending */
-    
-    switch ((iir >> 1) & 0x07) {
-        case 0x02: /* Received data available */
-        case 0x06: /* Character timeout */
-            while (inb(sp->base + UART_LSR) & LSR_DATA_READY) {
-                u8 c = inb(sp->base + UART_DATA);
-                u8 next_head = (sp->rx_head + 1) % 256;
-                if (next_head != sp->rx_tail) {
-                    sp->rx_buffer[sp->rx_head] = c;
-                    sp->rx_head = next_head;
+    /* Until IIR says none: the ISA line is edge triggered, so a cause
+       left pending would never raise another edge */
+    u8 iir;
+    while (!((iir = inb(sp->base + UART_IIR)) & 0x01)) {
+        switch ((iir >> 1) & 0x07) {
+            case 0x02: /* Received data available */
+            case 0x06: /* Character timeout */
+                while (inb(sp->base + UART_LSR) & LSR_DATA_READY) {
+                    u8 c = inb(sp->base + UART_DATA);
+                    spsc_push(&sp->rx_ring, &c); /* full: drop */
                 }
-            }
-            break;
+                break;
             
-        case 0x01: /* Transmitter empty */
-            /* Handle transmit buffer if needed */
-            break;
+            case 0x01: /* Transmitter empty: refill 16 bytes from the ring */
+                if (port == 0) {
+                    uart_tx_irq();
+                } else {
+                    outb(sp->base + UART_IER, inb(sp->base + UART_IER) & ~IER_THR_EMPTY);
+                }
+                break;
             
-        case 0x03: /* Line status error */
-            /* Read LSR to clear error */
-            inb(sp->base + UART_LSR);
-            break;
+            case 0x03: /* Line status error */
+                /* Read LSR to clear error */
+                inb(sp->base + UART_LSR);
+                break;
             
-        case 0x00: /* Modem status change */
-            /* Read MSR to clear interrupt */
-            inb(sp->base + UART_MSR);
-            break;
+            case 0x00: /* Modem status change */
+                /* Read MSR to clear interrupt */
+                inb(sp->base + UART_MSR);
+                break;
+        }
     }
 }
 
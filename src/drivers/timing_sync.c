@@ -220,6 +220,10 @@ u8 timing_sync_is_tsc_invariant(void) {
     return timing_sync_info.tsc.invariant;
 }
 
+u8 timing_sync_is_tsc_deadline_supported(void) {
+    return timing_sync_info.tsc_deadline_supported;
+}
+
 u8 timing_sync_is_rdtscp_supported(void) {
     return timing_sync_info.rdtscp_supported;
 }
@@ -247,6 +251,12 @@ u64 timing_sync_get_tsc_frequency(void) {
     return timing_sync_info.tsc.frequency;
 }
 
+void timing_sync_set_tsc_frequency(u64 frequency) {
+    /* Calibrated elsewhere (clocksource); replaces the boot estimate */
+    timing_sync_info.tsc.frequency = frequency;
+    timing_sync_info.tsc.reliable = 1;
+}
+
 void timing_sync_set_tsc_deadline(u64 deadline) {
     if (!timing_sync_info.tsc_deadline_supported || !msr_is_supported()) return;
     
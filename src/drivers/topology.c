@@ -207,8 +207,8 @@ static void topology_parse_srat_table(void) {
         topology_info.numa_nodes[0].numa_node_id = 0;
         topology_info.numa_nodes[0].memory_base_low = 0;
         topology_info.numa_nodes[0].memory_base_high = 0;
-        topology_info.numa_nodes[0].memory_length_low = 0x100000000ULL; /* 4GB */
-        topology_info.numa_nodes[0].memory_length_high = 0;
+        topology_info.numa_nodes[0].memory_length_low = 0;
+        topology_info.numa_nodes[0].memory_length_high = 1; /* 4GB */
         topology_info.numa_nodes[0].proximity_domain = 0;
         topology_info.numa_nodes[0].enabled = 1;
         return;
@@ -351,6 +351,12 @@ u64 topology_get_numa_memory_size(u8 node_id) {
     return ((u64)node->memory_length_high << 32) | node->memory_length_low;
 }
 
+u32 topology_get_numa_proximity_domain(u8 node_id) {
+    if (node_id >= topology_info.num_numa_nodes) return 0;
+    
+    return topology_info.numa_nodes[node_id].proximity_domain;
+}
+
 u8 topology_is_numa_node_enabled(u8 node_id) {
     if (node_id >= topology_info.num_numa_nodes) return 0;
     
@@ -3,6 +3,7 @@
  */
 
 #include "kernel/types.h"
+#include "kernel/slab.h"
 
 /* UHCI registers */
 #define UHCI_USBCMD       0x00  /* USB Command */
@@ -91,14 +92,16 @@ typedef struct {
     u8 irq;
     u32* frame_list;
     uhci_qh_t* control_qh;
-    uhci_td_t* td_pool;
-    u8 td_pool_used[32];
     u8 initialized;
 } uhci_controller_t;
 
 static uhci_controller_t uhci_controllers[4];
 static u8 uhci_controller_count = 0;
 
+/* TDs for every controller; identity-mapped, so the controller can
+   follow the pointers as they are */
+static kmem_cache_t uhci_td_cache;
+
 static inline void outw(u16 port, u16 val) {
     __asm__ volatile("outw %0, %1" : : "a"(val), "Nd"(port));
 }
@@ -120,28 +123,21 @@ static inline u32 inl(u16 port) {
 }
 
 static uhci_td_t* uhci_alloc_td(uhci_controller_t* ctrl) {
-    for (u8 i = 0; i < 32; i++) {
-        if (!ctrl->td_pool_used[i]) {
-            ctrl->td_pool_used[i] = 1;
-            uhci_td_t* td = &ctrl->td_pool[i];
-            
-            /* Clear TD */
-            td->link_ptr = 1; /* Terminate */
-            td->control_status = 0;
-            td->token = 0;
-            td->buffer_ptr = 0;
-            
-            return td;
-        }
+    (void)ctrl;
+    uhci_td_t* td = (uhci_td_t*)kmem_cache_alloc(&uhci_td_cache);
+    if (td) {
+        /* Clear TD */
+        td->link_ptr = 1; /* Terminate */
+        td->control_status = 0;
+        td->token = 0;
+        td->buffer_ptr = 0;
     }
-    return 0;
+    return td;
 }
 
 static void uhci_free_td(uhci_controller_t* ctrl, uhci_td_t* td) {
-    u32 index = td - ctrl->td_pool;
-    if (index < 32) {
-        ctrl->td_pool_used[index] = 0;
-    }
+    (void)ctrl;
+    kmem_cache_free(&uhci_td_cache, td);
 }
 
 static void uhci_reset_controller(uhci_controller_t* ctrl) {
@@ -196,13 +192,10 @@ u8 uhci_init(u16 io_base, u8 irq) {
     ctrl->io_base = io_base;
     ctrl->irq = irq;
     
-    /* Allocate TD pool */
-    extern void* paging_alloc_pages(u32 count);
-    ctrl->td_pool = (uhci_td_t*)paging_alloc_pages(1);
-    if (!ctrl->td_pool) return 0;
-    
-    for (u8 i = 0; i < 32; i++) {
-        ctrl->td_pool_used[i] = 0;
+    /* TD cache, shared by all controllers; TDs are 16-byte aligned */
+    if (uhci_controller_count == 0 &&
+        !kmem_cache_init(&uhci_td_cache, "uhci_td", sizeof(uhci_td_t), 16, 0)) {
+        return 0;
     }
     
     /* Reset controller */
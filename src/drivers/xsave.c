@@ -3,6 +3,7 @@
  */
 
 #include "kernel/types.h"
+#include "kernel/slab.h"
 
 /* XSAVE feature bits */
 #define XFEATURE_FP             0x01    /* x87 floating point */
@@ -102,6 +103,10 @@ static void xsave_enumerate_features(void) {
     xsave_info.feature_offsets[1] = 160;
 }
 
+/* Save areas: sized for every supported feature, so enabling more
+   later still fits; XSAVE wants 64-byte alignment */
+static kmem_cache_t xsave_area_cache;
+
 static void xsave_enable_osxsave(void) {
     u32 cr4;
     __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
@@ -132,6 +137,7 @@ void xsave_init(void) {
     
     xsave_enumerate_features();
     xsave_enable_osxsave();
+    kmem_cache_init(&xsave_area_cache, "xsave_area", xsave_info.max_xsave_size, 64, 0);
     
     /* Enable basic features: x87 + SSE */
     u64 basic_features = XFEATURE_FP | XFEATURE_SSE;
@@ -277,10 +283,7 @@ u8 xsave_disable_feature(u32 feature_bit) {
 void* xsave_alloc_area(void) {
     if (!xsave_info.xsave_supported) return 0;
     
-    extern void* paging_alloc_pages(u32 count);
-    u32 pages_needed = (xsave_info.max_xsave_size_enabled + 4095) / 4096;
-    
-    void* area = paging_alloc_pages(pages_needed);
+    void* area = kmem_cache_alloc(&xsave_area_cache);
     if (area) {
         /* Clear the area */
         u8* ptr = (u8*)area;
@@ -292,6 +295,10 @@ void* xsave_alloc_area(void) {
     return area;
 }
 
+void xsave_free_area(void* xsave_area) {
+    kmem_cache_free(&xsave_area_cache, xsave_area);
+}
+
 void xsave_init_area(void* xsave_area) {
     if (!xsave_info.xsave_supported || !xsave_area) return;
     
@@ -0,0 +1,295 @@
+/*
+ * buddy.c - binary buddy page allocator (see buddy.h)
+ */
+
+#include "kernel/buddy.h"
+#include "kernel/irq.h"
+
+#define BUDDY_FREE 0x80     // meta: first page of a free block, | order
+
+static inline buddy_block_t* block_at(buddy_zone_t* z, u32 idx) {
+    return (buddy_block_t*)(z->base + (idx << BUDDY_PAGE_SHIFT));
+}
+
+static inline u32 block_idx(buddy_zone_t* z, buddy_block_t* b) {
+    return ((u32)b - z->base) >> BUDDY_PAGE_SHIFT;
+}
+
+static void list_add(buddy_zone_t* z, u32 idx, u8 order) {
+    buddy_block_t* b = block_at(z, idx);
+    b->prev = 0;
+    b->next = z->free[order];
+    if (b->next) b->next->prev = b;
+    z->free[order] = b;
+    z->nr_free[order]++;
+    z->free_mask |= 1u << order;
+    z->meta[idx] = BUDDY_FREE | order;
+}
+
+static void list_del(buddy_zone_t* z, u32 idx, u8 order) {
+    buddy_block_t* b = block_at(z, idx);
+    if (b->prev) b->prev->next = b->next;
+    else z->free[order] = b->next;
+    if (b->next) b->next->prev = b->prev;
+    if (!--z->nr_free[order]) z->free_mask &= ~(1u << order);
+    z->meta[idx] = 0;
+}
+
+// caller holds the lock; idx is the first page of an allocated block
+static void free_locked(buddy_zone_t* z, u32 idx, u8 order) {
+    if (z->meta[idx] & BUDDY_FREE) return;      // double free
+    z->free_pages += 1u << order;
+
+    while (order + 1 < BUDDY_MAX_ORDER) {
+        u32 buddy = idx ^ (1u << order);
+        if (buddy >= z->pages || z->meta[buddy] != (BUDDY_FREE | order)) break;
+        list_del(z, buddy, order);
+        idx &= ~(1u << order);
+        order++;
+    }
+    list_add(z, idx, order);
+}
+
+// the largest aligned block that starts at idx and fits in count pages
+static inline u8 chunk_order(u32 idx, u32 count) {
+    u8 order = 0;
+    while (order + 1 < BUDDY_MAX_ORDER && !(idx & (1u << order)) &&
+           (2u << order) <= count) {
+        order++;
+    }
+    return order;
+}
+
+static void free_run_locked(buddy_zone_t* z, u32 idx, u32 count) {
+    while (count) {
+        u8 order = chunk_order(idx, count);
+        free_locked(z, idx, order);
+        idx += 1u << order;
+        count -= 1u << order;
+    }
+}
+
+void buddy_init(buddy_zone_t* z, u32 base, u32 pages, u8* meta) {
+    z->base = base;
+    z->pages = pages;
+    z->meta = meta;
+    for (u32 i = 0; i < pages; i++) meta[i] = 0;
+    for (u8 o = 0; o < BUDDY_MAX_ORDER; o++) {
+        z->free[o] = 0;
+        z->nr_free[o] = 0;
+    }
+    z->free_mask = 0;
+    z->free_pages = 0;
+    z->lock.lock = 0;
+    for (u32 i = 0; i < SMP_MAX_CPUS; i++) {
+        buddy_pcp_t* p = &z->pcp[i];
+        p->head = 0;
+        p->count = p->allocs = p->hits = p->refills = p->drains = 0;
+    }
+}
+
+void buddy_add_range(buddy_zone_t* z, u32 addr, u32 size) {
+    u32 end = addr + size;
+    if (end < addr) end = 0xFFFFFFFF;   // wrapped at 4 GB
+    if (addr < z->base) addr = z->base;
+    u32 first = (addr - z->base + BUDDY_PAGE_SIZE - 1) >> BUDDY_PAGE_SHIFT;
+    u32 last = end > z->base ? (end - z->base) >> BUDDY_PAGE_SHIFT : 0;
+    if (last > z->pages) last = z->pages;
+    if (first >= last) return;
+
+    u32 flags = spin_lock_irqsave_kernel(&z->lock);
+    free_run_locked(z, first, last - first);
+    spin_unlock_irqrestore_kernel(&z->lock, flags);
+}
+
+// caller holds the lock; 0 when nothing is big enough
+static u32 alloc_locked(buddy_zone_t* z, u8 order) {
+    u32 avail = z->free_mask & ~((1u << order) - 1);
+    if (!avail) return 0;
+
+    u8 o = (u8)__builtin_ctz(avail);
+    u32 idx = block_idx(z, z->free[o]);
+    list_del(z, idx, o);
+    while (o > order) {             // give back the upper halves
+        o--;
+        list_add(z, idx + (1u << o), o);
+    }
+    z->free_pages -= 1u << order;
+    return z->base + (idx << BUDDY_PAGE_SHIFT);
+}
+
+// caller has kernel IRQs masked and owns p
+static void pcp_drain(buddy_zone_t* z, buddy_pcp_t* p, u32 n) {
+    spin_lock(&z->lock);
+    while (n-- && p->head) {
+        buddy_block_t* b = p->head;
+        p->head = b->next;
+        p->count--;
+        free_locked(z, block_idx(z, b), 0);
+    }
+    spin_unlock(&z->lock);
+    p->drains++;
+}
+
+u32 buddy_alloc(buddy_zone_t* z, u8 order) {
+    if (order >= BUDDY_MAX_ORDER) return 0;
+
+    u32 flags = spin_lock_irqsave_kernel(&z->lock);
+    u32 addr = alloc_locked(z, order);
+    spin_unlock_irqrestore_kernel(&z->lock, flags);
+    if (addr) return addr;
+
+    // our cached pages may be what keeps a block from merging
+    flags = irq_save_kernel();
+    buddy_pcp_t* p = &z->pcp[smp_cpu_id()];
+    if (p->count) {
+        pcp_drain(z, p, p->count);
+        spin_lock(&z->lock);
+        addr = alloc_locked(z, order);
+        spin_unlock(&z->lock);
+    }
+    irq_restore_kernel(flags);
+    return addr;
+}
+
+void buddy_free(buddy_zone_t* z, u32 addr, u8 order) {
+    u32 idx = (addr - z->base) >> BUDDY_PAGE_SHIFT;
+    if (addr < z->base || idx >= z->pages || order >= BUDDY_MAX_ORDER) return;
+
+    u32 flags = spin_lock_irqsave_kernel(&z->lock);
+    free_locked(z, idx, order);
+    spin_unlock_irqrestore_kernel(&z->lock, flags);
+}
+
+u32 buddy_alloc_page(buddy_zone_t* z) {
+    u32 flags = irq_save_kernel();
+    buddy_pcp_t* p = &z->pcp[smp_cpu_id()];
+    p->allocs++;
+
+    if (p->count) {
+        p->hits++;
+    } else {
+        spin_lock(&z->lock);
+        for (u32 i = 0; i < BUDDY_PCP_BATCH; i++) {
+            u32 addr = alloc_locked(z, 0);
+            if (!addr) break;
+            buddy_block_t* b = (buddy_block_t*)addr;
+            b->next = p->head;
+            p->head = b;
+            p->count++;
+        }
+        spin_unlock(&z->lock);
+        p->refills++;
+        if (!p->count) {
+            irq_restore_kernel(flags);
+            return 0;
+        }
+    }
+
+    buddy_block_t* b = p->head;
+    p->head = b->next;
+    p->count--;
+    irq_restore_kernel(flags);
+    return (u32)b;
+}
+
+void buddy_free_page(buddy_zone_t* z, u32 addr) {
+    if (addr < z->base || ((addr - z->base) >> BUDDY_PAGE_SHIFT) >= z->pages) return;
+
+    u32 flags = irq_save_kernel();
+    buddy_pcp_t* p = &z->pcp[smp_cpu_id()];
+    // make room first, so the page just freed stays cached
+    if (p->count >= BUDDY_PCP_HIGH) pcp_drain(z, p, BUDDY_PCP_BATCH);
+    buddy_block_t* b = (buddy_block_t*)(addr & ~(BUDDY_PAGE_SIZE - 1));
+    b->next = p->head;
+    p->head = b;
+    p->count++;
+    irq_restore_kernel(flags);
+}
+
+void buddy_drain(buddy_zone_t* z) {
+    u32 flags = irq_save_kernel();
+    buddy_pcp_t* p = &z->pcp[smp_cpu_id()];
+    if (p->count) pcp_drain(z, p, p->count);
+    irq_restore_kernel(flags);
+}
+
+u32 buddy_cached_pages(buddy_zone_t* z) {
+    u32 n = 0;
+    for (u32 i = 0; i < SMP_MAX_CPUS; i++) n += z->pcp[i].count;
+    return n;
+}
+
+u8 buddy_order_for(u32 count) {
+    u8 order = 0;
+    while ((1u << order) < count) order++;
+    return order;
+}
+
+u32 buddy_alloc_pages(buddy_zone_t* z, u32 count) {
+    if (!count) return 0;
+    u8 order = buddy_order_for(count);
+    u32 addr = buddy_alloc(z, order);
+    if (!addr || count == (1u << order)) return addr;
+
+    // keep count pages, the rest goes straight back in aligned chunks
+    u32 idx = (addr - z->base) >> BUDDY_PAGE_SHIFT;
+    u32 flags = spin_lock_irqsave_kernel(&z->lock);
+    free_run_locked(z, idx + count, (1u << order) - count);
+    spin_unlock_irqrestore_kernel(&z->lock, flags);
+    return addr;
+}
+
+void buddy_free_pages(buddy_zone_t* z, u32 addr, u32 count) {
+    u32 idx = (addr - z->base) >> BUDDY_PAGE_SHIFT;
+    if (addr < z->base || idx >= z->pages || count > z->pages - idx) return;
+
+    u32 flags = spin_lock_irqsave_kernel(&z->lock);
+    free_run_locked(z, idx, count);
+    spin_unlock_irqrestore_kernel(&z->lock, flags);
+}
+
+u32 buddy_move_range(buddy_zone_t* from, buddy_zone_t* to, u32 addr, u32 size) {
+    u32 end = addr + size;
+    if (end < addr) end = 0xFFFFFFFF;
+    if (addr < from->base) addr = from->base;
+    u32 first = (addr - from->base + BUDDY_PAGE_SIZE - 1) >> BUDDY_PAGE_SHIFT;
+    u32 last = end > from->base ? (end - from->base) >> BUDDY_PAGE_SHIFT : 0;
+    if (last > from->pages) last = from->pages;
+
+    u32 moved = 0;
+    u32 flags = spin_lock_irqsave_kernel(&from->lock);
+    for (u32 idx = first; idx < last; ) {
+        // the free block holding idx, if any: its head is idx rounded down
+        u8 order = 0;
+        u32 head = idx;
+        while (order < BUDDY_MAX_ORDER && from->meta[head] != (BUDDY_FREE | order)) {
+            order++;
+            head = idx & ~((1u << order) - 1);
+        }
+        if (order == BUDDY_MAX_ORDER) {
+            idx++;
+            continue;
+        }
+
+        // take the whole block, keep what lies outside the range
+        u32 tail = head + (1u << order);
+        list_del(from, head, order);
+        from->free_pages -= 1u << order;
+        u32 lo = head < first ? first : head;
+        u32 hi = tail > last ? last : tail;
+        if (head < lo) free_run_locked(from, head, lo - head);
+        if (hi < tail) free_run_locked(from, hi, tail - hi);
+        buddy_add_range(to, from->base + (lo << BUDDY_PAGE_SHIFT),
+                        (hi - lo) << BUDDY_PAGE_SHIFT);
+        moved += hi - lo;
+        idx = hi;
+    }
+    spin_unlock_irqrestore_kernel(&from->lock, flags);
+    return moved;
+}
+
+u32 buddy_largest_free(buddy_zone_t* z) {
+    u32 mask = z->free_mask;
+    return mask ? 1u << (31 - __builtin_clz(mask)) : 0;
+}
@@ -4,9 +4,11 @@
 
 #include "kernel/can.h"
 #include "kernel/types.h"
-#include "kernel/msg.h"
+#include "kernel/ring.h"
 #include "kernel/spinlock.h"
-#include "uart.h"
+#include "kernel/sched.h"
+#include "kernel/timer.h"
+#include "kernel/klog.h"
 
 #ifdef __arm__
 
@@ -35,8 +37,13 @@ typedef volatile struct {
 #define CAN1_FFA1R (*(volatile u32*)(CAN1_BASE + 0x214))
 #define CAN1_FA1R (*(volatile u32*)(CAN1_BASE + 0x21C))
 
-static msg_queue_t can_rx_q;
+#define CAN_RX_DEPTH 16
+
+// RX0 ISR -> reader task, frames written and read in place, no lock
+SPSC_RING_DEFINE(can_rx_q, can_frame_t, CAN_RX_DEPTH);
 static spinlock_t can_lock = {0};
+static volatile u32 can_rx_dropped;
+static wait_queue_t can_rx_wq;      // the reader, blocked on an empty ring
 
 void can_init(u32 baud) {
     // enable clocks
@@ -62,34 +69,69 @@ void can_init(u32 baud) {
     // enable RX0 IRQ
     NVIC_ISER1 |= (1<<21);
     
-    msg_init(&can_rx_q);
-    uart_puts("CAN ready 500k\r\n");
+    spsc_init(&can_rx_q);
+    wq_init(&can_rx_wq);
+    LOCK_STAT_NAME(&can_lock, "can_lock");
+    KLOG("CAN ready 500k\r\n");
 }
 
 can_err_t can_send(const can_frame_t* frame) {
     u32 mb = 0;
     
-    spin_lock(&can_lock);
+    u32 flags = spin_lock_irqsave_kernel(&can_lock);
     if (!(CAN1_TX[mb].TIR & (1<<0))) {   // TXE
         CAN1_TX[mb].TIR = (frame->id << 21) | (1<<1);  // STD ID
         CAN1_TX[mb].TDTR = frame->len;
         CAN1_TX[mb].TDLR = *(u32*)frame->data;
         CAN1_TX[mb].TDHR = *(u32*)(frame->data + 4);
         CAN1_TX[mb].TIR |= (1<<0);   // request
-        spin_unlock(&can_lock);
+        spin_unlock_irqrestore_kernel(&can_lock, flags);
         return CAN_OK;
     }
-    spin_unlock(&can_lock);
+    spin_unlock_irqrestore_kernel(&can_lock, flags);
     return CAN_ERR_TX;
 }
 
 can_err_t can_recv(can_frame_t* frame) {
-    msg_t msg;
-    if (msg_recv(&can_rx_q, &msg)) {
-        *frame = *(can_frame_t*)msg.data;
-        return CAN_OK;
+    return can_recv_timeout(frame, 0);
+}
+
+can_err_t can_recv_timeout(can_frame_t* frame, u32 timeout_ms) {
+    const can_frame_t* f = can_recv_borrow_timeout(timeout_ms);
+    if (!f) return CAN_ERR_RX;
+    *frame = *f;
+    can_recv_release(f);
+    return CAN_OK;
+}
+
+// single reader: the ring has one consumer
+const can_frame_t* can_recv_borrow(void) {
+    return spsc_peek(&can_rx_q);
+}
+
+const can_frame_t* can_recv_borrow_timeout(u32 timeout_ms) {
+    u32 deadline = timer_ticks() + timeout_ms;
+    for (;;) {
+        u32 snap = wq_prepare(&can_rx_wq);
+        const can_frame_t* f = spsc_peek(&can_rx_q);
+        if (f) return f;
+        u32 left = timeout_ms;
+        if (timeout_ms != WAIT_FOREVER) {
+            s32 d = (s32)(deadline - timer_ticks());
+            if (d <= 0) return 0;
+            left = (u32)d;
+        }
+        wq_wait(&can_rx_wq, snap, left);
     }
-    return CAN_ERR_RX;
+}
+
+void can_recv_release(const can_frame_t* frame) {
+    (void)frame;    // always the oldest one
+    spsc_consume(&can_rx_q);
+}
+
+u32 can_rx_drop_count(void) {
+    return can_rx_dropped;
 }
 
 void can_set_filter(u32 id, u32 mask) {
@@ -104,15 +146,17 @@ u8 can_tx_mailbox_free(void) {
 // RX0 IRQ
 void CEC_CAN_IRQHandler(void) {
     if (*(volatile u32*)(CAN1_BASE + 0x08) & (1<<0)) {   // FMP0
-        can_frame_t frm;
-        frm.id  = (CAN1_RX0->RIR >> 21) & 0x7FF;
-        frm.len = CAN1_RX0->RDTR & 0x0F;
-        *(u32*)frm.data     = CAN1_RX0->RDLR;
-        *(u32*)(frm.data+4) = CAN1_RX0->RDHR;
-        
-        msg_t msg;
-        *(can_frame_t*)msg.data = frm;
-        msg_send(&can_rx_q, &msg);
+        can_frame_t* frm = spsc_reserve(&can_rx_q);
+        if (frm) {
+            frm->id  = (CAN1_RX0->RIR >> 21) & 0x7FF;
+            frm->len = CAN1_RX0->RDTR & 0x0F;
+            *(u32*)frm->data     = CAN1_RX0->RDLR;
+            *(u32*)(frm->data+4) = CAN1_RX0->RDHR;
+            spsc_commit(&can_rx_q);
+            wq_wake_one(&can_rx_wq);    // reader runs at the next switch
+        } else {
+            can_rx_dropped++;   // nobody draining: drop, the FIFO must move on
+        }
         
         // release FIFO
         *(volatile u32*)(CAN1_BASE + 0x08) |= (1<<5);
@@ -124,6 +168,13 @@ void CEC_CAN_IRQHandler(void) {
 void can_init(u32 baud) { (void)baud; }
 can_err_t can_send(const can_frame_t* frame) { (void)frame; return CAN_OK; }
 can_err_t can_recv(can_frame_t* frame) { (void)frame; return CAN_ERR_RX; }
+const can_frame_t* can_recv_borrow(void) { return 0; }
+can_err_t can_recv_timeout(can_frame_t* frame, u32 timeout_ms) {
+    (void)frame; (void)timeout_ms; return CAN_ERR_RX;
+}
+const can_frame_t* can_recv_borrow_timeout(u32 timeout_ms) { (void)timeout_ms; return 0; }
+void can_recv_release(const can_frame_t* frame) { (void)frame; }
+u32 can_rx_drop_count(void) { return 0; }
 void can_set_filter(u32 id, u32 mask) { (void)id; (void)mask; }
 u8 can_tx_mailbox_free(void) { return 1; }
 void can_irq_handler(void) {}
@@ -0,0 +1,219 @@
+/*
+ * clocksource.c - 64-bit monotonic clock (see clocksource.h)
+ *
+ * ns = ns_at_last + ((count - last) & mask) * mult >> shift, with the
+ * sub-ns remainder carried in frac so updates never lose time. shift
+ * is the largest that keeps CLOCK_MAX_DELTA_S of counts inside 64 bits.
+ */
+
+#include "kernel/clocksource.h"
+#include "kernel/seqlock.h"
+#include "kernel/timer.h"
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+#define HAVE_DWT 1
+#endif
+
+#define NSEC_PER_SEC 1000000000ULL
+#define CAL_DIV      100         // calibrate over 1/100 s
+
+enum { SRC_TICK, SRC_TSC, SRC_HPET, SRC_PMTMR, SRC_DWT, SRC_RP2040 };
+
+static const char* const src_names[] = {
+    "tick", "tsc", "hpet", "acpi_pm", "dwt", "rp2040_timer"
+};
+
+static struct {
+    seqlock_t seq;
+    u64 last;               // counter value at ns
+    u64 ns;
+    u64 frac;               // ns << shift not yet in ns
+    u64 mult;
+    u64 mask;               // counter width
+    u64 hz;
+    u8 shift;
+    u8 source;
+} clk;
+
+#ifdef __x86_64__
+extern u8 timing_sync_is_tsc_supported(void);
+extern u8 timing_sync_is_tsc_invariant(void);
+extern void timing_sync_set_tsc_frequency(u64 hz);
+extern u8 hpet_is_initialized(void);
+extern u64 hpet_get_counter(void);
+extern u64 hpet_get_frequency(void);
+extern u32 acpi_get_pm_timer(void);
+
+#define PMTMR_HZ   3579545
+#define PMTMR_MASK 0xFFFFFF     // 24 bits unless FADT says 32; 24 is safe
+
+static inline u64 rdtsc(void) {
+    u32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64)hi << 32) | lo;
+}
+#elif defined(HAVE_DWT)
+#define DWT_CTRL   (*(volatile u32*)0xE0001000)
+#define DWT_CYCCNT (*(volatile u32*)0xE0001004)
+#define DEMCR      (*(volatile u32*)0xE000EDFC)
+#define SYST_LOAD  (*(volatile u32*)0xE000E014)
+#elif defined(__RP2040__)
+#define TIMERAWH (*(volatile u32*)0x40054024)
+#define TIMERAWL (*(volatile u32*)0x40054028)
+#endif
+
+static inline u64 counter_read(void) {
+#ifdef __x86_64__
+    switch (clk.source) {
+    case SRC_TSC:   return rdtsc();
+    case SRC_HPET:  return hpet_get_counter();
+    case SRC_PMTMR: return acpi_get_pm_timer();
+    default:        return timer_ticks();
+    }
+#elif defined(HAVE_DWT)
+    return DWT_CYCCNT;
+#elif defined(__RP2040__)
+    // raw registers: the latched pair is not safe with two cores
+    u32 hi, lo;
+    do {
+        hi = TIMERAWH;
+        lo = TIMERAWL;
+    } while (hi != TIMERAWH);
+    return ((u64)hi << 32) | lo;
+#else
+    return timer_ticks();
+#endif
+}
+
+#ifdef __x86_64__
+static u64 ref_read(u8 ref) {
+    return ref == SRC_HPET ? hpet_get_counter() : acpi_get_pm_timer();
+}
+
+// TSC rate against ref, from one edge of ref to CAL_DIV-th of a second on
+static u64 tsc_calibrate(u8 ref, u64 ref_hz, u64 ref_mask) {
+    u64 r0 = ref_read(ref);
+    u64 r;
+    while ((r = ref_read(ref)) == r0) {
+    }
+    u64 t0 = rdtsc();
+
+    u64 d;
+    do {
+        d = (ref_read(ref) - r) & ref_mask;
+    } while (d < ref_hz / CAL_DIV);
+    u64 t1 = rdtsc();
+
+    return (t1 - t0) * ref_hz / d;
+}
+
+static void pick_source(void) {
+    u8 ref = SRC_TICK;
+    u64 ref_hz = 0, ref_mask = 0;
+    if (hpet_is_initialized() && hpet_get_frequency()) {
+        ref = SRC_HPET;
+        ref_hz = hpet_get_frequency();
+        ref_mask = 0xFFFFFFFF;  // 32-bit HPETs read back 32 bits
+    } else if (acpi_get_pm_timer() || acpi_get_pm_timer()) {
+        ref = SRC_PMTMR;
+        ref_hz = PMTMR_HZ;
+        ref_mask = PMTMR_MASK;
+    }
+
+    if (ref != SRC_TICK && timing_sync_is_tsc_supported() && timing_sync_is_tsc_invariant()) {
+        clk.hz = tsc_calibrate(ref, ref_hz, ref_mask);
+        clk.mask = ~0ULL;
+        clk.source = SRC_TSC;
+        // one TSC rate for tickless deadlines and cycle conversions too
+        timing_sync_set_tsc_frequency(clk.hz);
+    } else if (ref != SRC_TICK) {
+        clk.hz = ref_hz;
+        clk.mask = ref_mask;
+        clk.source = ref;
+    } else {
+        clk.hz = 1000;
+        clk.mask = 0xFFFFFFFF;
+        clk.source = SRC_TICK;
+    }
+}
+#elif defined(HAVE_DWT)
+static void pick_source(void) {
+    DEMCR |= (1 << 24);         // TRCENA
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= 1;              // CYCCNTENA
+    // SysTick runs off the core clock at 1 kHz
+    clk.hz = (u64)(SYST_LOAD + 1) * 1000;
+    clk.mask = 0xFFFFFFFF;
+    clk.source = SRC_DWT;
+}
+#elif defined(__RP2040__)
+static void pick_source(void) {
+    clk.hz = 1000000;
+    clk.mask = ~0ULL;
+    clk.source = SRC_RP2040;
+}
+#else
+static void pick_source(void) {
+    clk.hz = 1000;
+    clk.mask = 0xFFFFFFFF;
+    clk.source = SRC_TICK;
+}
+#endif
+
+void clocksource_init(void) {
+    seqlock_init(&clk.seq);
+    pick_source();
+
+    u64 max_delta = clk.hz * CLOCK_MAX_DELTA_S;
+    u8 shift = 32;
+    while (shift > 1 && (NSEC_PER_SEC << shift) / clk.hz > ~0ULL / max_delta) shift--;
+
+    u32 flags = write_seqlock(&clk.seq);
+    clk.shift = shift;
+    clk.mult = (NSEC_PER_SEC << shift) / clk.hz;
+    clk.ns = 0;
+    clk.frac = 0;
+    clk.last = counter_read();
+    write_sequnlock(&clk.seq, flags);
+}
+
+void clocksource_update(void) {
+    if (!clk.mult) return;
+
+    u32 flags = write_seqlock(&clk.seq);
+    u64 now = counter_read();
+    u64 acc = ((now - clk.last) & clk.mask) * clk.mult + clk.frac;
+    clk.ns += acc >> clk.shift;
+    clk.frac = acc & ((1ULL << clk.shift) - 1);
+    clk.last = now;
+    write_sequnlock(&clk.seq, flags);
+}
+
+u64 clock_now_ns(void) {
+    u64 last, ns, frac, mult, mask;
+    u8 shift;
+    u32 seq;
+
+    do {
+        seq = read_seqbegin(&clk.seq);
+        last = clk.last;
+        ns = clk.ns;
+        frac = clk.frac;
+        mult = clk.mult;
+        mask = clk.mask;
+        shift = clk.shift;
+    } while (read_seqretry(&clk.seq, seq));
+
+    u64 delta = (counter_read() - last) & mask;
+    // a 64-bit counter a hair behind the updating CPU's: not before last
+    if (mask == ~0ULL && (s64)delta < 0) delta = 0;
+    return ns + ((delta * mult + frac) >> shift);
+}
+
+const char* clocksource_name(void) {
+    return src_names[clk.source];
+}
+
+u64 clocksource_hz(void) {
+    return clk.hz;
+}
@@ -0,0 +1,230 @@
+/*
+ * fpu.c - lazy FPU/SIMD context per task
+ *
+ * Only tasks that touch FP/SIMD pay for it, and no task sees another's
+ * registers.
+ *
+ * x86: every switch sets CR0.TS. The first FP/SIMD instruction of a
+ * slice traps (#NM) and loads the task's saved state, or a clean init
+ * state the first time. A task whose state is still live in this CPU's
+ * registers gets only a clts. At switch-out, TS still clear means the
+ * task used FP this slice, so it is saved then (XSAVEC, else XSAVEOPT,
+ * else FXSAVE). A stolen task therefore always finds its state in
+ * memory. fpu_cpu records which CPU's registers are current.
+ *
+ * Cortex-M4F/M7: ASPEN/LSPEN give lazy stacking for exceptions. Tasks
+ * switch by function call, so only the callee-saved s16-s31 and FPSCR
+ * carry over. CONTROL.FPCA is cleared at switch-in and set by hardware
+ * on the first FP instruction, which makes it the "used FP this slice"
+ * bit. Until then a task runs on zeroed s16-s31 and the FPDSCR default
+ * FPSCR, reloaded only when another task's state was in the registers.
+ */
+
+#include "kernel/fpu.h"
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/smp.h"
+#include "uart.h"
+
+static volatile u32 fpu_traps;
+static volatile u32 fpu_saves;
+
+#ifdef __x86_64__
+extern void xsave_save_state(void* xsave_area, u64 feature_mask);
+extern void xsave_restore_state(const void* xsave_area, u64 feature_mask);
+extern void xsave_save_state_compact(void* xsave_area, u64 feature_mask);
+extern u8 xsave_is_supported(void);
+extern u8 xsave_is_xsavec_supported(void);
+extern u64 xsave_get_enabled_features(void);
+extern u32 xsave_get_area_size(void);
+
+#define FPU_AREA_SIZE 4096      // AVX-512 standard layout is ~2.7 KB
+#define CR0_MP  (1u << 1)
+#define CR0_EM  (1u << 2)
+#define CR0_TS  (1u << 3)
+#define CR0_NE  (1u << 5)
+#define CR4_OSFXSR     (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+#define CR4_OSXSAVE    (1u << 18)
+
+static u8 fpu_areas[MAX_TASKS][FPU_AREA_SIZE] __attribute__((aligned(64)));
+static u8 fpu_init_area[FPU_AREA_SIZE] __attribute__((aligned(64)));
+static struct task* fpu_owner[SMP_MAX_CPUS];
+static u8 use_xsave, use_xsavec;
+static u64 xmask;
+
+static inline u32 read_cr0(void) {
+    u32 v;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr0(u32 v) {
+    __asm__ volatile("mov %0, %%cr0" : : "r"(v) : "memory");
+}
+
+static void fpu_save(struct task* t) {
+    if (use_xsavec) xsave_save_state_compact(t->fpu_area, xmask);
+    else if (use_xsave) xsave_save_state(t->fpu_area, xmask);
+    else __asm__ volatile("fxsave (%0)" : : "r"(t->fpu_area) : "memory");
+    fpu_saves++;
+}
+
+static void fpu_restore(const void* area) {
+    if (use_xsave) xsave_restore_state(area, xmask);
+    else __asm__ volatile("fxrstor (%0)" : : "r"(area) : "memory");
+}
+
+void fpu_init(void) {
+    use_xsave = xsave_is_supported() && xsave_get_area_size() <= FPU_AREA_SIZE;
+    use_xsavec = use_xsave && xsave_is_xsavec_supported();
+    xmask = use_xsave ? xsave_get_enabled_features() : 0;
+    if (xsave_is_supported() && !use_xsave) {
+        uart_puts("FPU: xsave area too big, x87/SSE only\r\n");
+    }
+
+    // XSTATE_BV = 0: xrstor puts every component in its init state;
+    // the legacy fields cover fxrstor
+    for (u32 i = 0; i < FPU_AREA_SIZE; i++) fpu_init_area[i] = 0;
+    *(u16*)(fpu_init_area + 0) = 0x037F;    // FCW
+    *(u32*)(fpu_init_area + 24) = 0x1F80;   // MXCSR
+}
+
+// simd_init() did this on the boot CPU; APs need their own copy
+void fpu_cpu_init(void) {
+    u32 cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (use_xsave) cr4 |= CR4_OSXSAVE;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+    if (use_xsave) {
+        __asm__ volatile("xsetbv" : : "a"((u32)xmask), "d"((u32)(xmask >> 32)), "c"(0));
+    }
+
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+    fpu_owner[smp_cpu_id()] = 0;
+}
+
+void fpu_attach(struct task* t, u32 slot) {
+    t->fpu_area = fpu_areas[slot];
+    t->fpu_used = 0;
+    t->fpu_cpu = 0xFF;          // a reused slot must not inherit live registers
+}
+
+// prev is still running; called right before context_switch
+void fpu_switch(struct task* prev, struct task* next) {
+    (void)next;
+    u32 cr0 = read_cr0();
+    if (cr0 & CR0_TS) return;   // nobody touched FP this slice
+    if (fpu_owner[smp_cpu_id()] == prev) fpu_save(prev);
+    write_cr0(cr0 | CR0_TS);
+}
+
+// #NM: first FP/SIMD instruction since the last switch
+void fpu_trap(void) {
+    __asm__ volatile("clts");
+    fpu_traps++;
+
+    u32 cpu = smp_cpu_id();
+    struct task* cur = task_current();
+    if (!cur) return;
+    if (fpu_owner[cpu] == cur && cur->fpu_cpu == cpu) return;  // still live
+
+    // the old owner was saved when it was switched out
+    fpu_restore(cur->fpu_used ? cur->fpu_area : fpu_init_area);
+    cur->fpu_used = 1;
+    cur->fpu_cpu = cpu;
+    fpu_owner[cpu] = cur;
+}
+
+#elif defined(__arm__) && defined(__ARM_FP)
+#define CPACR (*(volatile u32*)0xE000ED88)
+#define FPCCR (*(volatile u32*)0xE000EF34)
+#define FPDSCR (*(volatile u32*)0xE000EF3C)     // default FPSCR (RMode, FZ, DN, AHP)
+#define FPCCR_ASPEN (1u << 31)
+#define FPCCR_LSPEN (1u << 30)
+#define CONTROL_FPCA (1u << 2)
+#define FPU_AREA_WORDS 17       // s16-s31, FPSCR
+
+static u32 fpu_areas[MAX_TASKS][FPU_AREA_WORDS];
+static u32 fpu_init_area[FPU_AREA_WORDS];       // zeroed s16-s31, default FPSCR
+static u8 fpu_clean[SMP_MAX_CPUS];              // registers hold fpu_init_area
+
+static inline u32 read_control(void) {
+    u32 v;
+    __asm__ volatile("mrs %0, control" : "=r"(v));
+    return v;
+}
+
+static inline void clear_fpca(void) {
+    __asm__ volatile("msr control, %0\n isb" : : "r"(read_control() & ~CONTROL_FPCA) : "memory");
+}
+
+void fpu_init(void) {
+    CPACR |= (0xF << 20);                   // CP10/CP11 full access
+    FPCCR |= FPCCR_ASPEN | FPCCR_LSPEN;
+    __asm__ volatile("dsb\n isb");
+    fpu_init_area[FPU_AREA_WORDS - 1] = FPDSCR;
+}
+
+void fpu_cpu_init(void) {
+    clear_fpca();
+}
+
+void fpu_attach(struct task* t, u32 slot) {
+    t->fpu_area = fpu_areas[slot];
+    t->fpu_used = 0;
+    t->fpu_cpu = 0;
+}
+
+// s16-s31 are callee-saved: loading next's copy here is only safe
+// because nothing between us and context_switch uses the FPU
+void fpu_switch(struct task* prev, struct task* next) {
+    if (read_control() & CONTROL_FPCA) {
+        u32* a = (u32*)prev->fpu_area;
+        __asm__ volatile("vstmia %0, {s16-s31}\n"
+                         "vmrs r1, fpscr\n"
+                         "str r1, [%0, #64]"
+                         : : "r"(a) : "r1", "memory");
+        prev->fpu_used = 1;
+        fpu_saves++;
+    }
+    // a task that hasn't used FP yet gets the init state, not prev's
+    u32 cpu = smp_cpu_id();
+    const u32* a = 0;
+    if (next->fpu_used) {
+        a = next->fpu_area;
+        fpu_clean[cpu] = 0;
+    } else if (!fpu_clean[cpu] || prev->fpu_used) {
+        a = fpu_init_area;
+        fpu_clean[cpu] = 1;
+    }
+    if (a) {
+        __asm__ volatile("vldmia %0, {s16-s31}\n"
+                         "ldr r1, [%0, #64]\n"
+                         "vmsr fpscr, r1"
+                         : : "r"(a) : "r1", "memory");
+    }
+    clear_fpca();               // re-armed by next's first FP instruction
+}
+
+void fpu_trap(void) {
+    fpu_traps++;
+}
+
+#else
+// no FPU: nothing to save
+void fpu_init(void) { }
+void fpu_cpu_init(void) { }
+void fpu_attach(struct task* t, u32 slot) { (void)slot; t->fpu_area = 0; t->fpu_used = 0; }
+void fpu_switch(struct task* prev, struct task* next) { (void)prev; (void)next; }
+void fpu_trap(void) { fpu_traps++; }
+#endif
+
+u32 fpu_trap_count(void) {
+    return fpu_traps;
+}
+
+u32 fpu_save_count(void) {
+    return fpu_saves;
+}
@@ -0,0 +1,246 @@
+/*
+ * hrtimer.c - per-CPU min-heaps of one-shot timers (see hrtimer.h)
+ *
+ * Only heap[0] is programmed, and only when it changes, so queueing a
+ * later timer costs O(log n) with no hardware access. A CPU never
+ * programs another CPU's compare unit: a cancel from elsewhere leaves
+ * the old expiry armed, and that IRQ finds nothing due and re-arms.
+ */
+
+#include "kernel/hrtimer.h"
+#include "kernel/clocksource.h"
+#include "kernel/spinlock.h"
+#include "kernel/smp.h"
+
+typedef struct {
+    spinlock_t lock;
+    hrtimer_t* heap[HRTIMER_MAX];
+    u32 n;
+    u64 armed;                  // what the hardware holds, 0 for nothing
+} __attribute__((aligned(64))) hrtimer_base_t;
+
+static hrtimer_base_t bases[SMP_MAX_CPUS];
+static u8 hw_kind = HRTIMER_HW_NONE;
+
+static inline void heap_set(hrtimer_base_t* b, u32 i, hrtimer_t* t) {
+    b->heap[i] = t;
+    t->index = i;
+}
+
+static void sift_up(hrtimer_base_t* b, u32 i) {
+    hrtimer_t* t = b->heap[i];
+    while (i) {
+        u32 parent = (i - 1) / 2;
+        if (b->heap[parent]->expires <= t->expires) break;
+        heap_set(b, i, b->heap[parent]);
+        i = parent;
+    }
+    heap_set(b, i, t);
+}
+
+static void sift_down(hrtimer_base_t* b, u32 i) {
+    hrtimer_t* t = b->heap[i];
+    for (;;) {
+        u32 child = 2 * i + 1;
+        if (child >= b->n) break;
+        if (child + 1 < b->n && b->heap[child + 1]->expires < b->heap[child]->expires) child++;
+        if (t->expires <= b->heap[child]->expires) break;
+        heap_set(b, i, b->heap[child]);
+        i = child;
+    }
+    heap_set(b, i, t);
+}
+
+// caller holds the lock
+static void heap_del(hrtimer_base_t* b, hrtimer_t* t) {
+    u32 i = t->index;
+    t->index = HRTIMER_IDLE;
+    if (--b->n == i) return;
+    hrtimer_t* last = b->heap[b->n];
+    heap_set(b, i, last);
+    sift_up(b, i);
+    if (last->index == i) sift_down(b, i);
+}
+
+static inline hrtimer_base_t* local_base(void) {
+    return &bases[hw_kind == HRTIMER_HW_PERCPU ? smp_cpu_id() : 0];
+}
+
+// caller holds the lock; b must be this CPU's base, or the global one
+static void program(hrtimer_base_t* b) {
+    if (hw_kind == HRTIMER_HW_NONE) return;
+
+    u64 next = b->n ? b->heap[0]->expires : 0;
+    if (next == b->armed) return;
+    b->armed = next;
+    if (next) {
+        u64 limit = clock_now_ns() + HRTIMER_MAX_ARM;
+        if (next > limit) next = limit;     // armed != expires: re-arms then
+    }
+    hrtimer_arch_program(next);
+}
+
+static inline u8 may_program(hrtimer_base_t* b) {
+    return hw_kind == HRTIMER_HW_GLOBAL || b == local_base();
+}
+
+void hrtimer_setup(void) {
+    for (u32 i = 0; i < SMP_MAX_CPUS; i++) {
+        bases[i].lock.lock = 0;
+        bases[i].n = 0;
+        bases[i].armed = 0;
+        LOCK_STAT_NAME(&bases[i].lock, "hrtimer");
+    }
+    hw_kind = hrtimer_arch_setup();
+}
+
+void hrtimer_init(hrtimer_t* t, hrtimer_fn_t fn, void* arg) {
+    t->expires = 0;
+    t->fn = fn;
+    t->arg = arg;
+    t->index = HRTIMER_IDLE;
+    t->cpu = 0;
+}
+
+u8 hrtimer_start(hrtimer_t* t, u64 expires_ns) {
+    hrtimer_base_t* b = local_base();
+    if (t->index != HRTIMER_IDLE && &bases[t->cpu] != b) hrtimer_cancel(t);
+
+    u32 flags = spin_lock_irqsave_kernel(&b->lock);
+    if (t->index != HRTIMER_IDLE) {
+        heap_del(b, t);
+    } else if (b->n == HRTIMER_MAX) {
+        spin_unlock_irqrestore_kernel(&b->lock, flags);
+        return 0;
+    }
+    t->expires = expires_ns;
+    t->cpu = (u8)(b - bases);
+    heap_set(b, b->n++, t);
+    sift_up(b, t->index);
+    program(b);
+    spin_unlock_irqrestore_kernel(&b->lock, flags);
+    return 1;
+}
+
+u8 hrtimer_start_in(hrtimer_t* t, u64 delay_ns) {
+    return hrtimer_start(t, clock_now_ns() + delay_ns);
+}
+
+u8 hrtimer_cancel(hrtimer_t* t) {
+    hrtimer_base_t* b = &bases[t->cpu];
+    u32 flags = spin_lock_irqsave_kernel(&b->lock);
+    u8 queued = t->index != HRTIMER_IDLE;
+    if (queued) {
+        heap_del(b, t);
+        if (may_program(b)) program(b);
+    }
+    spin_unlock_irqrestore_kernel(&b->lock, flags);
+    return queued;
+}
+
+u8 hrtimer_active(const hrtimer_t* t) {
+    return t->index != HRTIMER_IDLE;
+}
+
+void hrtimer_interrupt(void) {
+    hrtimer_base_t* b = local_base();
+    u32 flags = spin_lock_irqsave_kernel(&b->lock);
+    b->armed = 0;               // whatever was armed has fired
+    while (b->n && b->heap[0]->expires <= clock_now_ns()) {
+        hrtimer_t* t = b->heap[0];
+        heap_del(b, t);
+        spin_unlock_irqrestore_kernel(&b->lock, flags);
+        t->fn(t);
+        flags = spin_lock_irqsave_kernel(&b->lock);
+    }
+    program(b);
+    spin_unlock_irqrestore_kernel(&b->lock, flags);
+}
+
+void hrtimer_tick(void) {
+    hrtimer_base_t* b = local_base();
+    // unlocked peek; a stale answer only delays to the next tick or IRQ
+    if (!b->n || b->heap[0]->expires > clock_now_ns()) return;
+    hrtimer_interrupt();
+}
+
+u8 hrtimer_hw(void) {
+    return hw_kind;
+}
+
+#ifdef __x86_64__
+/* LAPIC TSC-deadline on every CPU when there is one, else HPET
+   timer 1 through the I/O APIC to CPU 0. Both land on IRQ 19. */
+extern u8 apic_is_enabled(void);
+extern void apic_timer_tsc_deadline(u8 vector);
+extern u8 timing_sync_is_tsc_deadline_supported(void);
+extern u64 timing_sync_get_tsc(void);
+extern u64 timing_sync_get_tsc_frequency(void);
+extern void timing_sync_set_tsc_deadline(u64 deadline);
+extern u8 hpet_is_initialized(void);
+extern u64 hpet_get_counter(void);
+extern u64 hpet_get_frequency(void);
+extern u8 hpet_set_comparator(u8 timer_num, u64 counter, u8 gsi);
+extern void hpet_disable_timer(u8 timer_num);
+extern u32 hpet_get_route_cap(u8 timer_num);
+extern void ioapic_set_irq(u32 gsi, u8 vector, u8 dest_apic_id, u8 trigger_mode, u8 polarity);
+
+#define HRTIMER_VECTOR   51
+#define HPET_HR_TIMER    1      // 0 is the legacy-replacement tick
+#define HPET_MIN_NS      2000   // never aim closer than this: equality match
+
+static u8 hpet_gsi;
+
+static inline u64 ns_to(u64 ns, u64 hz) {
+    return ns * hz / 1000000000ULL;     // ns <= HRTIMER_MAX_ARM: no overflow
+}
+
+u8 hrtimer_arch_setup(void) {
+    if (apic_is_enabled() && timing_sync_is_tsc_deadline_supported() &&
+        timing_sync_get_tsc_frequency()) {
+        return HRTIMER_HW_PERCPU;
+    }
+
+    // PCI-range inputs first, they are never shared with ISA devices
+    u32 cap = hpet_is_initialized() ? hpet_get_route_cap(HPET_HR_TIMER) : 0;
+    if (!cap) return HRTIMER_HW_NONE;
+    hpet_gsi = (u8)__builtin_ctz((cap & 0xFFFF0000) ? (cap & 0xFFFF0000) : cap);
+    ioapic_set_irq(hpet_gsi, HRTIMER_VECTOR, 0, 0, 0);
+    return HRTIMER_HW_GLOBAL;
+}
+
+void hrtimer_arch_program(u64 ns) {
+    u64 now = clock_now_ns();
+    u64 delta = ns > now ? ns - now : 0;
+
+    if (hw_kind == HRTIMER_HW_PERCPU) {
+        if (!ns) {
+            timing_sync_set_tsc_deadline(0);
+            return;
+        }
+        // a deadline already behind the TSC fires at once
+        apic_timer_tsc_deadline(HRTIMER_VECTOR);
+        timing_sync_set_tsc_deadline(timing_sync_get_tsc() +
+                                     ns_to(delta, timing_sync_get_tsc_frequency()) + 1);
+    } else {
+        if (!ns) {
+            hpet_disable_timer(HPET_HR_TIMER);
+            return;
+        }
+        if (delta < HPET_MIN_NS) delta = HPET_MIN_NS;
+        u64 hz = hpet_get_frequency();
+        while (!hpet_set_comparator(HPET_HR_TIMER, hpet_get_counter() + ns_to(delta, hz), hpet_gsi)) {
+            delta *= 2;
+        }
+    }
+}
+
+#else
+__attribute__((weak)) u8 hrtimer_arch_setup(void) {
+    return HRTIMER_HW_NONE;
+}
+
+__attribute__((weak)) void hrtimer_arch_program(u64 ns) {
+    (void)ns;
+}
+#endif
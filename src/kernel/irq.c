@@ -0,0 +1,39 @@
+/*
+ * irq.c - NVIC priorities for the kernel/control IRQ split (see irq.h)
+ */
+
+#include "kernel/irq.h"
+
+#ifdef IRQ_HAVE_BASEPRI
+
+#define NVIC_ICTR (*(volatile u32*)0xE000E004)
+#define NVIC_IPR  ((volatile u32*)0xE000E400)
+#define SCB_SHPR  ((volatile u32*)0xE000ED18)  // exceptions 4..15
+
+static void set_prio_byte(volatile u32* base, u32 idx, u8 prio) {
+    volatile u32* w = base + idx / 4;
+    u32 shift = (idx % 4) * 8;
+    *w = (*w & ~(0xFFu << shift)) | ((u32)prio << shift);
+}
+
+// CMSIS numbering: SysTick is -1, PendSV -2, SVCall -5
+void irq_set_prio(s32 irqn, u8 prio) {
+    if (irqn >= 0) set_prio_byte(NVIC_IPR, (u32)irqn, prio);
+    else set_prio_byte(SCB_SHPR, (u32)(16 + irqn - 4), prio);
+}
+
+// out of reset everything sits at 0, above any BASEPRI mask; move every
+// IRQ down to kernel priority so only explicitly raised ones escape it
+void irq_prio_init(void) {
+    u32 n = ((NVIC_ICTR & 0xF) + 1) * 32;
+    for (u32 i = 0; i < n; i++) set_prio_byte(NVIC_IPR, i, IRQ_KERNEL_PRIO);
+    irq_set_prio(-1, IRQ_KERNEL_PRIO);      // SysTick
+    irq_set_prio(-2, 0xFF);                 // PendSV: last of all
+}
+
+#else
+
+void irq_set_prio(s32 irqn, u8 prio) { (void)irqn; (void)prio; }
+void irq_prio_init(void) {}
+
+#endif
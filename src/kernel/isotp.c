@@ -6,6 +6,7 @@
 #include "kernel/can.h"
 #include "kernel/timer.h"
 #include "kernel/types.h"
+#include "string.h"
 
 typedef struct {
     u8 buf[ISOTP_MAX_PAYLOAD];
@@ -47,17 +48,26 @@ u8 isotp_send(const isotp_msg_t* msg) {
 }
 
 u8 isotp_recv(isotp_msg_t* msg) {
-    can_frame_t f;
-    if (can_recv(&f) != 0) return 1;
+    return isotp_recv_timeout(msg, 0);
+}
+
+// parses the frame where the CAN ISR left it: one copy, into msg.
+// Sleeps until the CAN ISR wakes us rather than polling.
+u8 isotp_recv_timeout(isotp_msg_t* msg, u32 timeout_ms) {
+    const can_frame_t* f = can_recv_borrow_timeout(timeout_ms);
+    if (!f) return 1;
     
-    u8 type = f.data[0] >> 4;
+    u8 ret = 1;
+    u8 type = f->data[0] >> 4;
     if (type == 0) {   // SF
-        u8 len = f.data[0] & 0x0F;
-        if (len > 7) return 1;
-        memcpy(msg->data, &f.data[1], len);
-        msg->len = len;
-        msg->id  = f.id;
-        return 0;
+        u8 len = f->data[0] & 0x0F;
+        if (len <= 7) {
+            memcpy(msg->data, &f->data[1], len);
+            msg->len = len;
+            msg->id  = f->id;
+            ret = 0;
+        }
     }
-    return 1;
+    can_recv_release(f);
+    return ret;
 }
@@ -0,0 +1,93 @@
+/*
+ * klog.c - deferred binary logging (see klog.h)
+ */
+
+#include "kernel/klog.h"
+#include "kernel/ring.h"
+#include "kernel/smp.h"
+#include "kernel/sched.h"
+#include "kernel/clocksource.h"
+#include "kernel/kprintf.h"
+#include "kernel/uart.h"
+
+static klog_rec_t klog_buf[SMP_MAX_CPUS][KLOG_RING];
+static volatile u32 klog_seq[SMP_MAX_CPUS][KLOG_RING];
+static mpsc_ring_t rings[SMP_MAX_CPUS];
+static volatile u32 dropped[SMP_MAX_CPUS];
+static u8 klog_ready;
+
+void klog_init(void) {
+    for (u32 c = 0; c < SMP_MAX_CPUS; c++) {
+        rings[c].buf = (u8*)klog_buf[c];
+        rings[c].seq = klog_seq[c];
+        rings[c].mask = KLOG_RING - 1;
+        rings[c].elem_size = sizeof(klog_rec_t);
+        mpsc_init(&rings[c]);
+        dropped[c] = 0;
+    }
+    klog_ready = 1;
+}
+
+void klog_write(const char* fmt, u32 nargs, u32 a0, u32 a1, u32 a2, u32 a3) {
+    if (!klog_ready) return;
+
+    u32 cpu = smp_cpu_id();
+    klog_rec_t* r = mpsc_reserve(&rings[cpu]);
+    if (!r) {
+        __atomic_fetch_add(&dropped[cpu], 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    u32 lost = dropped[cpu] ? __atomic_exchange_n(&dropped[cpu], 0, __ATOMIC_RELAXED) : 0;
+    r->fmt = (u32)(unsigned long)fmt;
+    r->nargs = (u8)nargs;
+    r->cpu = (u8)cpu;
+    r->lost = lost > 0xFFFF ? 0xFFFF : (u16)lost;
+    r->ts = clock_now_ns();
+    r->args[0] = a0;
+    r->args[1] = a1;
+    r->args[2] = a2;
+    r->args[3] = a3;
+    mpsc_commit(&rings[cpu], r);
+}
+
+static void emit(const klog_rec_t* r) {
+#if KLOG_RAW
+    u32 sync = KLOG_SYNC;
+    const u8* p = (const u8*)&sync;
+    for (u32 i = 0; i < sizeof(sync); i++) uart_putc((char)p[i]);
+    p = (const u8*)r;
+    for (u32 i = 0; i < sizeof(*r); i++) uart_putc((char)p[i]);
+#else
+    if (r->lost) kprintf("[klog: %d lost]\r\n", r->lost);
+    kprintf("[%d us] ", (u32)(r->ts / 1000));
+    kprintf_args((const char*)(unsigned long)r->fmt, r->args, r->nargs);
+#endif
+}
+
+// oldest head first, so records from different CPUs interleave in order
+u32 klog_drain(void) {
+    u32 n = 0;
+    for (;;) {
+        const klog_rec_t* next = 0;
+        u32 from = 0;
+        for (u32 c = 0; c < SMP_MAX_CPUS; c++) {
+            const klog_rec_t* r = mpsc_peek(&rings[c]);
+            if (r && (!next || r->ts < next->ts)) {
+                next = r;
+                from = c;
+            }
+        }
+        if (!next) return n;
+        emit(next);
+        mpsc_consume(&rings[from]);
+        n++;
+    }
+}
+
+void klog_task(void) {
+    while (1) {
+        klog_drain();
+        task_sleep(KLOG_DRAIN_MS);
+    }
+}
@@ -57,3 +57,29 @@ void kprintf(const char* fmt, ...) {
     
     va_end(ap);
 }
+
+// same formats, arguments from an array (klog records)
+void kprintf_args(const char* fmt, const u32* args, u32 nargs) {
+    u32 n = 0;
+    
+    while (*fmt) {
+        if (*fmt == '%') {
+            fmt++;
+            u32 v = n < nargs ? args[n] : 0;
+            switch (*fmt++) {
+                case 'x': print_hex(v); n++; break;
+                case 'd': print_dec(v); n++; break;
+                case 's': {
+                    const char* s = (const char*)(unsigned long)v;
+                    while (s && *s) uart_putc(*s++);
+                    n++;
+                    break;
+                }
+                case 'c': uart_putc((char)v); n++; break;
+                default: uart_putc('%'); fmt--; break;
+            }
+        } else {
+            uart_putc(*fmt++);
+        }
+    }
+}
@@ -1,37 +1,143 @@
 /*
- * log.c - append-only ELM log on SD
+ * log.c - append-only ELM log on SD (see log.h)
+ *
+ * log_head is (buffer sequence << LOG_SEQ_SHIFT) | next slot in it.
+ * A producer claims a slot with one CAS, fills it, then bumps the
+ * buffer's fill count; the buffer belongs to the writer once that count
+ * reaches its length (LOG_SLOTS, or less when log_flush() sealed it).
+ * log_tail counts buffers done, and nobody claims a slot in a buffer
+ * LOG_BUFS or more ahead of it. Entries never straddle a block.
  */
 
 #include "kernel/log.h"
 #include "kernel/sd.h"
 #include "kernel/timer.h"
 #include "kernel/types.h"
+#include "kernel/atomic.h"
+#include "kernel/sched.h"
+#include "kernel/klog.h"
+#include "string.h"
 
-static u32 log_block = 1;   // skip MBR
-static u8  log_buf[SD_BLOCK_SIZE];
-static u32 log_idx = 0;
+#define LOG_PER_BLOCK ((u32)(SD_BLOCK_SIZE / sizeof(log_entry_t)))
+#define LOG_SLOTS     (LOG_BUF_BLOCKS * LOG_PER_BLOCK)     // < 1 << LOG_SEQ_SHIFT
+#define LOG_SEQ_SHIFT 10
+#define LOG_SLOT_MASK ((1u << LOG_SEQ_SHIFT) - 1)
+#define LOG_SEQ_MASK  (0xFFFFFFFFu >> LOG_SEQ_SHIFT)
+
+static u32 log_block = 1;   // skip MBR; writer only
+static u8  log_bufs[LOG_BUFS][LOG_BUF_BLOCKS * SD_BLOCK_SIZE] __attribute__((aligned(4)));
+static volatile u32 log_fill[LOG_BUFS];     // entries written
+static volatile u32 log_len[LOG_BUFS];      // entries it will get
+static volatile u32 log_head;
+static volatile u32 log_tail;
+static volatile u32 log_drops;
+static wait_queue_t log_wq;         // the writer, for a full buffer
+static wait_queue_t log_done_wq;    // log_flush(), for the writer
+static u8 log_ready;
+
+static log_entry_t* log_slot(u32 b, u32 k) {
+    return (log_entry_t*)(log_bufs[b] + k / LOG_PER_BLOCK * SD_BLOCK_SIZE
+                          + k % LOG_PER_BLOCK * sizeof(log_entry_t));
+}
 
 void log_init(void) {
     sd_init();
-    log_flush();   // write empty block
+    for (u32 b = 0; b < LOG_BUFS; b++) log_len[b] = LOG_SLOTS;
+    wq_init(&log_wq);
+    wq_init(&log_done_wq);
+    log_ready = 1;
 }
 
 void log_can(const can_frame_t* f) {
-    log_entry_t* e = (log_entry_t*)(log_buf + log_idx);
+    if (!log_ready) return;
+
+    u32 head = atomic_load_rlx(&log_head), next;
+    do {
+        u32 seq = head >> LOG_SEQ_SHIFT;
+        if (((seq - atomic_load_acq(&log_tail)) & LOG_SEQ_MASK) >= LOG_BUFS) {
+            __atomic_fetch_add(&log_drops, 1, __ATOMIC_RELAXED);   // card is behind
+            return;
+        }
+        next = (head & LOG_SLOT_MASK) == LOG_SLOTS - 1 ? (seq + 1) << LOG_SEQ_SHIFT : head + 1;
+    } while (!atomic_cas_u32(&log_head, &head, next));
+
+    u32 b = (head >> LOG_SEQ_SHIFT) & (LOG_BUFS - 1);
+    log_entry_t* e = log_slot(b, head & LOG_SLOT_MASK);
     e->magic    = LOG_MAGIC;
     e->timestamp = timer_ticks();
     e->id       = f->id;
     memcpy(e->data, f->data, 8);
-    
-    log_idx += sizeof(log_entry_t);
-    if (log_idx + sizeof(log_entry_t) > SD_BLOCK_SIZE) {
-        log_flush();
+
+    if (__atomic_add_fetch(&log_fill[b], 1, __ATOMIC_RELEASE) == atomic_load_acq(&log_len[b])) {
+        wq_wake_one(&log_wq);
+    }
+}
+
+// close the partly filled buffer; returns the sequence the writer must reach
+static u32 log_seal(void) {
+    u32 head = atomic_load_rlx(&log_head);
+    for (;;) {
+        u32 seq = head >> LOG_SEQ_SHIFT;
+        u32 k = head & LOG_SLOT_MASK;
+        if (!k) return seq;
+        if (atomic_cas_u32(&log_head, &head, (seq + 1) << LOG_SEQ_SHIFT)) {
+            atomic_store_rel(&log_len[seq & (LOG_BUFS - 1)], k);
+            wq_wake_one(&log_wq);
+            return seq + 1;
+        }
     }
 }
 
 void log_flush(void) {
-    if (log_idx) {
-        sd_write(log_block++, log_buf);
-        log_idx = 0;
+    if (!log_ready) return;
+
+    u32 until = log_seal();
+    for (;;) {
+        u32 snap = wq_prepare(&log_done_wq);
+        u32 ahead = (until - atomic_load_acq(&log_tail)) & LOG_SEQ_MASK;
+        if (!ahead || ahead > LOG_BUFS) return;     // the writer is there, or past it
+        wq_wait(&log_done_wq, snap, WAIT_FOREVER);
+    }
+}
+
+u32 log_dropped(void) {
+    return log_drops;
+}
+
+static void log_write_buf(u32 b, u32 len) {
+    u32 blocks = (len + LOG_PER_BLOCK - 1) / LOG_PER_BLOCK;
+    // sealed: blank what the last lap left in the rest of the last block
+    for (u32 k = len; k < blocks * LOG_PER_BLOCK; k++) {
+        memset(log_slot(b, k), 0, sizeof(log_entry_t));
+    }
+    if (sd_write_multi(log_block, log_bufs[b], blocks) == 0) {
+        log_block += blocks;
+    } else {
+        __atomic_fetch_add(&log_drops, len, __ATOMIC_RELAXED);
+    }
+}
+
+void log_writer_task(void) {
+    u32 reported = 0;
+    for (;;) {
+        u32 snap = wq_prepare(&log_wq);
+        u32 b = log_tail & (LOG_BUFS - 1);
+        u32 len = atomic_load_acq(&log_len[b]);
+        if (atomic_load_acq(&log_fill[b]) != len) {
+            wq_wait(&log_wq, snap, WAIT_FOREVER);
+            continue;
+        }
+
+        log_write_buf(b, len);
+        log_fill[b] = 0;
+        log_len[b] = LOG_SLOTS;
+        atomic_store_rel(&log_tail, log_tail + 1);     // producers may have it back
+        wq_wake_all(&log_done_wq);
+
+        u32 drops = log_drops;
+        if (drops != reported) {
+            KLOG("log: %d frames dropped\r\n", drops - reported);
+            reported = drops;
+        }
     }
 }
@@ -6,11 +6,15 @@
 
 #include "kernel/types.h"
 #include "kernel/sched.h"
+#include "kernel/smp.h"
 #include "kernel/timer.h"
+#include "kernel/clocksource.h"
+#include "kernel/hrtimer.h"
 #include "kernel/uart.h"
 #include "kernel/flash.h"
 #include "kernel/ipc.h"
 #include "kernel/log.h"
+#include "kernel/klog.h"
 
 static const char banner[] =
     "BLOOD_KERNEL v1.20 universal main\r\n"
@@ -33,6 +37,7 @@ __attribute__((weak)) void uart_early_init(void) { /* nop */ }
 __attribute__((weak)) void clock_init(void) { /* nop */ }
 __attribute__((weak)) void gpio_init(void)  { /* nop */ }
 __attribute__((weak)) void ipc_init(void)   { /* nop */ }
+__attribute__((weak)) void timer_idle(void) { __asm__ volatile("nop"); }
 
 /* ----------------------------------------------------------
    3. Build-time stamp
@@ -45,8 +50,10 @@ static const char *build_time(void) { return __TIME__; }
    ---------------------------------------------------------- */
 static void idle_task(void) {
     while (1) {
-        /* arch-specific idle hook */
-        __asm__ volatile("nop");
+        /* lowest priority: anything woken by the tick runs first */
+        task_yield();
+        /* nothing local: take work from a busy CPU before halting */
+        if (!sched_balance()) timer_idle();
     }
 }
 
@@ -55,8 +62,8 @@ static void blink_task(void) {
     while (1) {
         /* arch-specific LED toggle */
         gpio_toggle(0);
-        timer_delay(500);
-        kprintf("blink %u\r\n", cnt++);
+        task_sleep(500);
+        KLOG("blink %d\r\n", cnt++);
     }
 }
 
@@ -68,7 +75,7 @@ static void log_task(void) {
             uart_puts((char *)buf);
             uart_puts("\r\n");
         }
-        timer_delay(100);
+        task_sleep(100);
     }
 }
 
@@ -119,6 +126,9 @@ static void loader_boot(void) {
 void kernel_main(void) {
     uart_early_init();
     clock_init();
+    clocksource_init();
+    hrtimer_setup();
+    klog_init();
     gpio_init();
     ipc_init();
     log_init();
@@ -131,8 +141,20 @@ void kernel_main(void) {
     loader_boot();
 
     sched_init();
-    task_create(idle_task, 0, 256);
+    /* idle runs schedule(), sched_balance() and timer_idle() -> hrtimer,
+       and takes IRQ frames on x86: a whole x86 stack slot */
+    for (u32 cpu = 0; cpu < smp_num_cpus(); cpu++) {
+        task_create_affinity(idle_task, 0, 1024, SCHED_PRIO_IDLE, 1u << cpu);
+    }
+#ifdef BLOOD_BENCH
+    /* make bench: the suite owns the serial port and CPU 0 */
+    extern void bench_task(void);
+    task_create_affinity(bench_task, 0, 512, SCHED_PRIO_DEFAULT, 1u);
+#else
     task_create(blink_task, 0, 256);
     task_create(log_task, 0, 512);
+    task_create(log_writer_task, 0, 512);
+    task_create_prio(klog_task, 0, 512, SCHED_PRIO_IDLE - 1);
+#endif
     sched_start();
 }
@@ -1,5 +1,7 @@
 /*
  * mem.c - parse multiboot memory map, read ARM SCB
+ * The x86 map is kept for paging_init(), which seeds the page
+ * allocator from it.
  */
 
 #include "kernel/mem.h"
@@ -15,6 +17,9 @@ struct multiboot_mmap {
     u32 type;
 } PACKED;
 
+static mem_region_t regions[MEM_MAX_REGIONS];
+static u32 nregions;
+
 void detect_memory_x86(u32 mbi_addr) {
     if (!mbi_addr) {
         uart_puts("no multiboot info\r\n");
@@ -39,11 +44,25 @@ void detect_memory_x86(u32 mbi_addr) {
             uart_puts("  ");
             uart_hex((u32)mmap->length);
             uart_puts(" bytes\r\n");
+
+            // 32-bit paging: drop what lies above 4 GB, clip what crosses it
+            u64 end = mmap->base_addr + mmap->length;
+            if (end > 0x100000000ULL) end = 0x100000000ULL;
+            if (mmap->base_addr < end && nregions < MEM_MAX_REGIONS) {
+                regions[nregions].base = (u32)mmap->base_addr;
+                regions[nregions].size = (u32)(end - mmap->base_addr);
+                nregions++;
+            }
         }
         mmap = (struct multiboot_mmap*)((u32)mmap + mmap->size + 4);
     }
 }
 
+u32 mem_regions(const mem_region_t** out) {
+    *out = regions;
+    return nregions;
+}
+
 #elif defined(__arm__)       // ARM Cortex-M4
 
 #define SCB_BASE 0xE000E000
@@ -60,4 +79,9 @@ void detect_memory_arm(void) {
     // TODO: read MPU for actual RAM size
 }
 
+u32 mem_regions(const mem_region_t** out) {
+    *out = 0;
+    return 0;
+}
+
 #endif
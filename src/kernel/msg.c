@@ -1,43 +1,39 @@
 /*
- * msg.c - lock-free ring buffer for small messages
+ * msg.c - lock-free queues for small messages (on mpsc_ring_t)
  */
 
 #include "kernel/msg.h"
-#include "kernel/spinlock.h"
+#include "kernel/timer.h"
+
+RING_CHECK_SIZE(MSG_DEPTH);
 
 void msg_init(msg_queue_t* q) {
-    q->head = q->tail = q->count = 0;
-    q->lock = (spinlock_t){0};
+    q->ring = (mpsc_ring_t){ (u8*)q->buf, q->seq, MSG_DEPTH - 1, sizeof(msg_t), 0, 0 };
+    mpsc_init(&q->ring);
+    wq_init(&q->rx_wq);
 }
 
 u8 msg_send(msg_queue_t* q, const msg_t* msg) {
-    spin_lock(&q->lock);
-    
-    if (q->count >= MSG_DEPTH) {
-        spin_unlock(&q->lock);
-        return 0;   // full
-    }
-    
-    q->buf[q->head] = *msg;
-    q->head = (q->head + 1) % MSG_DEPTH;
-    q->count++;
-    
-    spin_unlock(&q->lock);
+    if (!mpsc_push(&q->ring, msg)) return 0;    // full
+    wq_wake_one(&q->rx_wq);
     return 1;
 }
 
 u8 msg_recv(msg_queue_t* q, msg_t* msg) {
-    spin_lock(&q->lock);
-    
-    if (q->count == 0) {
-        spin_unlock(&q->lock);
-        return 0;   // empty
+    return mpsc_pop(&q->ring, msg);     // 0: empty
+}
+
+u8 msg_recv_timeout(msg_queue_t* q, msg_t* msg, u32 timeout_ms) {
+    u32 deadline = timer_ticks() + timeout_ms;
+    for (;;) {
+        u32 snap = wq_prepare(&q->rx_wq);
+        if (mpsc_pop(&q->ring, msg)) return 1;
+        u32 left = timeout_ms;
+        if (timeout_ms != WAIT_FOREVER) {
+            s32 d = (s32)(deadline - timer_ticks());
+            if (d <= 0) return 0;
+            left = (u32)d;
+        }
+        wq_wait(&q->rx_wq, snap, left);     // woken or not, look again
     }
-    
-    *msg = q->buf[q->tail];
-    q->tail = (q->tail + 1) % MSG_DEPTH;
-    q->count--;
-    
-    spin_unlock(&q->lock);
-    return 1;
 }
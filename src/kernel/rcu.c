@@ -0,0 +1,52 @@
+/*
+ * rcu.c - quiescent-state grace periods
+ *
+ * One counter per CPU, each on its own cache line and written only by
+ * that CPU from schedule(). A grace period snapshots them, kicks the
+ * CPUs that lag (a halted idle CPU wakes, yields and so reports) and
+ * yields until each has moved. The caller's own CPU is quiescent by
+ * the time it gets here.
+ */
+
+#include "kernel/types.h"
+#include "kernel/rcu.h"
+#include "kernel/sched.h"
+#include "kernel/smp.h"
+
+struct rcu_cpu {
+    volatile u32 qs;
+} __attribute__((aligned(64)));
+
+static struct rcu_cpu rcu_cpus[SMP_MAX_CPUS];
+static volatile u32 rcu_gp_count;
+
+void rcu_qs(void) {
+    struct rcu_cpu* c = &rcu_cpus[smp_cpu_id()];
+    __atomic_store_n(&c->qs, c->qs + 1, __ATOMIC_RELEASE);
+}
+
+void synchronize_rcu(void) {
+    u32 snap[SMP_MAX_CPUS];
+    u32 self = smp_cpu_id();
+    u32 n = smp_num_cpus();
+
+    // the update is visible everywhere before we start counting
+    __sync_synchronize();
+    if (n > 1 && task_current()) {
+        for (u32 c = 0; c < n; c++) {
+            snap[c] = __atomic_load_n(&rcu_cpus[c].qs, __ATOMIC_ACQUIRE);
+            if (c != self) smp_send_resched(c);
+        }
+        for (u32 c = 0; c < n; c++) {
+            if (c == self) continue;
+            while (__atomic_load_n(&rcu_cpus[c].qs, __ATOMIC_ACQUIRE) == snap[c]) {
+                task_yield();
+            }
+        }
+    }
+    __sync_fetch_and_add(&rcu_gp_count, 1);
+}
+
+u32 rcu_grace_periods(void) {
+    return rcu_gp_count;
+}
@@ -0,0 +1,116 @@
+/*
+ * ring.c - lock-free SPSC/MPSC rings (see ring.h)
+ */
+
+#include "kernel/ring.h"
+#include "kernel/atomic.h"
+#include "string.h"
+
+static inline void* slot_at(u8* buf, u32 pos, u32 mask, u16 size) {
+    return buf + (pos & mask) * size;
+}
+
+/* ---------- single producer, single consumer ---------- */
+
+void spsc_init(spsc_ring_t* r) {
+    r->head = r->tail = 0;
+}
+
+void* spsc_reserve(spsc_ring_t* r) {
+    u32 head = r->head;
+    if (head - atomic_load_acq(&r->tail) > r->mask) return 0;
+    return slot_at(r->buf, head, r->mask, r->elem_size);
+}
+
+void spsc_commit(spsc_ring_t* r) {
+    atomic_store_rel(&r->head, r->head + 1);
+}
+
+const void* spsc_peek(spsc_ring_t* r) {
+    u32 tail = r->tail;
+    if (atomic_load_acq(&r->head) == tail) return 0;
+    return slot_at(r->buf, tail, r->mask, r->elem_size);
+}
+
+void spsc_consume(spsc_ring_t* r) {
+    atomic_store_rel(&r->tail, r->tail + 1);
+}
+
+u8 spsc_push(spsc_ring_t* r, const void* elem) {
+    void* s = spsc_reserve(r);
+    if (!s) return 0;
+    memcpy(s, elem, r->elem_size);
+    spsc_commit(r);
+    return 1;
+}
+
+u8 spsc_pop(spsc_ring_t* r, void* elem) {
+    const void* s = spsc_peek(r);
+    if (!s) return 0;
+    memcpy(elem, s, r->elem_size);
+    spsc_consume(r);
+    return 1;
+}
+
+u32 spsc_count(spsc_ring_t* r) {
+    return atomic_load_acq(&r->head) - atomic_load_acq(&r->tail);
+}
+
+/* ---------- multiple producers, single consumer ---------- */
+
+void mpsc_init(mpsc_ring_t* r) {
+    for (u32 i = 0; i <= r->mask; i++) r->seq[i] = i;
+    r->head = r->tail = 0;
+}
+
+void* mpsc_reserve(mpsc_ring_t* r) {
+    u32 pos = atomic_load_rlx(&r->head);
+    for (;;) {
+        u32 seq = atomic_load_acq(&r->seq[pos & r->mask]);
+        s32 diff = (s32)(seq - pos);
+        if (diff == 0) {
+            // ours if nobody moved head; a failed CAS reloads pos
+            if (atomic_cas_u32(&r->head, &pos, pos + 1)) {
+                return slot_at(r->buf, pos, r->mask, r->elem_size);
+            }
+        } else if (diff < 0) {
+            return 0;   // full: consumer still owns this slot
+        } else {
+            pos = atomic_load_rlx(&r->head);    // lost the race, retry
+        }
+    }
+}
+
+void mpsc_commit(mpsc_ring_t* r, void* slot) {
+    u32 i = (u32)((u8*)slot - r->buf) / r->elem_size;
+    atomic_store_rel(&r->seq[i], r->seq[i] + 1);
+}
+
+const void* mpsc_peek(mpsc_ring_t* r) {
+    u32 pos = r->tail;
+    if (atomic_load_acq(&r->seq[pos & r->mask]) != pos + 1) return 0;
+    return slot_at(r->buf, pos, r->mask, r->elem_size);
+}
+
+void mpsc_consume(mpsc_ring_t* r) {
+    u32 pos = r->tail;
+    // free for the producer one lap ahead
+    atomic_store_rel(&r->seq[pos & r->mask], pos + r->mask + 1);
+    r->tail = pos + 1;
+}
+
+u8 mpsc_push(mpsc_ring_t* r, const void* elem) {
+    void* s = mpsc_reserve(r);
+    if (!s) return 0;
+    memcpy(s, elem, r->elem_size);
+    mpsc_commit(r, s);
+    return 1;
+}
+
+u8 mpsc_pop(mpsc_ring_t* r, void* elem) {
+    const void* s = mpsc_peek(r);
+    if (!s) return 0;
+    memcpy(elem, s, r->elem_size);
+    mpsc_consume(r);
+    return 1;
+}
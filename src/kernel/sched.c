@@ -1,17 +1,92 @@
 /*
- * sched.c - round-robin scheduler with MPU support
+ * sched.c - O(1) priority scheduler with MPU support
+ *
+ * One FIFO ready list per priority plus a 32-bit ready bitmap. Bit
+ * (31 - prio) is set while level prio has runnable tasks, so the most
+ * urgent level is a single CLZ (BSR on x86). Yield re-queues the caller
+ * at the tail of its level: round-robin among equals, strict priority
+ * between levels. The running task is never on a ready list.
+ *
+ * Sleeping tasks sit in a hashed timer wheel keyed by wake tick and
+ * reuse the ready-list links. Each tick only walks the slot for that
+ * tick, so a sleeper costs nothing until its slot comes round.
+ *
+ * SMP: every CPU owns a run queue and an idle task. A task stays on the
+ * CPU it last ran on; an idle CPU pulls work from the nearest busy one
+ * (SMT sibling, then shared L2, then L3) if the task's affinity allows.
+ * The tick CPU owns the wheel and wakes sleepers on their home CPU. A
+ * task just switched out keeps on_cpu set until its CPU schedules again,
+ * so no other CPU resumes it before its registers are saved. With one
+ * CPU all of this collapses to the single queue.
+ *
+ * Periodic tasks own level 0, kept sorted by absolute deadline (EDF) or
+ * by period (RM), so they outrank every normal task and the pick stays
+ * a CLZ. Each is pinned to the first CPU that passes admission. Jobs
+ * are not preempted: a release is dispatched at the next scheduling
+ * point, so admission adds the longest job that can block each task on
+ * top of the utilisation bound. Normal tasks must yield well inside the
+ * shortest deadline for that to hold.
+ *
+ * Wait queues park a task until a producer signals it, optionally with
+ * a timeout through the wheel. Either side may win the wake-up; both
+ * claim the task with a CAS on its state (WAITING -> WAKING) and only
+ * the winner queues it. A signal from an ISR lands on the run queue at
+ * once and kicks a halted CPU, so the waiter runs at the next
+ * scheduling point instead of on its next poll.
+ *
+ * Every pass through schedule() is an RCU quiescent state (rcu.h).
+ *
+ * Lock order: pool_lock or a wait queue, wheel_lock, run queues by
+ * ascending CPU.
  */
 
 #include "kernel/sched.h"
 #include "kernel/types.h"
 #include "kernel/spinlock.h"
+#include "kernel/context.h"
+#include "kernel/timer.h"
 #include "kernel/mpu.h"
-#include "uart.h"
+#include "kernel/smp.h"
+#include "kernel/fpu.h"
+#include "kernel/atomic.h"
+#include "kernel/irq.h"
+#include "kernel/rcu.h"
+#include "kernel/klog.h"
+
+struct runqueue {
+    spinlock_t lock;
+    volatile u32 ready_bitmap;  // peeked without the lock by other CPUs
+    u32 nr_ready;
+    struct task* curr;
+    struct task* last;          // switched out, on_cpu not yet cleared
+    struct task* head[SCHED_PRIO_LEVELS];
+    struct task* tail[SCHED_PRIO_LEVELS];
+};
 
 static struct task task_pool[MAX_TASKS];
-static struct task* current_task = 0;
+static struct runqueue rqs[SMP_MAX_CPUS];
+static struct task* wheel[TIMER_WHEEL_SLOTS];
+static u32 wheel_tick;          // last tick sched_tick() expired
 static u32 next_pid = 1;
-static spinlock_t sched_lock = {0};
+static spinlock_t pool_lock = {0};
+static spinlock_t wheel_lock = {0};
+static volatile u32 idle_cpus;  // CPUs about to halt in timer_idle()
+// for lock_stats_dump(); SMP_MAX_CPUS is at most 8
+static const char* const rq_names[8] = { "rq0", "rq1", "rq2", "rq3", "rq4", "rq5", "rq6", "rq7" };
+static volatile u8 sched_running;
+
+#define PRIO_BIT(p) (0x80000000u >> (p))
+#define WHEEL_SLOT(t) ((t) & (TIMER_WHEEL_SLOTS - 1))
+#define CPU_BIT(c) (1u << (c))
+
+static inline struct runqueue* this_rq(void) {
+    return &rqs[smp_cpu_id()];
+}
+
+static inline u32 online_mask(void) {
+    u32 n = smp_num_cpus();
+    return n >= 32 ? 0xFFFFFFFFu : CPU_BIT(n) - 1;
+}
 
 static void write_canary(struct task* t) {
     u32* canary_ptr = (u32*)(t->stack_base);
@@ -24,111 +99,727 @@ static u8 check_canary(struct task* t) {
     return (*canary_ptr == t->canary) ? 1 : 0;
 }
 
+// periodic class order; FIFO among equals
+static inline u8 rt_before(struct task* a, struct task* b) {
+#if SCHED_RT_RM
+    return a->period < b->period;
+#else
+    return (s32)(a->deadline_tick - b->deadline_tick) < 0;
+#endif
+}
+
+static void rq_push(struct runqueue* rq, struct task* t) {
+    u8 p = t->priority;
+    struct task* at = 0;
+    if (p == SCHED_PRIO_RT) {
+        at = rq->head[p];
+        while (at && !rt_before(t, at)) at = at->next;
+    }
+    if (at) {
+        t->next = at;
+        t->prev = at->prev;
+        if (at->prev) at->prev->next = t;
+        else rq->head[p] = t;
+        at->prev = t;
+    } else {
+        t->next = 0;
+        t->prev = rq->tail[p];
+        if (rq->tail[p]) rq->tail[p]->next = t;
+        else rq->head[p] = t;
+        rq->tail[p] = t;
+    }
+    rq->ready_bitmap |= PRIO_BIT(p);
+    rq->nr_ready++;
+}
+
+static void rq_remove(struct runqueue* rq, struct task* t) {
+    u8 p = t->priority;
+    if (t->prev) t->prev->next = t->next;
+    else rq->head[p] = t->next;
+    if (t->next) t->next->prev = t->prev;
+    else rq->tail[p] = t->prev;
+    t->next = t->prev = 0;
+    if (!rq->head[p]) rq->ready_bitmap &= ~PRIO_BIT(p);
+    rq->nr_ready--;
+}
+
+static struct task* rq_pop(struct runqueue* rq) {
+    if (!rq->ready_bitmap) return 0;
+    struct task* t = rq->head[__builtin_clz(rq->ready_bitmap)];
+    rq_remove(rq, t);
+    return t;
+}
+
+// irqs already off
+static void rq_lock_pair(u32 a, u32 b) {
+    if (a > b) { u32 x = a; a = b; b = x; }
+    spin_lock(&rqs[a].lock);
+    if (b != a) spin_lock(&rqs[b].lock);
+}
+
+static void rq_unlock_pair(u32 a, u32 b) {
+    spin_unlock(&rqs[a].lock);
+    if (b != a) spin_unlock(&rqs[b].lock);
+}
+
+// racy load estimate; idle counts once on every CPU
+static u32 least_loaded(u32 cpus) {
+    u32 best = smp_cpu_id(), load = 0xFFFFFFFF;
+    for (u32 c = 0; c < smp_num_cpus(); c++) {
+        if (!(cpus & CPU_BIT(c))) continue;
+        u32 l = rqs[c].nr_ready + (rqs[c].curr ? 1 : 0);
+        if (l < load) {
+            load = l;
+            best = c;
+        }
+    }
+    return best;
+}
+
+// after queueing t on cpu: wake that CPU if it is halted, or else a
+// halted CPU that may steal t
+static void kick_cpu(u32 cpu, struct task* t) {
+    __sync_synchronize();       // pairs with the idle bit in sched_next_wake
+    u32 idle = idle_cpus;
+    if (!idle) return;
+    if (idle & CPU_BIT(cpu)) {
+        smp_send_resched(cpu);
+        return;
+    }
+    u32 spare = idle & t->affinity & ~CPU_BIT(smp_cpu_id());
+    if (!spare) return;
+    const u8* order = smp_steal_order(cpu);
+    for (u32 i = 0; i + 1 < smp_num_cpus(); i++) {
+        if (spare & CPU_BIT(order[i])) {
+            smp_send_resched(order[i]);
+            return;
+        }
+    }
+}
+
+// t is on no list; stays home unless its affinity moved it away
+static void wake_task(struct task* t) {
+    u32 c = t->cpu;
+    if (!t->on_cpu && !(t->affinity & CPU_BIT(c))) {
+        c = least_loaded(t->affinity & online_mask());
+    }
+    struct runqueue* rq = &rqs[c];
+    spin_lock(&rq->lock);
+    t->cpu = c;
+    t->state = TASK_READY;
+    rq_push(rq, t);
+    spin_unlock(&rq->lock);
+    kick_cpu(c, t);
+}
+
+static void wheel_insert(struct task* t) {
+    struct task** slot = &wheel[WHEEL_SLOT(t->wake_tick)];
+    t->prev = 0;
+    t->next = *slot;
+    if (*slot) (*slot)->prev = t;
+    *slot = t;
+}
+
+static void wheel_remove(struct task* t) {
+    if (t->prev) t->prev->next = t->next;
+    else wheel[WHEEL_SLOT(t->wake_tick)] = t->next;
+    if (t->next) t->next->prev = t->prev;
+    t->next = t->prev = 0;
+}
+
+// a waiter belongs to whoever moves it out of TASK_WAITING first
+static inline u8 wq_claim(struct task* t) {
+    return __sync_bool_compare_and_swap(&t->state, TASK_WAITING, TASK_WAKING);
+}
+
+// caller holds wheel_lock
+static void wheel_expire(u32 slot, u32 now) {
+    struct task* t = wheel[slot];
+    while (t) {
+        struct task* n = t->next;
+        if ((s32)(now - t->wake_tick) >= 0) {   // later laps stay put
+            // a waiter being signalled right now is the waker's to remove
+            u8 ours = t->state == TASK_SLEEPING || wq_claim(t);
+            if (ours) {
+                wheel_remove(t);
+                wake_task(t);       // a timed-out waiter unlinks itself
+            }
+        }
+        t = n;
+    }
+}
+
+// caller holds the run queue lock, plus wheel_lock if t may be sleeping
+// or waiting; a waiter stays linked on its queue until someone unlinks it
+static void kill_task(struct task* t) {
+    if (t->state == TASK_WAITING && !wq_claim(t)) return;  // being woken
+    KLOG("Stack overflow task %x\r\n", t->pid);     // rq lock held: no UART here
+    if (t->state == TASK_READY) rq_remove(&rqs[t->cpu], t);
+    else if (t->state == TASK_SLEEPING) wheel_remove(t);
+    else if (t->state == TASK_WAKING && t->wq_timed) wheel_remove(t);
+    t->state = TASK_BLOCKED;
+    t->pid = 0;
+}
+
 void sched_init(void) {
     for (int i = 0; i < MAX_TASKS; i++) {
-        task_pool[i].state = 0;
+        task_pool[i].state = TASK_BLOCKED;
         task_pool[i].pid = 0;
+        task_pool[i].on_cpu = 0;
+    }
+    for (u32 c = 0; c < SMP_MAX_CPUS; c++) {
+        rqs[c] = (struct runqueue){0};
+        LOCK_STAT_NAME(&rqs[c].lock, rq_names[c]);
     }
-    uart_puts("Scheduler initialized\r\n");
+    LOCK_STAT_NAME(&pool_lock, "pool_lock");
+    LOCK_STAT_NAME(&wheel_lock, "wheel_lock");
+    for (int i = 0; i < TIMER_WHEEL_SLOTS; i++) wheel[i] = 0;
+    wheel_tick = timer_ticks();
+    irq_prio_init();
+    fpu_init();
+    KLOG("Scheduler initialized\r\n");
 }
 
 u32 task_create(task_entry_t entry, void* arg, u32 stack_size) {
-    spin_lock(&sched_lock);
-    
+    return task_create_prio(entry, arg, stack_size, SCHED_PRIO_DEFAULT);
+}
+
+u32 task_create_prio(task_entry_t entry, void* arg, u32 stack_size, u8 prio) {
+    return task_create_affinity(entry, arg, stack_size, prio, SCHED_CPU_ALL);
+}
+
+// caller holds pool_lock; the task is not queued yet
+static struct task* task_alloc(task_entry_t entry, u32 stack_size, u8 prio,
+                               u32 cpus) {
     for (int i = 0; i < MAX_TASKS; i++) {
-        if (task_pool[i].state == 0) {
-            task_pool[i].pid = next_pid++;
-            task_pool[i].stack_size = stack_size;
-            
+        // an exited task's slot is busy until its CPU has switched away,
+        // a killed waiter's until its wait queue has let go of it
+        if (task_pool[i].pid == 0 && !task_pool[i].on_cpu && !task_pool[i].wq) {
+            struct task* t = &task_pool[i];
+            t->pid = next_pid++;
+            t->stack_size = stack_size;
+            t->priority = prio;
+            t->affinity = cpus;
+            t->period = 0;
+            fpu_attach(t, i);
+
 #ifdef __arm__
             // carve out RAM for task
-            task_pool[i].stack_base = 0x20010000 + (i * 0x4000);
+            t->stack_base = 0x20010000 + (i * 0x4000);
 #else
-            task_pool[i].stack_base = 0x8000 + (i * 0x400);
+            t->stack_base = 0x8000 + (i * 0x400);
 #endif
-            
-            task_pool[i].sp = (u32*)(task_pool[i].stack_base + stack_size - 32);
-            write_canary(&task_pool[i]);
-            
-            u32* sp = task_pool[i].sp;
+
+            t->sp = (u32*)(t->stack_base + stack_size - 32);
+            write_canary(t);
+
+            u32* sp = t->sp;
 #ifdef __arm__
             sp[0] = 0x01000000;
             sp[1] = (u32)entry;
             sp[2] = 0xFFFFFFFD;
 #endif
-            
+
 #ifdef __x86_64__
             sp[0] = (u32)entry;
 #endif
-            
-            task_pool[i].state = 0;
-            spin_unlock(&sched_lock);
-            return task_pool[i].pid;
+            return t;
+        }
+    }
+    return 0;
+}
+
+// caller holds pool_lock
+static void task_enqueue(struct task* t, u32 cpu) {
+    struct runqueue* rq = &rqs[cpu];
+    spin_lock(&rq->lock);
+    t->cpu = cpu;
+    t->state = TASK_READY;
+    rq_push(rq, t);
+    spin_unlock(&rq->lock);
+    kick_cpu(cpu, t);
+}
+
+// lands on the least loaded CPU in cpus
+u32 task_create_affinity(task_entry_t entry, void* arg, u32 stack_size, u8 prio,
+                         u32 cpus) {
+    (void)arg;
+    if (prio >= SCHED_PRIO_LEVELS) prio = SCHED_PRIO_IDLE;
+    if (prio == SCHED_PRIO_RT) prio = SCHED_PRIO_RT + 1;   // periodic only
+    cpus &= online_mask();
+    if (!cpus) return 0;
+
+    spin_lock_irq(&pool_lock);
+    u32 pid = 0;
+    struct task* t = task_alloc(entry, stack_size, prio, cpus);
+    if (t) {
+        task_enqueue(t, least_loaded(cpus));
+        pid = t->pid;
+    }
+    spin_unlock_irq(&pool_lock);
+    return pid;
+}
+
+// a waiting task moves now; a running or sleeping one at its next wake-up
+// or when an allowed CPU steals it
+u8 task_set_affinity(u32 pid, u32 cpus) {
+    cpus &= online_mask();
+    if (!pid || !cpus) return 0;
+
+    spin_lock_irq(&pool_lock);
+    struct task* t = 0;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (task_pool[i].pid == pid) t = &task_pool[i];
+    }
+    if (!t) {
+        spin_unlock_irq(&pool_lock);
+        return 0;
+    }
+
+    t->affinity = cpus;
+    u32 from = t->cpu;
+    if (!(cpus & CPU_BIT(from))) {
+        u32 to = least_loaded(cpus);
+        rq_lock_pair(from, to);
+        if (t->state == TASK_READY && t->cpu == from && !t->on_cpu) {
+            rq_remove(&rqs[from], t);
+            t->cpu = to;
+            rq_push(&rqs[to], t);
+        }
+        rq_unlock_pair(from, to);
+        kick_cpu(to, t);
+    }
+    spin_unlock_irq(&pool_lock);
+    return 1;
+}
+
+static void periodic_main(void);
+
+#if SCHED_RT_RM
+// Liu & Layland n(2^(1/n) - 1), Q16, rounded down
+static const u32 rm_bound[] = {
+    65536, 54291, 51102, 49599, 48725, 48154, 47751, 47452
+};
+#define RT_BOUND(n) ((n) <= 8 ? rm_bound[(n) - 1] : 45426u)   // ln 2
+#else
+#define RT_BOUND(n) 65536u
+#endif
+
+static inline u32 q16_div_up(u32 a, u32 b) {
+    return (u32)((((u64)a << 16) + b - 1) / b);
+}
+
+// entry i of cpu's periodic set; i == MAX_TASKS is the candidate
+static u8 rt_entry(int i, u32 cpu, u32 wcet, u32 deadline, u32* c, u32* d) {
+    if (i == MAX_TASKS) {
+        *c = wcet;
+        *d = deadline;
+        return 1;
+    }
+    struct task* t = &task_pool[i];
+    if (!t->pid || !t->period || t->cpu != cpu) return 0;
+    *c = t->wcet;
+    *d = t->deadline;
+    return 1;
+}
+
+// Would cpu still meet every deadline with (wcet, deadline) added?
+// In deadline order, task k may be blocked by one whole job of any less
+// urgent task, so it needs
+//   sum(D_i <= D_k) C_i/D_i + max(D_j > D_k) C_j / D_k <= bound(k)
+// O(n^2) over a handful of tasks, no scratch arrays on a task stack.
+// caller holds pool_lock
+static u8 rt_admit(u32 cpu, u32 wcet, u32 deadline) {
+    for (int k = 0; k <= MAX_TASKS; k++) {
+        u32 ck, dk;
+        if (!rt_entry(k, cpu, wcet, deadline, &ck, &dk)) continue;
+
+        u32 util = 0, block = 0, n = 0;
+        for (int i = 0; i <= MAX_TASKS; i++) {
+            u32 ci, di;
+            if (!rt_entry(i, cpu, wcet, deadline, &ci, &di)) continue;
+            if (di <= dk) {
+                util += q16_div_up(ci, di);
+                n++;
+            } else if (ci > block) {
+                block = ci;
+            }
+        }
+        if (util + q16_div_up(block, dk) > RT_BOUND(n)) return 0;
+    }
+    return 1;
+}
+
+// wcet and deadline in ticks; deadline 0 means = period. First fit over
+// the CPUs; 0 if no CPU can take it without risking a miss.
+u32 task_create_periodic(task_entry_t entry, u32 period, u32 wcet, u32 deadline) {
+    if (!deadline) deadline = period;
+    if (!entry || !period || !wcet || wcet > deadline || deadline > period) return 0;
+
+    spin_lock_irq(&pool_lock);
+    u32 pid = 0;
+    for (u32 cpu = 0; cpu < smp_num_cpus(); cpu++) {
+        if (!rt_admit(cpu, wcet, deadline)) continue;
+        struct task* t = task_alloc(periodic_main, KERNEL_STACK_SIZE,
+                                    SCHED_PRIO_RT, CPU_BIT(cpu));
+        if (!t) break;
+        t->job = entry;
+        t->period = period;
+        t->wcet = wcet;
+        t->deadline = deadline;
+        t->jobs = 0;
+        t->misses = 0;
+        t->release_tick = timer_ticks();
+        t->deadline_tick = t->release_tick + deadline;
+        task_enqueue(t, cpu);
+        pid = t->pid;
+        break;
+    }
+    spin_unlock_irq(&pool_lock);
+    return pid;
+}
+
+u8 task_rt_stats(u32 pid, u32* jobs, u32* misses) {
+    for (int i = 0; i < MAX_TASKS; i++) {
+        struct task* t = &task_pool[i];
+        if (t->pid == pid && t->period) {
+            if (jobs) *jobs = t->jobs;
+            if (misses) *misses = t->misses;
+            return 1;
         }
     }
-    
-    spin_unlock(&sched_lock);
     return 0;
 }
 
+// full sweep; the switch path only checks the outgoing task
 void task_stack_check(void) {
+    spin_lock_irq(&pool_lock);
+    spin_lock(&wheel_lock);
+    for (u32 c = 0; c < smp_num_cpus(); c++) spin_lock(&rqs[c].lock);
     for (int i = 0; i < MAX_TASKS; i++) {
         if (task_pool[i].pid != 0 && !check_canary(&task_pool[i])) {
-            uart_puts("Stack overflow task ");
-            uart_hex(task_pool[i].pid);
-            uart_puts("\r\n");
-            task_pool[i].state = 0;
+            kill_task(&task_pool[i]);
         }
     }
+    for (u32 c = smp_num_cpus(); c-- > 0; ) spin_unlock(&rqs[c].lock);
+    spin_unlock(&wheel_lock);
+    spin_unlock_irq(&pool_lock);
+}
+
+struct task* task_current(void) {
+    return this_rq()->curr;
 }
 
+// APs park here until the boot CPU has created their idle tasks
 void sched_start(void) {
-    if (!current_task) {
-        for (int i = 0; i < MAX_TASKS; i++) {
-            if (task_pool[i].state == 0 && task_pool[i].pid != 0) {
-                current_task = &task_pool[i];
-                current_task->state = 1;
-                break;
-            }
+    u32 cpu = smp_cpu_id();
+    if (cpu == 0) {
+        sched_running = 1;
+    } else {
+        while (!sched_running) __sync_synchronize();
+    }
+    fpu_cpu_init();
+
+    struct runqueue* rq = &rqs[cpu];
+    spin_lock_irq(&rq->lock);
+    if (!rq->curr) {
+        rq->curr = rq_pop(rq);
+        if (rq->curr) {
+            rq->curr->state = TASK_RUNNING;
+            rq->curr->on_cpu = 1;
         }
     }
-    
-    if (current_task) {
-        uart_puts("Switching to first task\r\n");
-        context_switch(0, current_task->sp);
+    struct task* first = rq->curr;
+    spin_unlock_irq(&rq->lock);
+
+    if (first) {
+        KLOG("Switching to first task\r\n");
+        context_switch(0, first->sp);
     }
 }
 
-void task_yield(void) {
-    spin_lock(&sched_lock);
-    task_stack_check();
-    
-    struct task* next = current_task;
-    u32 start = (current_task) ? (current_task - task_pool) : 0;
-    
-    for (u32 i = 1; i <= MAX_TASKS; i++) {
-        u32 idx = (start + i) % MAX_TASKS;
-        if (task_pool[idx].state == 0 && task_pool[idx].pid != 0) {
-            next = &task_pool[idx];
-            break;
+// caller holds rq->lock with irqs off; drops it before switching
+static void schedule(struct runqueue* rq) {
+    struct task* old = rq->curr;
+    u32 bit = CPU_BIT(rq - rqs);
+
+    // whatever we switched away from last time is saved by now
+    if (rq->last && rq->last != old) rq->last->on_cpu = 0;
+    rq->last = 0;
+    if (idle_cpus & bit) __sync_fetch_and_and(&idle_cpus, ~bit);
+    rcu_qs();       // nothing is held across a switch
+
+    if (old->state == TASK_RUNNING) {
+        if (old->pid != 0 && !check_canary(old)) {
+            kill_task(old);
+        } else {
+            old->state = TASK_READY;
+            rq_push(rq, old);
         }
     }
-    
-    if (next != current_task) {
-        struct task* old = current_task;
-        current_task = next;
-        if (old) old->state = 0;
-        next->state = 1;
-        spin_unlock(&sched_lock);
+
+    struct task* next = rq_pop(rq);
+    if (!next) {
+        // nothing runnable, not even idle
+        spin_unlock_irq(&rq->lock);
+        return;
+    }
+
+    next->state = TASK_RUNNING;
+    next->on_cpu = 1;
+    rq->curr = next;
+    if (next != old) rq->last = old;
+    spin_unlock_irq(&rq->lock);
+
+    if (next != old) {
+        fpu_switch(old, next);
         context_switch(&old->sp, next->sp);
+    }
+}
+
+void task_yield(void) {
+    struct runqueue* rq = this_rq();
+    spin_lock_irq(&rq->lock);
+    schedule(rq);
+}
+
+// park the caller until tick wake; already due means just yield
+static void sleep_until(u32 wake) {
+    spin_lock_irq(&wheel_lock);
+    struct runqueue* rq = this_rq();
+    struct task* t = rq->curr;
+    // a smashed stack is killed on the way out, not parked in the wheel
+    if ((s32)(wake - timer_ticks()) > 0 && check_canary(t)) {
+        t->wake_tick = wake;
+        t->state = TASK_SLEEPING;
+        wheel_insert(t);
+    }
+    spin_unlock(&wheel_lock);
+
+    // the tick may wake us from here on; schedule() copes
+    spin_lock(&rq->lock);
+    schedule(rq);
+}
+
+// 1 tick == 1 ms on every port
+void task_sleep(u32 ms) {
+    sleep_until(timer_ticks() + ms);
+}
+
+/* ---------- wait queues ---------- */
+
+void wq_init(wait_queue_t* wq) {
+    wq->lock = (spinlock_t){0};
+    wq->head = 0;
+    wq->seq = 0;
+}
+
+// take before testing the condition you are about to wait for
+u32 wq_prepare(wait_queue_t* wq) {
+    return atomic_load_acq(&wq->seq);
+}
+
+// caller holds wq->lock
+static void wq_insert(wait_queue_t* wq, struct task* t) {
+    struct task** pp = &wq->head;
+    while (*pp && (*pp)->priority <= t->priority) pp = &(*pp)->wq_next;
+    t->wq_next = *pp;
+    *pp = t;
+    t->wq = wq;
+}
+
+// caller holds wq->lock
+static void wq_unlink(wait_queue_t* wq, struct task* t) {
+    struct task** pp = &wq->head;
+    while (*pp && *pp != t) pp = &(*pp)->wq_next;
+    if (*pp) *pp = t->wq_next;
+    t->wq_next = 0;
+    t->wq = 0;
+}
+
+// park the caller until a wake-up newer than snap, or timeout_ms ticks.
+// 1 if signalled (possibly before we got to sleep), 0 on timeout.
+u8 wq_wait(wait_queue_t* wq, u32 snap, u32 timeout_ms) {
+    if (atomic_load_acq(&wq->seq) != snap) return 1;
+    if (!timeout_ms) return 0;
+
+    spin_lock_irq(&wq->lock);
+    struct runqueue* rq = this_rq();
+    struct task* t = rq->curr;
+    if (!check_canary(t)) {
+        // killed on the way out, never parked
+        spin_unlock(&wq->lock);
+        spin_lock(&rq->lock);
+        schedule(rq);
+        return 0;
+    }
+
+    t->wq_woken = 0;
+    t->wq_timed = timeout_ms != WAIT_FOREVER;
+    wq_insert(wq, t);
+    t->state = TASK_WAITING;
+    // a waker bumps seq before looking for waiters; one of us sees the other
+    __sync_synchronize();
+    if (wq->seq != snap) {
+        wq_unlink(wq, t);
+        t->state = TASK_RUNNING;
+        spin_unlock_irq(&wq->lock);
+        return 1;
+    }
+    if (t->wq_timed) {
+        spin_lock(&wheel_lock);
+        t->wake_tick = timer_ticks() + timeout_ms;
+        wheel_insert(t);
+        spin_unlock(&wheel_lock);
+    }
+    spin_unlock(&wq->lock);
+
+    // a waker or the tick may queue us from here on; schedule() copes
+    spin_lock(&rq->lock);
+    schedule(rq);
+
+    if (!t->wq_woken) {
+        // timed out: still linked unless a waker skipped past us
+        spin_lock_irq(&wq->lock);
+        if (t->wq == wq) wq_unlink(wq, t);
+        spin_unlock_irq(&wq->lock);
+    }
+    return t->wq_woken;
+}
+
+// wake up to n waiters, most urgent first; safe from ISRs
+static u8 wq_wake(wait_queue_t* wq, u32 n) {
+    __sync_fetch_and_add(&wq->seq, 1);      // full barrier, see wq_wait()
+    if (!wq->head) return 0;                // nobody parked: no locks
+
+    u32 flags = spin_lock_irqsave_kernel(&wq->lock);
+    u8 woken = 0;
+    while (wq->head && woken < n) {
+        struct task* t = wq->head;
+        wq_unlink(wq, t);
+        if (!wq_claim(t)) continue;         // timed out or killed meanwhile
+        t->wq_woken = 1;
+        if (t->wq_timed) {
+            spin_lock(&wheel_lock);
+            wheel_remove(t);
+            spin_unlock(&wheel_lock);
+        }
+        wake_task(t);
+        woken++;
+    }
+    spin_unlock_irqrestore_kernel(&wq->lock, flags);
+    return woken;
+}
+
+u8 wq_wake_one(wait_queue_t* wq) {
+    return wq_wake(wq, 1);
+}
+
+u8 wq_wake_all(wait_queue_t* wq) {
+    return wq_wake(wq, 0xFFFFFFFFu);
+}
+
+// body of every periodic task: one job per release, then sleep to the next
+static void periodic_main(void) {
+    struct task* t = task_current();
+    while (1) {
+        t->job();
+
+        u32 now = timer_ticks();
+        t->jobs++;
+        if ((s32)(now - t->deadline_tick) > 0) t->misses++;
+        t->release_tick += t->period;
+        // overrun: releases already gone never get a job
+        while ((s32)(now - t->release_tick) > 0) {
+            t->release_tick += t->period;
+            t->misses++;
+        }
+        t->deadline_tick = t->release_tick + t->deadline;
+        sleep_until(t->release_tick);
+    }
+}
+
+// tick ISR on the tick CPU; interrupts already masked against the task side
+void sched_tick(u32 now) {
+    spin_lock(&wheel_lock);
+    u32 lag = now - wheel_tick;
+    if (lag >= TIMER_WHEEL_SLOTS) {
+        // missed a whole lap: every slot may hold an expired sleeper
+        for (u32 i = 0; i < TIMER_WHEEL_SLOTS; i++) wheel_expire(i, now);
     } else {
-        spin_unlock(&sched_lock);
+        for (u32 i = 1; i <= lag; i++) wheel_expire(WHEEL_SLOT(wheel_tick + i), now);
+    }
+    wheel_tick = now;
+    spin_unlock(&wheel_lock);
+}
+
+// ticks until the earliest sleeper is due; 0 if something is runnable now.
+// Called with irqs off right before halting, so it also marks this CPU
+// idle: set before the peek, so a racing wake-up either sees the bit and
+// sends an IPI, or its task is seen here.
+u32 sched_next_wake(void) {
+    u32 cpu = smp_cpu_id();
+    __sync_fetch_and_or(&idle_cpus, CPU_BIT(cpu));
+    if (rqs[cpu].ready_bitmap) {
+        __sync_fetch_and_and(&idle_cpus, ~CPU_BIT(cpu));
+        return 0;
     }
+
+    u32 best = 0xFFFFFFFF;
+    spin_lock(&wheel_lock);
+    for (u32 i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+        for (struct task* t = wheel[i]; t; t = t->next) {
+            s32 d = (s32)(t->wake_tick - wheel_tick);
+            u32 left = d > 0 ? (u32)d : 0;
+            if (left < best) best = left;
+        }
+    }
+    spin_unlock(&wheel_lock);
+    return best;
+}
+
+// most urgent task on rq that cpu may take; never one still being saved
+static struct task* steal_candidate(struct runqueue* rq, u32 cpu) {
+    u32 map = rq->ready_bitmap;
+    while (map) {
+        u32 p = __builtin_clz(map);
+        for (struct task* t = rq->head[p]; t; t = t->next) {
+            if (!t->on_cpu && (t->affinity & CPU_BIT(cpu))) return t;
+        }
+        map &= ~PRIO_BIT(p);
+    }
+    return 0;
+}
+
+// idle task: pull one waiting task from the nearest CPU that has one.
+// 1 if something now sits on our queue.
+u8 sched_balance(void) {
+    u32 self = smp_cpu_id();
+    const u8* order = smp_steal_order(self);
+
+    for (u32 i = 0; i + 1 < smp_num_cpus(); i++) {
+        u32 v = order[i];
+        if (!rqs[v].ready_bitmap) continue;     // rechecked under the lock
+
+        u32 flags = irq_save_kernel();
+        rq_lock_pair(self, v);
+        struct task* t = steal_candidate(&rqs[v], self);
+        if (t) {
+            rq_remove(&rqs[v], t);
+            t->cpu = self;
+            rq_push(&rqs[self], t);
+        }
+        rq_unlock_pair(self, v);
+        irq_restore_kernel(flags);
+        if (t) return 1;
+    }
+    return 0;
 }
 
 void task_exit(void) {
-    spin_lock(&sched_lock);
-    current_task->state = 0;
-    spin_unlock(&sched_lock);
-    task_yield();
+    struct runqueue* rq = this_rq();
+    spin_lock_irq(&rq->lock);
+    rq->curr->state = TASK_BLOCKED;
+    rq->curr->pid = 0;
+    schedule(rq);
 }
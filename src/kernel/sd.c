@@ -89,6 +89,40 @@ u8 sd_write(u32 block, const u8* buf) {
     return 0;
 }
 
+u8 sd_write_multi(u32 block, const u8* buf, u32 count) {
+    spi_cs_en(4);
+    // pre-erase: the card can clear the whole run before data arrives
+    if (sd_cmd(55, 0) > 0x01 || sd_cmd(23, count) != 0) {   // APP_CMD, SET_WR_BLK_ERASE_COUNT
+        spi_cs_dis(4);
+        return 1;
+    }
+    if (sd_cmd(25, block << 9) != 0) {    // WRITE_MULTIPLE
+        spi_cs_dis(4);
+        return 1;
+    }
+
+    u8 err = 0;
+    for (u32 b = 0; b < count && !err; b++, buf += SD_BLOCK_SIZE) {
+        spi_xfer(0xFF);
+        spi_xfer(0xFC);   // multi-block token
+
+        for (int i = 0; i < SD_BLOCK_SIZE; i++) {
+            spi_xfer(buf[i]);
+        }
+        spi_xfer(0xFF); spi_xfer(0xFF);   // dummy CRC
+
+        u8 resp = spi_xfer(0xFF);
+        if ((resp & 0x1F) != 0x05) err = 1;
+        while (spi_xfer(0xFF) == 0);      // busy
+    }
+
+    spi_xfer(0xFD);   // stop token, also after an error
+    spi_xfer(0xFF);
+    while (spi_xfer(0xFF) == 0);      // busy
+    spi_cs_dis(4);
+    return err;
+}
+
 u32 sd_capacity(void) {
     return 0;   // TODO: read CSD
 }
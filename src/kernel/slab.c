@@ -0,0 +1,282 @@
+/*
+ * slab.c - object caches (see slab.h)
+ */
+
+#include "kernel/slab.h"
+#include "kernel/irq.h"
+#include "kernel/kprintf.h"
+
+#define SLAB_MIN_OBJS   8       // grow the slab order until this many fit
+#define SLAB_KEEP_EMPTY 1       // empty slabs a cache holds on to
+
+static kmem_cache_t* cache_list;
+
+/* ---------- slab pages ---------- */
+
+#ifdef __x86_64__
+// buddy blocks from paging.c: identity mapped and aligned to their size
+extern u32 paging_alloc_frames(u8 order);
+extern void paging_free_frames(u32 addr, u8 order);
+
+static slab_t* pages_alloc(u8 order) {
+    return (slab_t*)paging_alloc_frames(order);
+}
+
+static void pages_free(slab_t* s, u8 order) {
+    paging_free_frames((u32)s, order);
+}
+#else
+static u8 slab_pool[SLAB_POOL_SIZE]
+    __attribute__((section(".bss.slab_pool"), aligned(SLAB_PAGE_SIZE)));
+static u32 pool_used;
+static void* pool_free;         // given-back pages, linked through word 0
+static spinlock_t pool_lock;
+
+static slab_t* pages_alloc(u8 order) {
+    (void)order;                // always 0, see SLAB_MAX_ORDER
+    void* p = 0;
+    u32 flags = spin_lock_irqsave_kernel(&pool_lock);
+    if (pool_free) {
+        p = pool_free;
+        pool_free = *(void**)p;
+    } else if (pool_used + SLAB_PAGE_SIZE <= SLAB_POOL_SIZE) {
+        p = &slab_pool[pool_used];
+        pool_used += SLAB_PAGE_SIZE;
+    }
+    spin_unlock_irqrestore_kernel(&pool_lock, flags);
+    return (slab_t*)p;
+}
+
+static void pages_free(slab_t* s, u8 order) {
+    (void)order;
+    u32 flags = spin_lock_irqsave_kernel(&pool_lock);
+    *(void**)s = pool_free;
+    pool_free = s;
+    spin_unlock_irqrestore_kernel(&pool_lock, flags);
+}
+#endif
+
+/* ---------- slab lists, under c->lock ---------- */
+
+static inline slab_t* slab_of(kmem_cache_t* c, void* obj) {
+    return (slab_t*)((u32)obj & ~((SLAB_PAGE_SIZE << c->order) - 1));
+}
+
+static inline void** link_of(kmem_cache_t* c, void* obj) {
+    return (void**)((u8*)obj + c->link);
+}
+
+static void list_push(slab_t** head, slab_t* s) {
+    s->prev = 0;
+    s->next = *head;
+    if (s->next) s->next->prev = s;
+    *head = s;
+}
+
+static void list_remove(slab_t** head, slab_t* s) {
+    if (s->prev) s->prev->next = s->next;
+    else *head = s->next;
+    if (s->next) s->next->prev = s->prev;
+}
+
+static slab_t* slab_new(kmem_cache_t* c) {
+    slab_t* s = pages_alloc(c->order);
+    if (!s) return 0;
+
+    u8* base = (u8*)s + c->first + c->color_next;
+    c->color_next += c->color_step;
+    if (c->color_next > c->color_max) c->color_next = 0;
+
+    // free list in address order
+    s->free = 0;
+    s->inuse = 0;
+    for (u32 i = c->per_slab; i-- > 0; ) {
+        void* obj = base + i * c->stride;
+        if (c->ctor) c->ctor(obj);
+        *link_of(c, obj) = s->free;
+        s->free = obj;
+    }
+    c->slabs++;
+    return s;
+}
+
+static void* slab_get(kmem_cache_t* c) {
+    slab_t* s = c->partial;
+    if (!s) {
+        s = c->empty;
+        if (s) {
+            list_remove(&c->empty, s);
+            c->nempty--;
+        } else {
+            s = slab_new(c);
+            if (!s) return 0;
+        }
+        list_push(&c->partial, s);
+    }
+
+    void* obj = s->free;
+    s->free = *link_of(c, obj);
+    s->inuse++;
+    if (!s->free) list_remove(&c->partial, s);     // full: on no list
+    return obj;
+}
+
+static void slab_put(kmem_cache_t* c, void* obj) {
+    slab_t* s = slab_of(c, obj);
+    if (!s->free) list_push(&c->partial, s);        // was full
+    *link_of(c, obj) = s->free;
+    s->free = obj;
+    if (--s->inuse) return;
+
+    list_remove(&c->partial, s);
+    if (c->nempty < SLAB_KEEP_EMPTY) {
+        list_push(&c->empty, s);
+        c->nempty++;
+    } else {
+        c->slabs--;
+        pages_free(s, c->order);
+    }
+}
+
+/* ---------- caches ---------- */
+
+u8 kmem_cache_init(kmem_cache_t* c, const char* name, u32 size, u32 align, slab_ctor_t ctor) {
+    if (align < 4) align = 4;
+    if (align & (align - 1)) return 0;
+    if (size < 4) size = 4;
+
+    // a constructed object keeps its contents while free: link after it
+    u32 link = ctor ? (size + 3) & ~3u : 0;
+    u32 stride = ((ctor ? link + 4 : size) + align - 1) & ~(align - 1);
+    u32 first = (sizeof(slab_t) + align - 1) & ~(align - 1);
+
+    s32 order = -1;
+    u32 per_slab = 0;
+    for (u8 o = 0; o <= SLAB_MAX_ORDER; o++) {
+        u32 bytes = SLAB_PAGE_SIZE << o;
+        if (first + stride > bytes) continue;
+        order = o;
+        per_slab = (bytes - first) / stride;
+        if (per_slab >= SLAB_MIN_OBJS) break;
+    }
+    if (order < 0) return 0;
+
+    u8 listed = c->name != 0;
+    c->name = name;
+    c->size = size;
+    c->stride = stride;
+    c->link = link;
+    c->first = first;
+    c->per_slab = per_slab;
+    c->order = (u8)order;
+    c->color_max = (SLAB_PAGE_SIZE << order) - first - per_slab * stride;
+    c->color_step = align > SLAB_LINE ? align : SLAB_LINE;
+    c->color_next = 0;
+    c->ctor = ctor;
+    c->lock.lock = 0;
+    c->partial = c->empty = 0;
+    c->nempty = 0;
+    c->slabs = 0;
+    for (u32 i = 0; i < SMP_MAX_CPUS; i++) {
+        slab_mag_t* m = &c->mag[i];
+        m->count = m->allocs = m->frees = m->hits = m->fails = 0;
+    }
+    LOCK_STAT_NAME(&c->lock, name);
+    if (listed) return 1;
+
+    kmem_cache_t* head;
+    do {
+        head = cache_list;
+        c->next = head;
+    } while (!__sync_bool_compare_and_swap(&cache_list, head, c));
+    return 1;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* c) {
+    void* obj = 0;
+    u32 flags = irq_save_kernel();
+    slab_mag_t* m = &c->mag[smp_cpu_id()];
+
+    if (m->count) {
+        obj = m->objs[--m->count];
+        m->hits++;
+    } else {
+        // refill half a magazine, so a free right after has room
+        spin_lock(&c->lock);
+        while (m->count < SLAB_MAG_SIZE / 2) {
+            void* o = slab_get(c);
+            if (!o) break;
+            m->objs[m->count++] = o;
+        }
+        spin_unlock(&c->lock);
+        if (m->count) obj = m->objs[--m->count];
+    }
+    if (obj) m->allocs++;
+    else m->fails++;
+
+    irq_restore_kernel(flags);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* c, void* obj) {
+    if (!obj) return;
+    u32 flags = irq_save_kernel();
+    slab_mag_t* m = &c->mag[smp_cpu_id()];
+
+    if (m->count == SLAB_MAG_SIZE) {
+        spin_lock(&c->lock);
+        while (m->count > SLAB_MAG_SIZE / 2) slab_put(c, m->objs[--m->count]);
+        spin_unlock(&c->lock);
+    }
+    m->objs[m->count++] = obj;
+    m->frees++;
+
+    irq_restore_kernel(flags);
+}
+
+void kmem_cache_shrink(kmem_cache_t* c) {
+    u32 flags = irq_save_kernel();
+    slab_mag_t* m = &c->mag[smp_cpu_id()];
+
+    spin_lock(&c->lock);
+    while (m->count) slab_put(c, m->objs[--m->count]);
+    while (c->empty) {
+        slab_t* s = c->empty;
+        list_remove(&c->empty, s);
+        c->slabs--;
+        pages_free(s, c->order);
+    }
+    c->nempty = 0;
+    spin_unlock(&c->lock);
+
+    irq_restore_kernel(flags);
+}
+
+// racy snapshot: counters move while we add them up
+void kmem_cache_stats(kmem_cache_t* c, slab_stats_t* out) {
+    out->obj_size = c->stride;
+    out->per_slab = c->per_slab;
+    out->slabs = c->slabs;
+    out->cached = out->allocs = out->frees = out->hits = out->fails = 0;
+    for (u32 i = 0; i < SMP_MAX_CPUS; i++) {
+        slab_mag_t* m = &c->mag[i];
+        out->cached += m->count;
+        out->allocs += m->allocs;
+        out->frees += m->frees;
+        out->hits += m->hits;
+        out->fails += m->fails;
+    }
+    out->active = out->allocs - out->frees;
+}
+
+void slab_stats_dump(void) {
+    for (kmem_cache_t* c = cache_list; c; c = c->next) {
+        slab_stats_t st;
+        kmem_cache_stats(c, &st);
+        kprintf("SLAB name=%s size=%d per_slab=%d slabs=%d active=%d cached=%d "
+                "allocs=%d frees=%d hit_pct=%d fails=%d\r\n",
+                c->name, st.obj_size, st.per_slab, st.slabs, st.active, st.cached,
+                st.allocs, st.frees, st.allocs ? st.hits * 100 / st.allocs : 0,
+                st.fails);
+    }
+}
@@ -3,7 +3,13 @@
  */
 
 #include "kernel/spinlock.h"
+#include "kernel/atomic.h"
+#include "kernel/irq.h"
+#include "kernel/kprintf.h"
 #include "common/compiler.h"
+#ifdef __x86_64__
+#include "drivers/hw_transactional.h"
+#endif
 
 static inline void cpu_relax(void) {
 #ifdef __x86_64__
@@ -13,19 +19,142 @@ static inline void cpu_relax(void) {
 #endif
 }
 
+#if LOCK_STATS
+static lock_stat_t* volatile stat_list;
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+#define HAVE_DWT 1
+#endif
+
+static inline u32 lock_clock(void) {
+#ifdef __x86_64__
+    u32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+#elif defined(HAVE_DWT)
+    return *(volatile u32*)0xE0001004;   // DWT_CYCCNT
+#else
+    return 0;
+#endif
+}
+
+// caller holds the lock, so plain increments are safe;
+// t0 is when we first found it taken
+static void stat_hit(lock_stat_t* s, u8 contended, u32 t0) {
+    s->acquired++;
+    if (!contended) return;
+    s->contended++;
+    u32 d = lock_clock() - t0;
+    if (d > s->max_spin) s->max_spin = d;
+}
+
+#define STAT_HIT(l, c, t0) stat_hit(&(l)->stat, (c), (t0))
+#define STAT_CLOCK() lock_clock()
+// outside any transaction, and racing other CPUs: atomic
+#define STAT_ADD(l, field) __sync_fetch_and_add(&(l)->stat.field, 1)
+#else
+#define STAT_HIT(l, c, t0) ((void)(l), (void)(c), (void)(t0))
+#define STAT_CLOCK() 0
+#define STAT_ADD(l, field) ((void)(l))
+#endif
+
+/* ---------- RTM lock elision (x86) ---------- */
+
+#ifdef __x86_64__
+#define XBEGIN_STARTED  (~0u)
+#define ELIDE_BUSY      0xFF    // xabort code: lock was really held
+
+static u8 elide_on;
+static u8 elide_policy = TX_RETRY_ADAPTIVE;
+static const u8 elide_max_tries[] = { 1, 2, 8, 16 };   // per TX_RETRY_*
+
+static inline u32 xbegin(void) {
+    u32 status = XBEGIN_STARTED;    // untouched on start, abort code if not
+    __asm__ volatile(".byte 0xC7, 0xF8; .long 0" : "+a"(status) :: "memory");
+    return status;
+}
+
+static inline void xend(void) {
+    __asm__ volatile(".byte 0x0F, 0x01, 0xD5" ::: "memory");
+}
+
+static inline void xabort_busy(void) {
+    __asm__ volatile(".byte 0xC6, 0xF8, %c0" :: "i"(ELIDE_BUSY) : "memory");
+}
+
+static u8 elide_retry(u32 status, u32 tries) {
+    if (tries + 1 >= elide_max_tries[elide_policy]) return 0;
+    // held for real: worth another go once it is released
+    if ((status & RTM_ABORT_EXPLICIT) && (status >> 24) == ELIDE_BUSY) return 1;
+    if (elide_policy == TX_RETRY_AGGRESSIVE) return 1;
+    return hw_transactional_should_retry(status, tries);
+}
+
+// 1: inside a transaction with the lock word in our read set
+static u8 elide_lock(spinlock_t* lock) {
+    for (u32 tries = 0; ; tries++) {
+        while (lock->lock) cpu_relax();     // starting now would only abort
+        u32 status = xbegin();
+        if (status == XBEGIN_STARTED) {
+            if (!lock->lock) return 1;
+            xabort_busy();
+        }
+        STAT_ADD(lock, elide_aborts);
+        if (!elide_retry(status, tries)) break;
+    }
+    STAT_ADD(lock, elide_fallbacks);
+    return 0;
+}
+
+void spin_elision_init(void) {
+    elide_on = hw_transactional_has_rtm();
+}
+
+void spin_elision_policy(u8 policy) {
+    if (policy <= TX_RETRY_AGGRESSIVE) elide_policy = policy;
+}
+#else
+void spin_elision_init(void) {}
+void spin_elision_policy(u8 policy) { (void)policy; }
+#endif
+
+void spin_lock_set_elision(spinlock_t* lock, u8 on) {
+    lock->elide = on;
+}
+
 void spin_lock(spinlock_t* lock) {
-    while (__sync_lock_test_and_set(&lock->lock, 1)) {
-        while (lock->lock) cpu_relax();
+#ifdef __x86_64__
+    if (lock->elide && elide_on && elide_lock(lock)) return;
+#endif
+    if (!__sync_lock_test_and_set(&lock->lock, 1)) {
+        STAT_HIT(lock, 0, 0);
+        return;
     }
+    u32 t0 = STAT_CLOCK();
+    do {
+        while (lock->lock) cpu_relax();
+    } while (__sync_lock_test_and_set(&lock->lock, 1));
+    STAT_HIT(lock, 1, t0);
 }
 
 void spin_unlock(spinlock_t* lock) {
+#ifdef __x86_64__
+    // held, yet the word reads free: we are the transaction
+    if (lock->elide && elide_on && !lock->lock) {
+        xend();
+        STAT_ADD(lock, elided);
+        return;
+    }
+#endif
     __sync_lock_release(&lock->lock);
 }
 
+// kernel-priority mask: control ISRs stay live across scheduler locks
 void spin_lock_irq(spinlock_t* lock) {
 #ifdef __x86_64__
     __asm__ volatile("cli");
+#elif defined(IRQ_HAVE_BASEPRI)
+    (void)irq_save_kernel();
 #elif defined(__arm__)
     __asm__ volatile("cpsid i");
 #endif
@@ -36,7 +165,137 @@ void spin_unlock_irq(spinlock_t* lock) {
     spin_unlock(lock);
 #ifdef __x86_64__
     __asm__ volatile("sti");
+#elif defined(IRQ_HAVE_BASEPRI)
+    irq_restore_kernel(0);
 #elif defined(__arm__)
     __asm__ volatile("cpsie i");
 #endif
 }
+
+u32 spin_lock_irqsave(spinlock_t* lock) {
+    u32 flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t* lock, u32 flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+u32 spin_lock_irqsave_kernel(spinlock_t* lock) {
+    u32 flags = irq_save_kernel();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore_kernel(spinlock_t* lock, u32 flags) {
+    spin_unlock(lock);
+    irq_restore_kernel(flags);
+}
+
+/* ---------- ticket locks ---------- */
+
+void ticket_lock(ticket_lock_t* lock) {
+    u32 me = __sync_fetch_and_add(&lock->next, 1);
+    if (atomic_load_acq(&lock->owner) == me) {
+        STAT_HIT(lock, 0, 0);
+        return;
+    }
+    u32 t0 = STAT_CLOCK();
+    while (atomic_load_acq(&lock->owner) != me) cpu_relax();
+    STAT_HIT(lock, 1, t0);
+}
+
+void ticket_unlock(ticket_lock_t* lock) {
+    atomic_store_rel(&lock->owner, lock->owner + 1);
+}
+
+// take the next ticket only if it is served right away
+u8 ticket_trylock(ticket_lock_t* lock) {
+    u32 owner = atomic_load_acq(&lock->owner);
+    u32 expect = owner;
+    if (!atomic_cas_u32(&lock->next, &expect, owner + 1)) return 0;
+    STAT_HIT(lock, 0, 0);
+    return 1;
+}
+
+/* ---------- MCS queue locks ---------- */
+
+void mcs_lock(mcs_lock_t* lock, mcs_node_t* node) {
+    node->next = 0;
+    node->locked = 1;
+    mcs_node_t* prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    if (!prev) {
+        STAT_HIT(lock, 0, 0);
+        return;
+    }
+    u32 t0 = STAT_CLOCK();
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+    while (atomic_load_acq(&node->locked)) cpu_relax();    // our own line
+    STAT_HIT(lock, 1, t0);
+}
+
+void mcs_unlock(mcs_lock_t* lock, mcs_node_t* node) {
+    mcs_node_t* next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if (!next) {
+        mcs_node_t* expect = node;
+        if (__atomic_compare_exchange_n(&lock->tail, &expect, 0, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;     // nobody behind us
+        }
+        // a waiter swapped itself in but has not linked to us yet
+        while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) cpu_relax();
+    }
+    atomic_store_rel(&next->locked, 0);
+}
+
+/* ---------- statistics ---------- */
+
+void lock_stat_register(lock_stat_t* stat, const char* name) {
+#if LOCK_STATS
+    u8 listed = stat->name != 0;
+    stat->name = name;
+    if (listed) return;
+#ifdef HAVE_DWT
+    *(volatile u32*)0xE000EDFC |= (1 << 24);   // DEMCR.TRCENA
+    *(volatile u32*)0xE0001000 |= 1;           // DWT_CTRL.CYCCNTENA
+#endif
+    lock_stat_t* head;
+    do {
+        head = stat_list;
+        stat->next = head;
+    } while (!__sync_bool_compare_and_swap(&stat_list, head, stat));
+#else
+    (void)stat;
+    (void)name;
+#endif
+}
+
+// counters are read unlocked: a line may be one acquisition stale
+void lock_stats_dump(void) {
+#if LOCK_STATS
+    for (lock_stat_t* s = stat_list; s; s = s->next) {
+        kprintf("LOCK name=%s acq=%d contended=%d max_spin=%d",
+                s->name, s->acquired, s->contended, s->max_spin);
+        u32 tries = s->elided + s->elide_fallbacks;
+        if (tries) {
+            kprintf(" elided=%d fallback=%d aborts=%d elide_pct=%d",
+                    s->elided, s->elide_fallbacks, s->elide_aborts,
+                    s->elided * 100 / tries);
+        }
+        kprintf("\r\n");
+    }
+#else
+    kprintf("LOCK stats off, build with LOCK_STATS=1\r\n");
+#endif
+}
+
+void lock_stats_reset(void) {
+#if LOCK_STATS
+    for (lock_stat_t* s = stat_list; s; s = s->next) {
+        s->acquired = s->contended = s->max_spin = 0;
+        s->elided = s->elide_fallbacks = s->elide_aborts = 0;
+    }
+#endif
+}
@@ -1,21 +1,43 @@
 /*
- * timer.c - 1 ms tick source with critical sections
+ * timer.c - 1 ms tick source with critical sections and tickless idle
+ *
+ * timer_idle() is called by the idle task. With TICKLESS_IDLE it asks
+ * the scheduler how far off the next sleeper is, turns the periodic
+ * tick into a single wake-up at that deadline, sleeps the core and
+ * credits the skipped ticks on the way out. Any other interrupt ends
+ * the sleep early; the credit is then whatever time really passed.
+ * On x86 the wake-up is an hrtimer, so it shares the one compare unit
+ * with every other one-shot timer instead of fighting over it.
  */
 
 #include "kernel/timer.h"
+#include "kernel/clocksource.h"
+#include "kernel/hrtimer.h"
 #include "kernel/types.h"
 #include "kernel/spinlock.h"
+#include "kernel/sched.h"
+#include "kernel/smp.h"
 #include "uart.h"
 
 static volatile u32 system_ticks = 0;
+static volatile u32 tick_irqs = 0;      // tick interrupts actually taken
 static spinlock_t tick_lock = {0};
 
+u32 timer_irq_count(void) {
+    return tick_irqs;
+}
+
 #ifdef __x86_64__
 /* x86 PIT timer driver */
 extern void pit_init(u32 frequency);
 extern u32 pit_get_ticks(void);
+extern void pit_add_ticks(u32 n);
 extern void pit_delay(u32 ms);
 extern void pit_irq_handler(void);
+extern void pic_enable_irq(u8 irq);
+extern void pic_disable_irq(u8 irq);
+
+#define IDLE_MAX_TICKS   1000
 
 void timer_init(void) {
     pit_init(1000);
@@ -31,7 +53,61 @@ void timer_delay(u32 ms) {
 }
 
 void timer_irq_handler(void) {
+    tick_irqs++;
     pit_irq_handler();
+    clocksource_update();
+    hrtimer_tick();
+    sched_tick(pit_get_ticks());
+}
+
+// the wake-up is the IRQ itself; timer_idle() does the bookkeeping
+static void idle_wake_fn(hrtimer_t* t) {
+    (void)t;
+}
+
+static hrtimer_t idle_wake = { .fn = idle_wake_fn, .index = HRTIMER_IDLE };
+
+void timer_idle(void) {
+    __asm__ volatile("cli");
+    u32 n = sched_next_wake();
+    if (n == 0) {
+        __asm__ volatile("sti");
+        return;
+    }
+
+    if (smp_cpu_id() != 0) {
+        __asm__ volatile("sti; hlt");   // no tick here: resched IPI wakes us
+        return;
+    }
+    if (!TICKLESS_IDLE || n < 2 || hrtimer_hw() == HRTIMER_HW_NONE) {
+        __asm__ volatile("sti; hlt");   // next tick wakes us
+        return;
+    }
+    if (n > IDLE_MAX_TICKS) n = IDLE_MAX_TICKS;
+
+    u64 t0 = clock_now_ns();
+    u32 before = pit_get_ticks();
+
+    pic_disable_irq(0);
+    if (!hrtimer_start(&idle_wake, t0 + (u64)n * 1000000)) {
+        pic_enable_irq(0);
+        __asm__ volatile("sti; hlt");
+        return;
+    }
+
+    // sti shadow covers hlt, so the wake IRQ can't slip in between
+    __asm__ volatile("sti; hlt");
+    __asm__ volatile("cli");
+
+    hrtimer_cancel(&idle_wake);
+    u32 elapsed = (u32)((clock_now_ns() - t0) / 1000000);
+    u32 seen = pit_get_ticks() - before;
+    if (elapsed > seen) pit_add_ticks(elapsed - seen);
+
+    pic_enable_irq(0);
+    clocksource_update();
+    sched_tick(pit_get_ticks());
+    __asm__ volatile("sti");
 }
 
 #elif defined(__arm__)
@@ -40,8 +116,14 @@ void timer_irq_handler(void) {
 #define SYSTICK_LOAD   (*(volatile u32*)(SYSTICK_BASE + 0x04))
 #define SYSTICK_VAL    (*(volatile u32*)(SYSTICK_BASE + 0x08))
 
+#define SYSTICK_ENABLE     (1<<0)
+#define SYSTICK_COUNTFLAG  (1<<16)     // cleared by reading CTRL
+#define SYSTICK_TICK_CYCLES 10500
+#define SYSTICK_MAX_TICKS  (0x00FFFFFF / SYSTICK_TICK_CYCLES)
+#define SYSTICK_MIN_CYCLES 64          // shortest period timer_idle() reloads by hand
+
 void timer_init(void) {
-    SYSTICK_LOAD = 10500 - 1;
+    SYSTICK_LOAD = SYSTICK_TICK_CYCLES - 1;
     SYSTICK_VAL = 0;
     SYSTICK_CTRL = (1<<0) | (1<<1) | (1<<2);
 
@@ -58,16 +140,78 @@ u32 timer_ticks(void) {
 
 void timer_delay(u32 ms) {
     u32 end = timer_ticks() + ms;
-    while (timer_ticks() < end);
+    while ((s32)(timer_ticks() - end) < 0);     // survives the 49-day wrap
 }
 
 void SysTick_Handler(void) {
+    tick_irqs++;
     __sync_fetch_and_add(&system_ticks, 1);
+    clocksource_update();
+    hrtimer_tick();
+    sched_tick(system_ticks);
     if (system_ticks % 100 == 0) {
         *(volatile u32*)0xE000ED04 = (1<<28);  // PendSV
     }
 }
 
+void timer_idle(void) {
+    // masked: a pending IRQ still ends WFI but runs only after we fix up
+    __asm__ volatile("cpsid i");
+    u32 n = sched_next_wake();
+    if (n == 0) {
+        __asm__ volatile("cpsie i");
+        return;
+    }
+    if (!TICKLESS_IDLE || n < 2) {
+        __asm__ volatile("dsb\n wfi\n isb\n cpsie i");
+        return;
+    }
+    if (n > SYSTICK_MAX_TICKS) n = SYSTICK_MAX_TICKS;
+
+    // finish the current period, then n-1 more in one go
+    SYSTICK_CTRL &= ~SYSTICK_ENABLE;
+    u32 val0 = SYSTICK_VAL;             // to the next tick boundary
+    u32 reload = val0 + (n - 1) * SYSTICK_TICK_CYCLES;
+    SYSTICK_LOAD = reload;
+    SYSTICK_VAL = 0;
+    SYSTICK_CTRL |= SYSTICK_ENABLE;
+
+    __asm__ volatile("dsb\n wfi\n isb");
+
+    u32 ctrl = SYSTICK_CTRL;
+    SYSTICK_CTRL = ctrl & ~SYSTICK_ENABLE;
+    u32 elapsed = reload - SYSTICK_VAL;
+    u32 done, rem;                      // ticks passed, cycles to the next
+    if (ctrl & SYSTICK_COUNTFLAG) {
+        // deadline reached; the pending SysTick adds the last tick.
+        // elapsed is what ran on past it
+        done = n - 1;
+        rem = SYSTICK_TICK_CYCLES - elapsed;
+    } else if (elapsed < val0) {
+        done = 0;
+        rem = val0 - elapsed;
+    } else {
+        done = 1 + (elapsed - val0) / SYSTICK_TICK_CYCLES;
+        rem = SYSTICK_TICK_CYCLES - (elapsed - val0) % SYSTICK_TICK_CYCLES;
+    }
+    if (rem < SYSTICK_MIN_CYCLES || rem > SYSTICK_TICK_CYCLES) {
+        // too close to reload by hand: take the boundary now
+        if (!(ctrl & SYSTICK_COUNTFLAG)) done++;
+        rem = SYSTICK_TICK_CYCLES;
+    }
+    system_ticks += done;
+    clocksource_update();
+
+    // rest of the current period, then full ones again
+    SYSTICK_LOAD = rem - 1;
+    SYSTICK_VAL = 0;
+    SYSTICK_CTRL = ctrl | SYSTICK_ENABLE;
+    while (!SYSTICK_VAL);               // rem - 1 is in the counter
+    SYSTICK_LOAD = SYSTICK_TICK_CYCLES - 1;
+    if (done && !(ctrl & SYSTICK_COUNTFLAG)) sched_tick(system_ticks);
+    __asm__ volatile("cpsie i");
+}
+
 #elif defined(__AVR_ARCH__)
 // AVR timer
 extern void timer_init(void);
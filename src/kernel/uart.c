@@ -1,20 +1,162 @@
 /*
- * uart.c - COM1 (0x3F8) for x86, USART1 for STM32F4
+ * uart.c - console TX ring (see uart.h); COM1 (0x3F8) for x86,
+ * USART1 for STM32F4 (__STM32F4__); other ports bring their own uart*.c
+ *
+ * Writers copy into the ring under tx_lock; the port takes bytes off
+ * the tail under tx_cons_lock, so a writer never waits on the port
+ * and an ISR never waits on a writer. head and tail run free. A task
+ * that finds the ring full sleeps on tx_wq with the lock dropped, so
+ * its message may interleave with another writer's from there on.
  */
 
 #include "kernel/uart.h"
 #include "kernel/types.h"
+#include "kernel/ring.h"
+#include "kernel/atomic.h"
+#include "kernel/spinlock.h"
+#include "kernel/sched.h"
+#include "kernel/irq.h"
+#include "string.h"
+
+static u8 tx_buf[UART_TX_DEPTH];
+static volatile u32 tx_head;        // writers, under tx_lock
+static volatile u32 tx_tail;        // port, under tx_cons_lock
+static volatile u32 tx_dropped;
+static spinlock_t tx_lock = {0};
+static spinlock_t tx_cons_lock = {0};
+static wait_queue_t tx_wq;          // tasks waiting for room
+static volatile u32 tx_waiters;
+
+#define UART_TX_WAIT_MS 10          // then push the port along by hand
+
+/* ---------- consumer side, for the port ---------- */
+
+u32 uart_tx_begin(void) {
+    return spin_lock_irqsave_kernel(&tx_cons_lock);
+}
+
+void uart_tx_end(u32 flags) {
+    spin_unlock_irqrestore_kernel(&tx_cons_lock, flags);
+}
+
+u32 uart_tx_chunk(const u8** p) {
+    u32 tail = tx_tail;
+    u32 n = atomic_load_acq(&tx_head) - tail;
+    u32 off = tail & (UART_TX_DEPTH - 1);
+    if (n > UART_TX_DEPTH - off) n = UART_TX_DEPTH - off;   // up to the wrap
+    *p = &tx_buf[off];
+    return n;
+}
+
+void uart_tx_consume(u32 n) {
+    atomic_store_rel(&tx_tail, tx_tail + n);
+    __sync_synchronize();           // tail before waiters; tx_wait_room() does the reverse
+    if (tx_waiters) wq_wake_all(&tx_wq);
+}
+
+void uart_tx_drain(void) {
+    u32 flags = uart_tx_begin();
+    const u8* p;
+    u32 n;
+    while ((n = uart_tx_chunk(&p))) {
+        for (u32 i = 0; i < n; i++) uart_hw_putc((char)p[i]);
+        uart_tx_consume(n);
+    }
+    uart_tx_end(flags);
+}
+
+/* ---------- writers ---------- */
+
+static u8 tx_full(void) {
+    return atomic_load_acq(&tx_head) - atomic_load_acq(&tx_tail) == UART_TX_DEPTH;
+}
+
+// called without tx_lock and with IRQs as the writer had them
+static void tx_wait_room(void) {
+    uart_hw_tx_start();
+    if (!task_current() || !irq_can_sleep()) {
+        uart_hw_tx_poll();          // ISR, boot or masked: nothing else will
+        return;
+    }
+    __atomic_fetch_add(&tx_waiters, 1, __ATOMIC_SEQ_CST);
+    u32 snap = wq_prepare(&tx_wq);
+    if (tx_full() && !wq_wait(&tx_wq, snap, UART_TX_WAIT_MS)) uart_hw_tx_poll();
+    __atomic_fetch_sub(&tx_waiters, 1, __ATOMIC_RELAXED);
+}
+
+u32 uart_write(const void* buf, u32 len, u8 policy) {
+    const u8* s = buf;
+    u32 done = 0;
+
+    u32 flags = spin_lock_irqsave_kernel(&tx_lock);
+    while (done < len) {
+        u32 head = tx_head;
+        u32 room = UART_TX_DEPTH - (head - atomic_load_acq(&tx_tail));
+        if (!room) {
+            if (policy == UART_TX_DROP) break;
+            spin_unlock_irqrestore_kernel(&tx_lock, flags);
+            tx_wait_room();
+            flags = spin_lock_irqsave_kernel(&tx_lock);
+            continue;
+        }
+        u32 off = head & (UART_TX_DEPTH - 1);
+        u32 n = len - done;
+        if (n > room) n = room;
+        if (n > UART_TX_DEPTH - off) n = UART_TX_DEPTH - off;
+        memcpy(&tx_buf[off], s + done, n);
+        atomic_store_rel(&tx_head, head + n);
+        done += n;
+    }
+    spin_unlock_irqrestore_kernel(&tx_lock, flags);
+
+    if (done < len) __atomic_fetch_add(&tx_dropped, len - done, __ATOMIC_RELAXED);
+    if (done) uart_hw_tx_start();
+    return done;
+}
+
+void uart_putc(char c) {
+    uart_write(&c, 1, UART_TX_BLOCK);
+}
+
+void uart_puts(const char* s) {
+    uart_write(s, strlen(s), UART_TX_BLOCK);
+}
+
+void uart_flush(void) {
+    while (atomic_load_acq(&tx_tail) != atomic_load_acq(&tx_head)) uart_hw_tx_poll();
+}
+
+u32 uart_tx_dropped(void) {
+    return tx_dropped;
+}
+
+void uart_hex(u32 val) {
+    const char hex[] = "0123456789ABCDEF";
+    char buf[10] = { '0', 'x' };
+    for (int i = 0; i < 8; i++) {
+        buf[2 + i] = hex[(val >> (28 - 4 * i)) & 0xF];
+    }
+    uart_write(buf, sizeof(buf), UART_TX_BLOCK);
+}
 
 #ifdef __x86_64__            // actually i686, but gcc sets this
 #define UART_BASE 0x3F8
 #define UART_REG(r) (UART_BASE + (r))
+#define UART_IER        1
+#define UART_LSR        5
+#define IER_RX          0x01
+#define IER_THRE        0x02
+#define LSR_THRE        0x20    // TX FIFO empty (FIFO mode)
+#define UART_FIFO_DEPTH 16
 
 static void uart_write_reg(u16 reg, u8 val) {
-    *(volatile u8*)UART_REG(reg) = val;
+    __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"((u16)UART_REG(reg)));
 }
 
 static u8 uart_read_reg(u16 reg) {
-    return *(volatile u8*)UART_REG(reg);
+    u8 val;
+    __asm__ volatile("inb %1, %0" : "=a"(val) : "Nd"((u16)UART_REG(reg)));
+    return val;
 }
 
 void uart_early_init(void) {
@@ -25,14 +167,60 @@ void uart_early_init(void) {
     uart_write_reg(2, 0xC7);   // FIFO
 }
 
-void uart_putc(char c) {
-    while (!(uart_read_reg(5) & 0x20));
+void uart_hw_putc(char c) {
+    while (!(uart_read_reg(UART_LSR) & LSR_THRE));
     uart_write_reg(0, c);
 }
 
-#elif defined(__arm__)       // ARM Cortex-M4
+// refill the FIFO once it is empty; caller holds the consumer side
+static u8 tx_pump(void) {
+    if (!(uart_read_reg(UART_LSR) & LSR_THRE)) return 1;
+    const u8* p;
+    u32 sent = 0, n;
+    while (sent < UART_FIFO_DEPTH && (n = uart_tx_chunk(&p))) {
+        if (n > UART_FIFO_DEPTH - sent) n = UART_FIFO_DEPTH - sent;
+        for (u32 i = 0; i < n; i++) uart_write_reg(0, p[i]);
+        uart_tx_consume(n);
+        sent += n;
+    }
+    return uart_tx_chunk(&p) != 0;
+}
+
+void uart_hw_tx_start(void) {
+    // IRQ4 is live once drivers/serial.c has set up COM1; polled until then
+    if (!(uart_read_reg(UART_IER) & IER_RX)) {
+        uart_tx_drain();
+        return;
+    }
+    u32 flags = uart_tx_begin();
+    if (tx_pump()) uart_write_reg(UART_IER, uart_read_reg(UART_IER) | IER_THRE);
+    uart_tx_end(flags);
+}
+
+void uart_hw_tx_poll(void) {
+    u32 flags = uart_tx_begin();
+    tx_pump();
+    uart_tx_end(flags);
+}
+
+// COM1 THRE interrupt, from serial_irq_handler(0)
+void uart_tx_irq(void) {
+    u32 flags = uart_tx_begin();
+    if (!tx_pump()) uart_write_reg(UART_IER, uart_read_reg(UART_IER) & ~IER_THRE);
+    uart_tx_end(flags);
+}
+
+// COM1 RX is interrupt driven in drivers/serial.c (IRQ4)
+s32 uart_getc(void) {
+    extern u8 serial_available(u8 port);
+    extern u8 serial_getc(u8 port);
+    return serial_available(0) ? serial_getc(0) : -1;
+}
+
+#elif defined(__STM32F4__)   // ARM Cortex-M4, USART1
 #define USART1_BASE 0x40011000
 #define RCC_BASE    0x40023800
+#define DMA2_BASE   0x40026400
 
 #define RCC_AHB1ENR   (*(volatile u32*)(RCC_BASE + 0x30))
 #define RCC_APB2ENR   (*(volatile u32*)(RCC_BASE + 0x44))
@@ -40,30 +228,106 @@ void uart_putc(char c) {
 #define USART1_DR     (*(volatile u32*)(USART1_BASE + 0x04))
 #define USART1_BRR    (*(volatile u32*)(USART1_BASE + 0x08))
 #define USART1_CR1    (*(volatile u32*)(USART1_BASE + 0x0C))
+#define USART1_CR3    (*(volatile u32*)(USART1_BASE + 0x14))
+#define NVIC_ISER1    (*(volatile u32*)0xE000E104)
+#define NVIC_ISER2    (*(volatile u32*)0xE000E108)
+#define UART_RX_DEPTH 64
+
+// USART1_TX is DMA2 stream 7, channel 4
+#define DMA2_HISR     (*(volatile u32*)(DMA2_BASE + 0x04))
+#define DMA2_HIFCR    (*(volatile u32*)(DMA2_BASE + 0x0C))
+#define DMA2_S7CR     (*(volatile u32*)(DMA2_BASE + 0xB8))
+#define DMA2_S7NDTR   (*(volatile u32*)(DMA2_BASE + 0xBC))
+#define DMA2_S7PAR    (*(volatile u32*)(DMA2_BASE + 0xC0))
+#define DMA2_S7M0AR   (*(volatile u32*)(DMA2_BASE + 0xC4))
+#define DMA_S7_TCIF   (1<<27)
+#define DMA_S7_FLAGS  0x0F400000    // TC, HT, TE, DME, FE
+#define DMA_SxCR_TX   ((4<<25) | (1<<10) | (1<<6) | (1<<4))  // ch4, MINC, mem->periph, TCIE
+
+// USART1 ISR -> reader task
+SPSC_RING_DEFINE(uart_rx, u8, UART_RX_DEPTH);
+static volatile u32 uart_rx_dropped;
+static u32 dma_len;             // bytes in flight, under the consumer side
 
 void uart_early_init(void) {
-    RCC_AHB1ENR |= (1<<0);   // GPIOA clock
+    RCC_AHB1ENR |= (1<<0) | (1<<22);    // GPIOA, DMA2 clocks
     RCC_APB2ENR |= (1<<4);   // USART1 clock
-    
+
     USART1_BRR = 0x0683;     // 84MHz/115200 = 0x0683
-    USART1_CR1 = (1<<13) | (1<<3) | (1<<2);  // UE, TE, RE
+    spsc_init(&uart_rx);
+    USART1_CR3 = (1<<7);     // DMAT
+    DMA2_S7PAR = USART1_BASE + 0x04;
+    USART1_CR1 = (1<<13) | (1<<5) | (1<<3) | (1<<2);  // UE, RXNEIE, TE, RE
+    NVIC_ISER1 |= (1<<5);    // USART1 = IRQ37
+    NVIC_ISER2 |= (1<<6);    // DMA2 stream 7 = IRQ70
 }
 
-void uart_putc(char c) {
+void uart_hw_putc(char c) {
     while (!(USART1_SR & (1<<7)));   // TXE
     USART1_DR = c;
 }
 
-#endif
+// retire the finished transfer, start the next; consumer side held
+static void tx_pump(void) {
+    if (dma_len) {
+        if (!(DMA2_HISR & DMA_S7_TCIF)) return;     // still sending
+        DMA2_HIFCR = DMA_S7_FLAGS;  // or TCIF7 re-raises the IRQ forever
+        uart_tx_consume(dma_len);
+        dma_len = 0;
+    }
+    const u8* p;
+    u32 n = uart_tx_chunk(&p);
+    if (!n) return;
+    DMA2_HIFCR = DMA_S7_FLAGS;      // the stream won't start with any set
+    DMA2_S7M0AR = (u32)p;
+    DMA2_S7NDTR = n;
+    dma_len = n;
+    DMA2_S7CR = DMA_SxCR_TX | (1<<0);   // EN
+}
 
-void uart_puts(const char* s) {
-    while (*s) uart_putc(*s++);
+void uart_hw_tx_start(void) {
+    u32 flags = uart_tx_begin();
+    tx_pump();
+    uart_tx_end(flags);
 }
 
-void uart_hex(u32 val) {
-    const char hex[] = "0123456789ABCDEF";
-    uart_puts("0x");
-    for (int i = 28; i >= 0; i -= 4) {
-        uart_putc(hex[(val >> i) & 0xF]);
+void uart_hw_tx_poll(void) {
+    uart_hw_tx_start();
+}
+
+void DMA2_Stream7_IRQHandler(void) {
+    uart_hw_tx_start();
+}
+
+s32 uart_getc(void) {
+    u8 c;
+    return spsc_pop(&uart_rx, &c) ? c : -1;
+}
+
+void USART1_IRQHandler(void) {
+    while (USART1_SR & (1<<5)) {     // RXNE; reading DR clears it
+        u8 c = (u8)USART1_DR;
+        if (!spsc_push(&uart_rx, &c)) uart_rx_dropped++;
     }
 }
+
+#else
+// arch/*/uart*.c ports without a TX interrupt: send it all now
+__attribute__((weak)) void uart_hw_tx_start(void) {
+    uart_tx_drain();
+}
+
+__attribute__((weak)) void uart_hw_tx_poll(void) {
+    uart_tx_drain();
+}
+
+// no RX path in the ports yet
+__attribute__((weak)) s32 uart_getc(void) {
+    return -1;
+}
+
+// a port with no console driver at all (TMS570) links and stays quiet
+__attribute__((weak)) void uart_early_init(void) { }
+__attribute__((weak)) void uart_hw_putc(char c) { (void)c; }
+
+#endif
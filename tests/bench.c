@@ -0,0 +1,102 @@
+/*
+ * bench.c - sample buffer, percentiles and the suite runner
+ * Built into build/bench.elf by make ARCH=x86 bench; main.c starts
+ * bench_task() instead of the demo tasks when BLOOD_BENCH is defined.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/smp.h"
+#include "kernel/spinlock.h"
+#include "kernel/kprintf.h"
+#include "bench.h"
+
+#ifdef __x86_64__
+u8 bench_rdtscp;
+#endif
+
+static u32 samples[BENCH_SAMPLES];
+static u32 nsamples;
+static u32 overhead;
+
+void bench_init(void) {
+#ifdef __x86_64__
+    bench_rdtscp = timing_sync_is_rdtscp_supported();
+#elif defined(__arm__)
+    *(volatile u32*)0xE000EDFC |= (1 << 24);   // DEMCR.TRCENA
+    *(volatile u32*)0xE0001000 |= 1;           // DWT_CTRL.CYCCNTENA
+#endif
+    overhead = 0xFFFFFFFF;
+    for (u32 i = 0; i < 64; i++) {
+        u32 t0 = bench_cycles();
+        u32 d = bench_cycles() - t0;
+        if (d < overhead) overhead = d;
+    }
+}
+
+void bench_begin(void) {
+    nsamples = 0;
+}
+
+void bench_sample(u32 cycles) {
+    if (nsamples >= BENCH_SAMPLES) return;
+    samples[nsamples++] = cycles > overhead ? cycles - overhead : 0;
+}
+
+// shell sort: no recursion, fine on a 256 B task stack
+static void sort_samples(void) {
+    for (u32 gap = nsamples / 2; gap; gap /= 2) {
+        for (u32 i = gap; i < nsamples; i++) {
+            u32 v = samples[i];
+            u32 j = i;
+            for (; j >= gap && samples[j - gap] > v; j -= gap) samples[j] = samples[j - gap];
+            samples[j] = v;
+        }
+    }
+}
+
+void bench_report(const char* name, const char* key, u32 val) {
+    kprintf("BENCH name=%s ", name);
+    if (key) kprintf("%s=%d ", key, val);
+    if (!nsamples) {
+        kprintf("n=0\r\n");
+        return;
+    }
+
+    sort_samples();
+    u32 p99 = (nsamples * 99 + 99) / 100 - 1;
+    kprintf("n=%d min=%d median=%d p99=%d max=%d\r\n", nsamples, samples[0],
+            samples[nsamples / 2], samples[p99], samples[nsamples - 1]);
+}
+
+void bench_skip(const char* name, const char* why) {
+    kprintf("BENCH name=%s skipped=%s\r\n", name, why);
+}
+
+void bench_exit(void) {
+#ifdef __x86_64__
+    // QEMU isa-debug-exit (see make bench); a plain port write elsewhere
+    __asm__ volatile("outb %0, %1" : : "a"((u8)0), "Nd"((u16)0xF4));
+#endif
+}
+
+void bench_task(void) {
+    bench_init();
+#ifdef __x86_64__
+    kprintf("BENCH_START cpus=%d tsc_khz=%d rdtscp=%d overhead=%d\r\n",
+            smp_num_cpus(), (u32)(timing_sync_get_tsc_frequency() / 1000),
+            bench_rdtscp, overhead);
+#else
+    kprintf("BENCH_START cpus=%d overhead=%d\r\n", smp_num_cpus(), overhead);
+#endif
+
+    sched_bench_run();
+    ipc_bench_run();
+    hw_bench_run();
+    smp_bench_run();
+
+    lock_stats_dump();
+    kprintf("BENCH_END\r\n");
+    bench_exit();
+    task_exit();
+}
@@ -0,0 +1,54 @@
+/*
+ * bench.h - shared harness for the make bench suite
+ * Each benchmark collects up to BENCH_SAMPLES cycle counts and reports
+ * one serial line:
+ *   BENCH name=<n> [<key>=<v>] n=<count> min=<c> median=<c> p99=<c> max=<c>
+ * Counts are cycles with the timer read overhead already taken off.
+ */
+
+#ifndef _BLOOD_BENCH_H
+#define _BLOOD_BENCH_H
+
+#include "kernel/types.h"
+
+#define BENCH_SAMPLES 1024
+#define BENCH_CPU_MASK 1u     // the suite and its workers stay on CPU 0
+
+#ifdef __x86_64__
+#include "drivers/timing_sync.h"
+
+extern u8 bench_rdtscp;
+
+// rdtscp waits for older instructions; plain rdtsc may read early
+static inline u32 bench_cycles(void) {
+    if (bench_rdtscp) {
+        u32 lo, hi, aux;
+        __asm__ volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux) : : "memory");
+        return lo;
+    }
+    return (u32)timing_sync_get_tsc();
+}
+#elif defined(__arm__)
+static inline u32 bench_cycles(void) {
+    return *(volatile u32*)0xE0001004;   // DWT_CYCCNT
+}
+#else
+static inline u32 bench_cycles(void) {
+    return 0;
+}
+#endif
+
+void bench_init(void);          // cycle counter + read overhead
+void bench_begin(void);         // drop samples of the previous run
+void bench_sample(u32 cycles);
+void bench_report(const char* name, const char* key, u32 val);
+void bench_skip(const char* name, const char* why);
+void bench_exit(void);          // end of suite: leave QEMU if we can
+
+// one per file, run in order by bench_task()
+void sched_bench_run(void);
+void ipc_bench_run(void);
+void hw_bench_run(void);
+void smp_bench_run(void);
+
+#endif
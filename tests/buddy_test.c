@@ -0,0 +1,195 @@
+/*
+ * buddy_test.c - buddy allocator stress: random sizes, ns/op, fragmentation
+ * Runs on a private zone over a static arena so the result does not
+ * depend on what the rest of the system holds. Every live block is
+ * stamped page by page with its slot number; a stamp that changes means
+ * two live blocks overlapped. After freeing everything the zone must
+ * be back to the blocks it started with.
+ *
+ * Then one worker per CPU allocates and frees single pages in bursts,
+ * first straight from the zone under its lock, then through the
+ * per-CPU caches, and reports ns/op for each. Pages are stamped with
+ * the owning worker, so a page handed to two CPUs at once shows up.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/clocksource.h"
+#include "kernel/buddy.h"
+#include "kernel/smp.h"
+#include "kernel/kprintf.h"
+
+#ifdef __x86_64__
+#define BUDDY_PAGES 1024        // 4 MB arena
+#define BUDDY_SLOTS 128
+#define BUDDY_MAXRUN 37         // pages per request, not a power of two
+#define PCP_BURST 8             // pages each worker holds at once
+#define PCP_ROUNDS 2000
+#else
+#define BUDDY_PAGES 8
+#define BUDDY_SLOTS 8
+#define BUDDY_MAXRUN 3
+#define PCP_BURST 4
+#define PCP_ROUNDS 200
+#endif
+#define BUDDY_OPS 20000
+
+static u8 arena[BUDDY_PAGES * BUDDY_PAGE_SIZE] __attribute__((aligned(4096)));
+static u8 arena_meta[BUDDY_PAGES];
+static buddy_zone_t zone;
+static u32 slot_addr[BUDDY_SLOTS];
+static u32 slot_pages[BUDDY_SLOTS];
+static volatile u32 buddy_fails;
+static volatile u32 pcp_live;
+static volatile u8 pcp_cached;                 // 0: zone lock, 1: per-CPU cache
+static volatile u32 pcp_next_id;
+static volatile u32 pcp_ns[SMP_MAX_CPUS];
+
+static u32 rng = 0x2545F491;
+static u32 next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void stamp(u32 slot, u32 tag) {
+    for (u32 p = 0; p < slot_pages[slot]; p++) {
+        *(volatile u32*)(slot_addr[slot] + p * BUDDY_PAGE_SIZE + 8) = tag;
+    }
+}
+
+static void check(u32 slot) {
+    for (u32 p = 0; p < slot_pages[slot]; p++) {
+        if (*(volatile u32*)(slot_addr[slot] + p * BUDDY_PAGE_SIZE + 8) != slot + 1) {
+            buddy_fails++;
+        }
+    }
+}
+
+static u64 elapsed_ns(u64 t0) {
+    return clock_now_ns() - t0;
+}
+
+static void pcp_worker(void) {
+    u32 id = __sync_fetch_and_add(&pcp_next_id, 1);
+    u32 pages[PCP_BURST];
+    u64 t0 = clock_now_ns();
+
+    for (u32 r = 0; r < PCP_ROUNDS; r++) {
+        for (u32 j = 0; j < PCP_BURST; j++) {
+            pages[j] = pcp_cached ? buddy_alloc_page(&zone) : buddy_alloc(&zone, 0);
+            if (pages[j]) *(volatile u32*)(pages[j] + 8) = id;
+            else __sync_fetch_and_add(&buddy_fails, 1);
+        }
+        for (u32 j = 0; j < PCP_BURST; j++) {
+            if (!pages[j]) continue;
+            if (*(volatile u32*)(pages[j] + 8) != id) __sync_fetch_and_add(&buddy_fails, 1);
+            if (pcp_cached) buddy_free_page(&zone, pages[j]);
+            else buddy_free(&zone, pages[j], 0);
+        }
+        if (r % 64 == 0) task_yield();
+    }
+    pcp_ns[id] = (u32)(elapsed_ns(t0) / (2 * PCP_ROUNDS * PCP_BURST));
+    buddy_drain(&zone);         // only the owner may empty its cache
+    __sync_fetch_and_sub(&pcp_live, 1);
+    task_exit();
+}
+
+// worst per-worker ns/op over one run on every CPU
+static u32 pcp_run(u8 cached, u32 cpus) {
+    pcp_cached = cached;
+    pcp_next_id = 0;
+    pcp_live = cpus;
+    for (u32 c = 0; c < cpus; c++) {
+        task_create_affinity(pcp_worker, 0, 512, SCHED_PRIO_DEFAULT - 1, 1u << c);
+    }
+    while (pcp_live) task_yield();
+
+    u32 worst = 0;
+    for (u32 c = 0; c < cpus; c++) {
+        if (pcp_ns[c] > worst) worst = pcp_ns[c];
+    }
+    return worst;
+}
+
+// free memory not in the largest block, in percent
+static u32 frag_pct(void) {
+    if (!zone.free_pages) return 0;
+    return 100 - buddy_largest_free(&zone) * 100 / zone.free_pages;
+}
+
+void buddy_test_task(void) {
+    // start one page in, so the top half of the arena is one odd run
+    buddy_init(&zone, (u32)arena, BUDDY_PAGES, arena_meta);
+    buddy_add_range(&zone, (u32)arena + BUDDY_PAGE_SIZE, (BUDDY_PAGES - 1) * BUDDY_PAGE_SIZE);
+    u32 start_free = zone.free_pages;
+    u32 start_largest = buddy_largest_free(&zone);
+    if (start_free != BUDDY_PAGES - 1) buddy_fails++;
+
+    // exact sizes and alignment
+    u32 a = buddy_alloc(&zone, 2);
+    if (!a || ((a - (u32)arena) & (4 * BUDDY_PAGE_SIZE - 1))) buddy_fails++;
+    buddy_free(&zone, a, 2);
+    a = buddy_alloc_pages(&zone, 3);
+    if (!a || zone.free_pages != start_free - 3) buddy_fails++;
+    buddy_free_pages(&zone, a, 3);
+    if (zone.free_pages != start_free) buddy_fails++;
+
+    u32 ops = 0, failed = 0, peak_frag = 0;
+    u64 t0 = clock_now_ns();
+    for (u32 i = 0; i < BUDDY_OPS; i++) {
+        u32 slot = next_rand() % BUDDY_SLOTS;
+        if (slot_addr[slot]) {
+            check(slot);
+            buddy_free_pages(&zone, slot_addr[slot], slot_pages[slot]);
+            slot_addr[slot] = 0;
+        } else {
+            u32 n = 1 + next_rand() % BUDDY_MAXRUN;
+            u32 addr = buddy_alloc_pages(&zone, n);
+            if (!addr) {
+                failed++;
+            } else {
+                slot_addr[slot] = addr;
+                slot_pages[slot] = n;
+                stamp(slot, slot + 1);
+            }
+        }
+        ops++;
+        if ((i & 255) == 0) {
+            u32 f = frag_pct();
+            if (f > peak_frag) peak_frag = f;
+        }
+    }
+    u32 ns_per_op = (u32)(elapsed_ns(t0) / ops);
+    u32 end_frag = frag_pct();
+
+    for (u32 s = 0; s < BUDDY_SLOTS; s++) {
+        if (!slot_addr[s]) continue;
+        check(s);
+        buddy_free_pages(&zone, slot_addr[s], slot_pages[s]);
+        slot_addr[s] = 0;
+    }
+    // everything merged back
+    if (zone.free_pages != start_free) buddy_fails++;
+    if (buddy_largest_free(&zone) != start_largest) buddy_fails++;
+
+    u32 cpus = smp_num_cpus();
+    if (cpus > SMP_MAX_CPUS) cpus = SMP_MAX_CPUS;
+    u32 locked_ns = pcp_run(0, cpus);
+    u32 cached_ns = pcp_run(1, cpus);
+    u32 allocs = 0, hits = 0;
+    for (u32 c = 0; c < SMP_MAX_CPUS; c++) {
+        allocs += zone.pcp[c].allocs;
+        hits += zone.pcp[c].hits;
+    }
+    if (buddy_cached_pages(&zone) || zone.free_pages != start_free) buddy_fails++;
+    if (buddy_largest_free(&zone) != start_largest) buddy_fails++;
+
+    kprintf("buddy ops=%d ns_per_op=%d alloc_fail=%d frag_pct=%d peak_frag_pct=%d\r\n",
+            ops, ns_per_op, failed, end_frag, peak_frag);
+    kprintf("buddy pcp cpus=%d locked_ns_per_op=%d cached_ns_per_op=%d hit_pct=%d\r\n",
+            cpus, locked_ns, cached_ns, allocs ? hits * 100 / allocs : 0);
+    kprintf("buddy %s\r\n", buddy_fails ? "FAIL" : "PASS");
+    task_exit();
+}
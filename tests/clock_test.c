@@ -0,0 +1,64 @@
+/*
+ * clock_test.c - clock_now_ns(): monotonic, on rate, cheap
+ * One worker per CPU reads the clock back to back and must never see
+ * it step back, across tick updates included. Over a 200 ms sleep it
+ * must agree with the tick to within a tick plus 2%. Reports the
+ * source, its rate and the cost of one read.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/timer.h"
+#include "kernel/clocksource.h"
+#include "kernel/smp.h"
+#include "kernel/kprintf.h"
+
+#define CLOCK_READS 200000
+#define CLOCK_SLEEP 200         // ms
+
+static volatile u32 clock_fails;
+static volatile u32 clock_live;
+
+static void reader(void) {
+    u64 prev = clock_now_ns();
+    for (u32 i = 0; i < CLOCK_READS; i++) {
+        u64 now = clock_now_ns();
+        if (now < prev) __sync_fetch_and_add(&clock_fails, 1);
+        prev = now;
+        if (i % 4096 == 0) task_yield();
+    }
+    __sync_fetch_and_sub(&clock_live, 1);
+    task_exit();
+}
+
+void clock_test_task(void) {
+    if (!clocksource_hz() || !clock_now_ns()) clock_fails++;
+
+    u32 cpus = smp_num_cpus();
+    if (cpus > SMP_MAX_CPUS) cpus = SMP_MAX_CPUS;
+    clock_live = cpus;
+    for (u32 c = 0; c < cpus; c++) {
+        task_create_affinity(reader, 0, 256, SCHED_PRIO_DEFAULT - 1, 1u << c);
+    }
+    while (clock_live) task_yield();
+
+    // rate against the tick
+    u32 t0 = timer_ticks();
+    u64 n0 = clock_now_ns();
+    task_sleep(CLOCK_SLEEP);
+    u32 ticks = timer_ticks() - t0;
+    u32 ms = (u32)((clock_now_ns() - n0) / 1000000);
+    u32 slack = 1 + ticks / 50;
+    if (ms + slack < ticks || ms > ticks + slack) clock_fails++;
+
+    // cost of one read, timed by itself
+    n0 = clock_now_ns();
+    for (u32 i = 0; i < 1000; i++) (void)clock_now_ns();
+    u32 read_ns = (u32)((clock_now_ns() - n0) / 1000);
+
+    kprintf("clock src=%s khz=%d ms=%d ticks=%d read_ns=%d fails=%d\r\n",
+            clocksource_name(), (u32)(clocksource_hz() / 1000), ms, ticks,
+            read_ns, clock_fails);
+    kprintf("clock %s\r\n", clock_fails ? "FAIL" : "PASS");
+    task_exit();
+}
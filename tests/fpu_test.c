@@ -0,0 +1,95 @@
+/*
+ * fpu_test.c - lazy FPU/SIMD switching
+ * Two tasks keep a private pattern in a vector register across yields
+ * while a third never touches the FPU; patterns must survive, the
+ * integer-only task must not cost a save, and a fresh task must start
+ * from a clean register file.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/fpu.h"
+#include "kernel/kprintf.h"
+
+#define ROUNDS 1000
+
+static volatile u32 fpu_fails;
+static volatile u32 fpu_live;
+
+#ifdef __x86_64__
+static inline void reg_set(u32 v) {
+    __asm__ volatile("movd %0, %%xmm7\n pshufd $0, %%xmm7, %%xmm7" : : "r"(v));
+}
+
+static inline u32 reg_get(void) {
+    u32 v;
+    __asm__ volatile("psrldq $4, %%xmm7\n movd %%xmm7, %0\n pshufd $0, %%xmm7, %%xmm7"
+                     : "=r"(v));
+    return v;
+}
+#elif defined(__arm__) && defined(__ARM_FP)
+static inline void reg_set(u32 v) {
+    __asm__ volatile("vmov s20, %0" : : "r"(v));
+}
+
+static inline u32 reg_get(void) {
+    u32 v;
+    __asm__ volatile("vmov %0, s20" : "=r"(v));
+    return v;
+}
+#else
+static u32 fake_reg;
+static inline void reg_set(u32 v) { fake_reg = v; }
+static inline u32 reg_get(void) { return fake_reg; }
+#endif
+
+static void fp_worker(u32 pattern) {
+    reg_set(pattern);
+    for (u32 i = 0; i < ROUNDS; i++) {
+        task_yield();
+        if (reg_get() != pattern) fpu_fails++;
+    }
+    fpu_live--;
+    task_exit();
+}
+
+static void fp_task_a(void) { fp_worker(0xA5A5A5A5); }
+static void fp_task_b(void) { fp_worker(0x5A5A5A5A); }
+
+static void int_task(void) {
+    for (u32 i = 0; i < ROUNDS; i++) task_yield();
+    fpu_live--;
+    task_exit();
+}
+
+// first FP access in a new task must not see the last owner's pattern
+static void fresh_task(void) {
+    if (reg_get() != 0) fpu_fails++;
+    fpu_live--;
+    task_exit();
+}
+
+void fpu_test_task(void) {
+    u32 traps0 = fpu_trap_count();
+    u32 saves0 = fpu_save_count();
+
+    fpu_live = 3;
+    task_create_prio(fp_task_a, 0, 512, SCHED_PRIO_DEFAULT - 1);
+    task_create_prio(fp_task_b, 0, 512, SCHED_PRIO_DEFAULT - 1);
+    task_create_prio(int_task, 0, 256, SCHED_PRIO_DEFAULT - 1);
+    while (fpu_live) task_yield();
+
+    u32 traps = fpu_trap_count() - traps0;
+    u32 saves = fpu_save_count() - saves0;
+
+    fpu_live = 1;
+    task_create_prio(fresh_task, 0, 256, SCHED_PRIO_DEFAULT - 1);
+    while (fpu_live) task_yield();
+
+    // at most one save per FP-task slice: never for the integer task
+    if (saves > 2 * (ROUNDS + 1)) fpu_fails++;
+
+    kprintf("fpu rounds=%d traps=%d saves=%d\r\n", ROUNDS, traps, saves);
+    kprintf("fpu %s\r\n", fpu_fails ? "FAIL" : "PASS");
+    task_exit();
+}
@@ -0,0 +1,86 @@
+/*
+ * hrtimer_test.c - one-shot timers: order, cancel, periodic re-arm
+ * Eight timers queued out of order must fire in deadline order and
+ * never early; a cancelled one must not fire at all; a 1 ms periodic
+ * timer re-armed from its callback must run HRT_PERIODS times in
+ * about HRT_PERIODS ms. Reports the hardware and the worst lateness.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/hrtimer.h"
+#include "kernel/clocksource.h"
+#include "kernel/kprintf.h"
+
+#define HRT_N       8
+#define HRT_PERIODS 50
+#define HRT_PERIOD  1000000ULL  // ns
+
+static hrtimer_t timers[HRT_N];
+static hrtimer_t cancelled;
+static hrtimer_t periodic;
+
+static volatile u32 fired_order[HRT_N];
+static volatile u32 fired;
+static volatile u32 periods;
+static volatile u32 hrt_fails;
+static volatile u32 worst_late_ns;
+
+static void note_late(hrtimer_t* t) {
+    u64 now = clock_now_ns();
+    if (now < t->expires) {
+        hrt_fails++;                    // early
+        return;
+    }
+    u32 late = (u32)(now - t->expires);
+    if (late > worst_late_ns) worst_late_ns = late;
+}
+
+static void order_fn(hrtimer_t* t) {
+    note_late(t);
+    fired_order[fired++] = (u32)(t - timers);
+}
+
+static void cancel_fn(hrtimer_t* t) {
+    (void)t;
+    hrt_fails++;
+}
+
+static void periodic_fn(hrtimer_t* t) {
+    note_late(t);
+    if (++periods < HRT_PERIODS) hrtimer_start(t, t->expires + HRT_PERIOD);
+}
+
+void hrtimer_test_task(void) {
+    // deadlines 1..8 ms, queued in a scrambled order
+    static const u8 perm[HRT_N] = { 5, 2, 7, 0, 3, 6, 1, 4 };
+    u64 base = clock_now_ns() + 2 * HRT_PERIOD;
+    for (u32 i = 0; i < HRT_N; i++) {
+        u32 k = perm[i];
+        hrtimer_init(&timers[k], order_fn, 0);
+        if (!hrtimer_start(&timers[k], base + k * HRT_PERIOD)) hrt_fails++;
+    }
+
+    hrtimer_init(&cancelled, cancel_fn, 0);
+    hrtimer_start_in(&cancelled, 3 * HRT_PERIOD);
+    if (!hrtimer_active(&cancelled) || !hrtimer_cancel(&cancelled)) hrt_fails++;
+    if (hrtimer_active(&cancelled) || hrtimer_cancel(&cancelled)) hrt_fails++;
+
+    task_sleep(20);
+    if (fired != HRT_N) hrt_fails++;
+    for (u32 i = 0; i < fired; i++) {
+        if (fired_order[i] != i) hrt_fails++;
+    }
+
+    hrtimer_init(&periodic, periodic_fn, 0);
+    u64 t0 = clock_now_ns();
+    hrtimer_start(&periodic, t0 + HRT_PERIOD);
+    while (periods < HRT_PERIODS) task_yield();
+    u32 ms = (u32)((clock_now_ns() - t0) / 1000000);
+    if (ms < HRT_PERIODS || ms > HRT_PERIODS + 5) hrt_fails++;
+
+    kprintf("hrtimer hw=%d fired=%d periods=%d ms=%d worst_late_ns=%d fails=%d\r\n",
+            hrtimer_hw(), fired, periods, ms, worst_late_ns, hrt_fails);
+    kprintf("hrtimer %s\r\n", hrt_fails ? "FAIL" : "PASS");
+    task_exit();
+}
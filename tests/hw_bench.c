@@ -0,0 +1,190 @@
+/*
+ * hw_bench.c - interrupt entry latency, simd_memcpy throughput, TLB reach
+ * IRQ latency is from just before the self-IPI (int $49 without a
+ * LAPIC) to the first line of irq_probe_handler(), so it includes the
+ * stub, irq_handler()'s dispatch and, for the IPI, the ICR write.
+ * The TLB pair reads one line per page over TLB_BLOCKS * 4MB, once
+ * through the large-page identity map and once through a 4KB alias of
+ * the same frames; dtlb_walks is page walks per pass from the PMU
+ * (DTLB_LOAD_MISSES.MISS_CAUSES_A_WALK, Intel), 0 without one.
+ * tlb_unmap times paging_unmap_region() over 1, 64 and 4096 mapped
+ * pages, shootdown IPIs included; compare BENCH_SMP=1 with 4.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "bench.h"
+
+#ifdef __x86_64__
+#include "drivers/apic.h"
+#include "drivers/idt.h"
+#include "drivers/simd.h"
+#include "drivers/paging.h"
+#include "drivers/perfmon.h"
+
+#define IRQ_TIMEOUT 1000000     // polls before we call the probe lost
+#define COPY_MAX    65536
+#define COPY_RUNS   (BENCH_SAMPLES / 4)
+
+#define TLB_ORDER   10                  // 4MB blocks
+#define TLB_BLOCK   (4096u << TLB_ORDER)
+#define TLB_BLOCKS  4
+#define TLB_ALIAS   (0xE0000000 + 4096) // off large-page alignment
+#define TLB_RUNS    32
+#define UNMAP_VA    0xE8000000
+#define UNMAP_RUNS  64
+#define EVT_DTLB_LOAD_WALK  0x08
+#define UMASK_DTLB_WALK     0x01
+
+static volatile u32 irq_stamp, irq_hit;
+static u8 copy_src[COPY_MAX] __attribute__((aligned(64)));
+static u8 copy_dst[COPY_MAX] __attribute__((aligned(64)));
+
+void irq_probe_handler(void) {
+    irq_stamp = bench_cycles();
+    irq_hit = 1;
+}
+
+static void bench_irq(void) {
+    u8 ipi = apic_is_enabled();
+    const char* name = ipi ? "irq_selfipi" : "irq_soft";
+
+    bench_begin();
+    for (u32 i = 0; i < BENCH_SAMPLES; i++) {
+        irq_hit = 0;
+        u32 t0 = bench_cycles();
+        if (ipi) apic_send_ipi(apic_get_id(), IDT_PROBE_VECTOR);
+        else __asm__ volatile("int %0" : : "i"(IDT_PROBE_VECTOR) : "memory");
+
+        u32 spins = 0;
+        while (!irq_hit && ++spins < IRQ_TIMEOUT);
+        if (!irq_hit) {
+            bench_skip(name, "no_irq");     // interrupts off in task context?
+            return;
+        }
+        bench_sample(irq_stamp - t0);
+    }
+    bench_report(name, "vector", IDT_PROBE_VECTOR);
+}
+
+static void bench_memcpy(void) {
+    for (u32 i = 0; i < COPY_MAX; i++) copy_src[i] = (u8)i;
+
+    for (u32 size = 64; size <= COPY_MAX; size <<= 2) {
+        bench_begin();
+        simd_memcpy(copy_dst, copy_src, size);      // warm the caches
+        for (u32 i = 0; i < COPY_RUNS; i++) {
+            u32 t0 = bench_cycles();
+            simd_memcpy(copy_dst, copy_src, size);
+            bench_sample(bench_cycles() - t0);
+        }
+        bench_report("simd_memcpy", "bytes", size);
+    }
+}
+
+static u32 tlb_block[TLB_BLOCKS];
+
+// one line per page, walking the sets so the caches are not the limit
+static u32 tlb_pass(u32 alias) {
+    u32 sum = 0;
+    for (u32 b = 0; b < TLB_BLOCKS; b++) {
+        u32 base = alias ? TLB_ALIAS + b * TLB_BLOCK : tlb_block[b];
+        for (u32 p = 0; p < TLB_BLOCK / 4096; p++) {
+            sum += *(volatile u32*)(base + p * 4096 + ((p * 64) & 0xFFF));
+        }
+    }
+    return sum;
+}
+
+static void bench_tlb_view(const char* name, u32 alias, u8 pmu) {
+    u64 walks = 0;
+    bench_begin();
+    tlb_pass(alias);
+    for (u32 i = 0; i < TLB_RUNS; i++) {
+        if (pmu) {
+            perfmon_reset_counter(0);
+            perfmon_enable_counter(0);
+        }
+        u32 t0 = bench_cycles();
+        tlb_pass(alias);
+        bench_sample(bench_cycles() - t0);
+        if (pmu) {
+            perfmon_disable_counter(0);
+            walks += perfmon_read_counter(0);
+        }
+    }
+    bench_report(name, "dtlb_walks", (u32)(walks / TLB_RUNS));
+}
+
+static void bench_tlb(void) {
+    extern u32 paging_alloc_frames(u8 order);
+    extern void paging_free_frames(u32 addr, u8 order);
+    u32 got = 0;
+
+    if (!paging_large_pages()) {
+        bench_skip("tlb", "no_large_pages");
+        return;
+    }
+    while (got < TLB_BLOCKS && (tlb_block[got] = paging_alloc_frames(TLB_ORDER))) got++;
+    if (got < TLB_BLOCKS) {
+        bench_skip("tlb", "no_memory");
+    } else {
+        for (u32 b = 0; b < TLB_BLOCKS; b++) {
+            paging_map_region(TLB_ALIAS + b * TLB_BLOCK, tlb_block[b], TLB_BLOCK,
+                              PAGE_PRESENT | PAGE_WRITABLE | PAGE_NX);
+            for (u32 p = 0; p < TLB_BLOCK; p += 4096) *(u32*)(tlb_block[b] + p) = p;
+        }
+        if (tlb_pass(0) != tlb_pass(1)) {
+            bench_skip("tlb", "alias_mismatch");
+        } else {
+            u8 pmu = perfmon_is_supported();
+            if (pmu) perfmon_setup_counter(0, EVT_DTLB_LOAD_WALK, UMASK_DTLB_WALK, 0, 1, "dtlb_walk");
+            bench_tlb_view("tlb_large", 0, pmu);
+            bench_tlb_view("tlb_4k", 1, pmu);
+        }
+        paging_unmap_region(TLB_ALIAS, TLB_BLOCKS * TLB_BLOCK);
+    }
+    for (u32 b = 0; b < got; b++) paging_free_frames(tlb_block[b], TLB_ORDER);
+}
+
+// every page aliases one frame: only the unmap itself is timed
+static void bench_unmap(void) {
+    static const u32 sizes[] = { 1, 64, 4096 };
+    extern u32 paging_alloc_frames(u8 order);
+    extern void paging_free_frames(u32 addr, u8 order);
+    u32 frame = paging_alloc_frames(0);
+    if (!frame) {
+        bench_skip("tlb_unmap", "no_memory");
+        return;
+    }
+
+    for (u32 s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        bench_begin();
+        for (u32 i = 0; i < UNMAP_RUNS; i++) {
+            for (u32 p = 0; p < sizes[s]; p++) {
+                paging_map_page(UNMAP_VA + p * 4096, frame, PAGE_PRESENT | PAGE_WRITABLE);
+                (void)*(volatile u32*)(UNMAP_VA + p * 4096);   // into the TLB
+            }
+            u32 t0 = bench_cycles();
+            paging_unmap_region(UNMAP_VA, sizes[s] * 4096);
+            bench_sample(bench_cycles() - t0);
+        }
+        bench_report("tlb_unmap", "pages", sizes[s]);
+    }
+    paging_free_frames(frame, 0);
+}
+
+void hw_bench_run(void) {
+    bench_irq();
+    bench_memcpy();
+    bench_tlb();
+    bench_unmap();
+}
+#else
+void hw_bench_run(void) {
+    bench_skip("irq", "x86_only");
+    bench_skip("simd_memcpy", "x86_only");
+    bench_skip("tlb", "x86_only");
+    bench_skip("tlb_unmap", "x86_only");
+}
+#endif
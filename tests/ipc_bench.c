@@ -0,0 +1,160 @@
+/*
+ * ipc_bench.c - msg round trip and lock cost
+ * Each lock kind (test-and-set, ticket, MCS) is timed alone and while
+ * CPU 1 hammers it; the contended case needs -smp 2 or more and
+ * reports skipped otherwise.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/smp.h"
+#include "kernel/spinlock.h"
+#include "kernel/msg.h"
+#include "bench.h"
+
+#define HOLD_SPIN 32            // work inside the hammer's critical section
+
+enum { LK_SPIN, LK_TICKET, LK_MCS, LK_KINDS };
+
+static const char* const uncontended_name[LK_KINDS] = {
+    "spin_lock_uncontended", "ticket_lock_uncontended", "mcs_lock_uncontended"
+};
+static const char* const contended_name[LK_KINDS] = {
+    "spin_lock_contended", "ticket_lock_contended", "mcs_lock_contended"
+};
+
+static msg_queue_t q_req, q_rsp;
+static spinlock_t bench_lock;
+static ticket_lock_t bench_ticket;
+static mcs_lock_t bench_mcs;
+static volatile u32 hammer_kind;
+static volatile u32 bench_live;
+static volatile u32 hammer_up, hammer_stop;
+static volatile u32 bench_sink;
+
+// blocks; the sender's wake-up puts us straight back on the run queue
+static void recv_wait(msg_queue_t* q, msg_t* m) {
+    msg_recv_timeout(q, m, WAIT_FOREVER);
+}
+
+static void ping_task(void) {
+    msg_t m = { { 0 } };
+    for (u32 i = 0; i <= BENCH_SAMPLES; i++) {
+        m.data[0] = (u8)i;
+        u32 t0 = bench_cycles();
+        msg_send(&q_req, &m);
+        recv_wait(&q_rsp, &m);
+        u32 d = bench_cycles() - t0;
+        if (i) bench_sample(d);
+    }
+    m.data[0] = 0xFF;
+    m.data[1] = 1;              // stop
+    msg_send(&q_req, &m);
+    bench_live--;
+    task_exit();
+}
+
+static void pong_task(void) {
+    msg_t m;
+    for (;;) {
+        recv_wait(&q_req, &m);
+        if (m.data[1]) break;
+        msg_send(&q_rsp, &m);
+    }
+    bench_live--;
+    task_exit();
+}
+
+static void bench_msg(void) {
+    msg_init(&q_req);
+    msg_init(&q_rsp);
+    bench_begin();
+
+    // same priority so the two alternate on every yield
+    bench_live = 2;
+    task_create_affinity(pong_task, 0, 256, SCHED_PRIO_DEFAULT - 1, BENCH_CPU_MASK);
+    task_create_affinity(ping_task, 0, 256, SCHED_PRIO_DEFAULT - 1, BENCH_CPU_MASK);
+    while (bench_live) task_yield();
+
+    bench_report("msg_roundtrip", "bytes", MSG_SIZE);
+}
+
+static inline void lock_kind(u32 kind, mcs_node_t* node) {
+    if (kind == LK_SPIN) spin_lock(&bench_lock);
+    else if (kind == LK_TICKET) ticket_lock(&bench_ticket);
+    else mcs_lock(&bench_mcs, node);
+}
+
+static inline void unlock_kind(u32 kind, mcs_node_t* node) {
+    if (kind == LK_SPIN) spin_unlock(&bench_lock);
+    else if (kind == LK_TICKET) ticket_unlock(&bench_ticket);
+    else mcs_unlock(&bench_mcs, node);
+}
+
+static void bench_lock_uncontended(u32 kind) {
+    mcs_node_t node;
+    bench_begin();
+    for (u32 i = 0; i < BENCH_SAMPLES; i++) {
+        u32 t0 = bench_cycles();
+        lock_kind(kind, &node);
+        unlock_kind(kind, &node);
+        bench_sample(bench_cycles() - t0);
+    }
+    bench_report(uncontended_name[kind], 0, 0);
+}
+
+static void hammer_task(void) {
+    mcs_node_t node;
+    u32 kind = hammer_kind;
+    u32 acc = 0;
+    hammer_up = 1;
+    while (!hammer_stop) {
+        lock_kind(kind, &node);
+        for (u32 j = 0; j < HOLD_SPIN; j++) acc = acc * 1103515245u + 12345u;
+        unlock_kind(kind, &node);
+    }
+    bench_sink = acc;
+    hammer_up = 0;
+    task_exit();
+}
+
+static void bench_lock_contended(u32 kind) {
+    mcs_node_t node;
+    if (smp_num_cpus() < 2) {
+        bench_skip(contended_name[kind], "single_cpu");
+        return;
+    }
+
+    hammer_stop = 0;
+    hammer_kind = kind;
+    if (!task_create_affinity(hammer_task, 0, 256, SCHED_PRIO_DEFAULT - 1,
+                              BENCH_CPU_MASK << 1)) {
+        bench_skip(contended_name[kind], "no_task");
+        return;
+    }
+    while (!hammer_up) task_yield();
+
+    bench_begin();
+    for (u32 i = 0; i < BENCH_SAMPLES; i++) {
+        u32 t0 = bench_cycles();
+        lock_kind(kind, &node);
+        unlock_kind(kind, &node);
+        bench_sample(bench_cycles() - t0);
+    }
+    hammer_stop = 1;
+    while (hammer_up) task_yield();
+
+    bench_report(contended_name[kind], "hold", HOLD_SPIN);
+}
+
+void ipc_bench_run(void) {
+    LOCK_STAT_NAME(&bench_lock, "bench_spin");
+    LOCK_STAT_NAME(&bench_ticket, "bench_ticket");
+    LOCK_STAT_NAME(&bench_mcs, "bench_mcs");
+
+    bench_msg();
+    for (u32 k = 0; k < LK_KINDS; k++) {
+        bench_lock_uncontended(k);
+        bench_lock_contended(k);
+    }
+}
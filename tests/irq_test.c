@@ -0,0 +1,63 @@
+/*
+ * irq_test.c - irqsave nesting
+ * An inner restore must leave the outer section masked; only the
+ * outermost restore unmasks. Run from a task, with irqs on.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/spinlock.h"
+#include "kernel/irq.h"
+#include "kernel/kprintf.h"
+
+static spinlock_t outer_lock, inner_lock;
+static u32 irq_fails;
+
+// 1 if the mask irq_save_kernel() sets is off
+static u8 kernel_irqs_on(void) {
+#ifdef __x86_64__
+    u32 f;
+    __asm__ volatile("pushf; pop %0" : "=r"(f));
+    return (f & 0x200) != 0;
+#elif defined(IRQ_HAVE_BASEPRI)
+    u32 b;
+    __asm__ volatile("mrs %0, basepri" : "=r"(b));
+    return b == 0;
+#elif defined(__arm__)
+    u32 p;
+    __asm__ volatile("mrs %0, primask" : "=r"(p));
+    return p == 0;
+#else
+    return 1;
+#endif
+}
+
+void irq_test_task(void) {
+    if (!kernel_irqs_on()) irq_fails++;
+
+    u32 f1 = spin_lock_irqsave(&outer_lock);
+    u32 f2 = spin_lock_irqsave(&inner_lock);
+    spin_unlock_irqrestore(&inner_lock, f2);
+    if (kernel_irqs_on()) irq_fails++;          // spin_lock_irq would unmask here
+    spin_unlock_irqrestore(&outer_lock, f1);
+    if (!kernel_irqs_on()) irq_fails++;
+
+    f1 = spin_lock_irqsave_kernel(&outer_lock);
+    f2 = spin_lock_irqsave_kernel(&inner_lock);
+    spin_unlock_irqrestore_kernel(&inner_lock, f2);
+    if (kernel_irqs_on()) irq_fails++;
+    spin_unlock_irqrestore_kernel(&outer_lock, f1);
+    if (!kernel_irqs_on()) irq_fails++;
+
+    // a full mask taken inside a kernel one comes back to the kernel one
+    f1 = irq_save_kernel();
+    f2 = irq_save();
+    irq_restore(f2);
+    if (kernel_irqs_on()) irq_fails++;
+    irq_restore_kernel(f1);
+    if (!kernel_irqs_on()) irq_fails++;
+
+    kprintf("irq fails=%d\r\n", irq_fails);
+    kprintf("irq %s\r\n", irq_fails ? "FAIL" : "PASS");
+    task_exit();
+}
@@ -0,0 +1,41 @@
+/*
+ * klog_test.c - deferred log: cost per record, overflow accounting
+ * Times KLOG() against an empty ring (the ISR case), then overfills
+ * the ring: exactly KLOG_RING records must drain, and the next one
+ * prints the other KLOG_EXTRA as lost. Runs above klog_task, on CPU 0,
+ * so the drain task can't empty the ring in between.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/klog.h"
+#include "kernel/clocksource.h"
+#include "kernel/kprintf.h"
+
+#define KLOG_TIMED   (KLOG_RING / 2)
+#define KLOG_EXTRA   8
+
+static u32 klog_fails;
+
+static void klog_test_body(void) {
+    klog_drain();
+
+    u64 t0 = clock_now_ns();
+    for (u32 i = 0; i < KLOG_TIMED; i++) KLOG("klog timed %d of %d\r\n", i, KLOG_TIMED);
+    u32 write_ns = (u32)((clock_now_ns() - t0) / KLOG_TIMED);
+    if (klog_drain() != KLOG_TIMED) klog_fails++;
+
+    for (u32 i = 0; i < KLOG_RING + KLOG_EXTRA; i++) KLOG("klog fill %d\r\n", i);
+    if (klog_drain() != KLOG_RING) klog_fails++;
+    KLOG("klog after overflow: expect %d lost\r\n", KLOG_EXTRA);
+    if (klog_drain() != 1) klog_fails++;
+
+    kprintf("klog write_ns=%d rec=%d fails=%d\r\n", write_ns, (u32)sizeof(klog_rec_t), klog_fails);
+    kprintf("klog %s\r\n", klog_fails ? "FAIL" : "PASS");
+    task_exit();
+}
+
+void klog_test_task(void) {
+    task_create_affinity(klog_test_body, 0, 512, SCHED_PRIO_DEFAULT - 1, 1u);
+    task_exit();
+}
@@ -0,0 +1,81 @@
+/*
+ * lock_test.c - ticket, MCS and elided locks: mutual exclusion, trylock
+ * LOCK_WORKERS tasks (spread over CPUs when SMP is up) bump a counter
+ * with a non-atomic read-modify-write under each lock; any lost update
+ * means two holders at once. Elided holders share one counter, so they
+ * must conflict, abort and still add up (a plain lock without RTM).
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/spinlock.h"
+#include "kernel/kprintf.h"
+
+#define LOCK_ITERS   5000
+#define LOCK_WORKERS 4
+
+static ticket_lock_t test_ticket;
+static mcs_lock_t test_mcs;
+static spinlock_t test_elided;
+static volatile u32 ticket_count, mcs_count, elided_count;
+static volatile u32 lock_fails;
+static volatile u32 lock_live;
+
+static void worker(void) {
+    mcs_node_t node;
+    for (u32 i = 0; i < LOCK_ITERS; i++) {
+        ticket_lock(&test_ticket);
+        u32 v = ticket_count;
+        ticket_count = v + 1;
+        ticket_unlock(&test_ticket);
+
+        mcs_lock(&test_mcs, &node);
+        v = mcs_count;
+        mcs_count = v + 1;
+        mcs_unlock(&test_mcs, &node);
+
+        spin_lock(&test_elided);
+        v = elided_count;
+        elided_count = v + 1;
+        spin_unlock(&test_elided);
+        // no preemption: spinners on this CPU only run if we let them
+        if (i % 64 == 0) task_yield();
+    }
+    __sync_fetch_and_sub(&lock_live, 1);
+    task_exit();
+}
+
+void lock_test_task(void) {
+    mcs_node_t node;
+
+    // trylock fails while held, succeeds once released
+    if (!ticket_trylock(&test_ticket)) lock_fails++;
+    if (ticket_trylock(&test_ticket)) lock_fails++;
+    ticket_unlock(&test_ticket);
+    ticket_lock(&test_ticket);
+    ticket_unlock(&test_ticket);
+    mcs_lock(&test_mcs, &node);
+    if (!test_mcs.tail) lock_fails++;
+    mcs_unlock(&test_mcs, &node);
+    if (test_mcs.tail) lock_fails++;
+
+    LOCK_STAT_NAME(&test_ticket, "test_ticket");
+    LOCK_STAT_NAME(&test_mcs, "test_mcs");
+    LOCK_STAT_NAME(&test_elided, "test_elided");
+    spin_lock_set_elision(&test_elided, 1);
+
+    lock_live = LOCK_WORKERS;
+    for (u32 i = 0; i < LOCK_WORKERS; i++) {
+        task_create_prio(worker, 0, 256, SCHED_PRIO_DEFAULT - 1);
+    }
+    while (lock_live) task_yield();
+    if (ticket_count != LOCK_WORKERS * LOCK_ITERS) lock_fails++;
+    if (mcs_count != LOCK_WORKERS * LOCK_ITERS) lock_fails++;
+    if (elided_count != LOCK_WORKERS * LOCK_ITERS) lock_fails++;
+
+    lock_stats_dump();
+    kprintf("lock iters=%d workers=%d fails=%d\r\n",
+            LOCK_ITERS, LOCK_WORKERS, lock_fails);
+    kprintf("lock %s\r\n", lock_fails ? "FAIL" : "PASS");
+    task_exit();
+}
@@ -0,0 +1,60 @@
+/*
+ * rt_test.c - periodic class: admission and deadline misses
+ * Three jobs that burn close to their WCET for RUN_MS; none may miss,
+ * and a task that would overload the CPU must be refused.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/timer.h"
+#include "kernel/kprintf.h"
+
+#define RUN_MS 2000
+
+static void burn(u32 ticks) {
+    u32 t0 = timer_ticks();
+    while (timer_ticks() - t0 < ticks);
+}
+
+// wcet - 1: a started tick may already be partly gone
+static void job_a(void) { burn(1); }
+static void job_b(void) { burn(3); }
+static void job_c(void) { burn(4); }
+
+static const struct {
+    task_entry_t job;
+    u32 period, wcet;
+} rt_set[] = {
+    { job_a, 10, 2 },
+    { job_b, 20, 4 },
+    { job_c, 50, 5 },
+};
+
+#define RT_N (sizeof(rt_set) / sizeof(rt_set[0]))
+
+void rt_test_task(void) {
+    u32 pid[RT_N];
+    u32 fails = 0;
+
+    for (u32 i = 0; i < RT_N; i++) {
+        pid[i] = task_create_periodic(rt_set[i].job, rt_set[i].period,
+                                      rt_set[i].wcet, 0);
+        if (!pid[i]) fails++;
+    }
+
+    // 60% more at the shortest period cannot fit next to the set above
+    if (task_create_periodic(job_a, 10, 6, 0)) fails++;
+
+    task_sleep(RUN_MS);
+
+    for (u32 i = 0; i < RT_N; i++) {
+        u32 jobs = 0, misses = 0;
+        task_rt_stats(pid[i], &jobs, &misses);
+        if (misses || jobs + 1 < RUN_MS / rt_set[i].period) fails++;
+        kprintf("rt period=%d wcet=%d jobs=%d misses=%d\r\n",
+                rt_set[i].period, rt_set[i].wcet, jobs, misses);
+    }
+
+    kprintf("rt %s\r\n", fails ? "FAIL" : "PASS");
+    task_exit();
+}
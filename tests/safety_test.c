@@ -20,12 +20,12 @@ static void test_watchdog_timeout(void) {
 void safety_test_task(void) {
     can_frame_t rx;
     while (1) {
-        if (can_recv(&rx) == 0 && rx.id == 0x7FF) {
+        // sleeps until the CAN ISR hands us a frame
+        if (can_recv_timeout(&rx, WAIT_FOREVER) == 0 && rx.id == 0x7FF) {
             switch (rx.data[0]) {
                 case 0x01: test_stack_overflow(); break;
                 case 0x02: test_watchdog_timeout(); break;
             }
         }
-        timer_delay(100);
     }
 }
@@ -0,0 +1,55 @@
+/*
+ * sched_bench.c - yield-to-run latency vs. task count
+ * Two tasks is the ping-pong case. Needs MAX_TASKS >= 34 for the
+ * 32-task round; make bench builds with MAX_TASKS=64.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "bench.h"
+
+static volatile u32 bench_stamp;
+static volatile u32 bench_live;
+static u32 bench_rounds;
+
+static void bench_worker(void) {
+    // round 0 stamps only: the first switch-in comes from the creator
+    for (u32 i = 0; i <= bench_rounds; i++) {
+        bench_stamp = bench_cycles();
+        task_yield();
+        u32 d = bench_cycles() - bench_stamp;
+        if (i) bench_sample(d);
+    }
+    bench_live--;
+    task_exit();
+}
+
+static void bench_run(u32 ntasks) {
+    bench_begin();
+    bench_rounds = BENCH_SAMPLES / ntasks;
+    bench_live = 0;
+
+    // workers outrank us, so they run back-to-back until all exit
+    for (u32 i = 0; i < ntasks; i++) {
+        if (!task_create_affinity(bench_worker, 0, 256, SCHED_PRIO_DEFAULT - 1,
+                                  BENCH_CPU_MASK)) break;
+        bench_live++;
+    }
+    u32 spawned = bench_live;
+    while (bench_live) task_yield();
+
+    bench_report(spawned == 2 ? "yield_pingpong" : "yield", "tasks", spawned);
+}
+
+void sched_bench_run(void) {
+    bench_run(2);
+    bench_run(4);
+    bench_run(16);
+    bench_run(32);
+}
+
+void sched_bench_task(void) {
+    bench_init();
+    sched_bench_run();
+    task_exit();
+}
@@ -0,0 +1,111 @@
+/*
+ * slab_test.c - object caches: alignment, constructors, colouring
+ * Objects must be distinct, aligned and constructed exactly once per
+ * slab; consecutive slabs must start their objects at different
+ * colours; a free/alloc pair must come back from the magazine; and
+ * after everything is freed and shrunk no object may be active.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/slab.h"
+#include "kernel/kprintf.h"
+
+#define SLAB_OBJS  24            // two slabs of 200-byte objects on x86
+
+typedef struct {
+    u32 magic;
+    u32 payload[10];
+} test_obj_t;
+
+#define TEST_MAGIC 0x51AB0B1E
+
+static kmem_cache_t test_plain;
+static kmem_cache_t test_ctor;
+static volatile u32 ctor_calls;
+static volatile u32 slab_fails;
+static void* objs[SLAB_OBJS];
+
+static void test_obj_ctor(void* p) {
+    ((test_obj_t*)p)->magic = TEST_MAGIC;
+    ctor_calls++;
+}
+
+static u32 obj_offset(kmem_cache_t* c, void* obj) {
+    return (u32)obj & ((SLAB_PAGE_SIZE << c->order) - 1);
+}
+
+void slab_test_task(void) {
+    slab_stats_t st;
+
+    if (kmem_cache_init(&test_plain, "test_plain", 1 << 20, 0, 0)) slab_fails++;
+    if (!kmem_cache_init(&test_plain, "test_plain", 200, 16, 0)) slab_fails++;
+    if (!kmem_cache_init(&test_ctor, "test_ctor", sizeof(test_obj_t), 0, test_obj_ctor)) {
+        slab_fails++;
+    }
+
+    // distinct and aligned
+    for (u32 i = 0; i < SLAB_OBJS; i++) {
+        objs[i] = kmem_cache_alloc(&test_plain);
+        if (!objs[i] || ((u32)objs[i] & 15)) slab_fails++;
+        for (u32 j = 0; j < i; j++) {
+            if (objs[j] == objs[i]) slab_fails++;
+        }
+    }
+
+    // colouring: each slab's lowest object sits at a new offset
+    kmem_cache_stats(&test_plain, &st);
+    if (st.slabs < 2 || st.active != SLAB_OBJS) slab_fails++;
+    u32 colours = 0;
+    u32 seen[SLAB_OBJS];
+    for (u32 i = 0; i < SLAB_OBJS; i++) {
+        u32 base = (u32)objs[i] & ~((SLAB_PAGE_SIZE << test_plain.order) - 1);
+        u32 lowest = obj_offset(&test_plain, objs[i]);
+        for (u32 j = 0; j < SLAB_OBJS; j++) {
+            u32 off = obj_offset(&test_plain, objs[j]);
+            if (((u32)objs[j] & ~((SLAB_PAGE_SIZE << test_plain.order) - 1)) == base &&
+                off < lowest) {
+                lowest = off;
+            }
+        }
+        u32 k = 0;
+        while (k < colours && seen[k] != lowest) k++;
+        if (k == colours) seen[colours++] = lowest;
+    }
+    if (test_plain.color_max >= test_plain.color_step && colours < 2) slab_fails++;
+
+    // a freed object comes straight back from this CPU's magazine
+    kmem_cache_stats(&test_plain, &st);
+    u32 hits = st.hits;
+    void* last = objs[SLAB_OBJS - 1];
+    kmem_cache_free(&test_plain, last);
+    objs[SLAB_OBJS - 1] = kmem_cache_alloc(&test_plain);
+    kmem_cache_stats(&test_plain, &st);
+    if (objs[SLAB_OBJS - 1] != last || st.hits != hits + 1) slab_fails++;
+
+    for (u32 i = 0; i < SLAB_OBJS; i++) kmem_cache_free(&test_plain, objs[i]);
+    kmem_cache_shrink(&test_plain);
+    kmem_cache_stats(&test_plain, &st);
+    if (st.active || st.cached || st.slabs) slab_fails++;
+
+    // constructed once per slab, still constructed after a round trip
+    for (u32 i = 0; i < SLAB_OBJS; i++) {
+        objs[i] = kmem_cache_alloc(&test_ctor);
+        if (!objs[i] || ((test_obj_t*)objs[i])->magic != TEST_MAGIC) slab_fails++;
+    }
+    kmem_cache_stats(&test_ctor, &st);
+    if (ctor_calls != st.slabs * st.per_slab) slab_fails++;
+    for (u32 i = 0; i < SLAB_OBJS; i++) kmem_cache_free(&test_ctor, objs[i]);
+    for (u32 i = 0; i < SLAB_OBJS; i++) {
+        objs[i] = kmem_cache_alloc(&test_ctor);
+        if (!objs[i] || ((test_obj_t*)objs[i])->magic != TEST_MAGIC) slab_fails++;
+    }
+    if (ctor_calls % st.per_slab) slab_fails++;
+    for (u32 i = 0; i < SLAB_OBJS; i++) kmem_cache_free(&test_ctor, objs[i]);
+    kmem_cache_shrink(&test_ctor);
+
+    slab_stats_dump();
+    kprintf("slab objs=%d colours=%d fails=%d\r\n", SLAB_OBJS, colours, slab_fails);
+    kprintf("slab %s\r\n", slab_fails ? "FAIL" : "PASS");
+    task_exit();
+}
@@ -0,0 +1,69 @@
+/*
+ * smp_bench.c - throughput vs. CPU count
+ * Boot x86 with -smp 8 (make ARCH=x86 bench BENCH_SMP=8). The same work
+ * is pinned to the first 1/2/4/8 CPUs in turn, so one boot gives the
+ * whole scaling curve; counts above smp_num_cpus() are left out. Each
+ * sample is one whole round timed from CPU 0, where the suite runs;
+ * the workers are the one place the suite leaves BENCH_CPU_MASK.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/smp.h"
+#include "bench.h"
+
+#define SMP_WORKERS 16
+#define SMP_CHUNKS  200         // yields per worker
+#define SMP_SPIN    2000        // LCG steps between yields
+#define SMP_ROUNDS  16          // samples per CPU count
+
+static volatile u32 bench_live;
+static volatile u32 bench_sink;
+
+static void bench_worker(void) {
+    u32 acc = 0;
+    for (u32 i = 0; i < SMP_CHUNKS; i++) {
+        for (u32 j = 0; j < SMP_SPIN; j++) acc = acc * 1103515245u + 12345u;
+        task_yield();
+    }
+    __sync_fetch_and_add(&bench_sink, acc);
+    __sync_fetch_and_sub(&bench_live, 1);
+    task_exit();
+}
+
+// one round of SMP_WORKERS on the first ncpu CPUs; 0 if one didn't start
+static u8 bench_round(u32 ncpu) {
+    u32 cpus = (1u << ncpu) - 1;
+
+    // count up front: workers on other CPUs may finish before we return
+    bench_live = SMP_WORKERS;
+    u32 t0 = bench_cycles();
+    u32 spawned = 0;
+    for (u32 i = 0; i < SMP_WORKERS; i++) {
+        if (!task_create_affinity(bench_worker, 0, 256, SCHED_PRIO_DEFAULT - 1, cpus)) break;
+        spawned++;
+    }
+    __sync_fetch_and_sub(&bench_live, SMP_WORKERS - spawned);
+    while (bench_live) task_yield();
+    bench_sample(bench_cycles() - t0);
+
+    return spawned == SMP_WORKERS;
+}
+
+static void bench_run(u32 ncpu) {
+    bench_begin();
+    for (u32 i = 0; i < SMP_ROUNDS; i++) {
+        if (!bench_round(ncpu)) {
+            bench_skip("smp_scale", "no_task");
+            return;
+        }
+    }
+    bench_report("smp_scale", "cpus", ncpu);
+}
+
+void smp_bench_run(void) {
+    for (u32 n = 1; n <= SMP_MAX_CPUS; n <<= 1) {
+        if (n > smp_num_cpus()) break;
+        bench_run(n);
+    }
+}
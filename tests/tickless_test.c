@@ -0,0 +1,47 @@
+/*
+ * tickless_test.c - tickless idle regression
+ * Run as the only non-idle task under QEMU (make ARCH=x86 qemu):
+ * each sleep must take ~1 tick interrupt instead of SLEEP_MS, and
+ * still wake within one tick of the requested time. Ticks are checked
+ * against clock_now_ns() wherever that runs off a free-running counter
+ * (TSC, HPET, DWT...), so corrected ticks can't hide a drift.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/timer.h"
+#include "kernel/clocksource.h"
+#include "kernel/kprintf.h"
+
+#define SLEEP_MS 200
+#define ROUNDS   5
+
+void tickless_test_task(void) {
+    u32 fails = 0;
+
+    for (u32 r = 0; r < ROUNDS; r++) {
+        u32 irq0 = timer_irq_count();
+        u32 t0 = timer_ticks();
+        u64 ns0 = clock_now_ns();
+        task_sleep(SLEEP_MS);
+        u32 slept = timer_ticks() - t0;
+        u32 irqs = timer_irq_count() - irq0;
+
+        if (slept < SLEEP_MS || slept > SLEEP_MS + 1) fails++;
+        if (TICKLESS_IDLE && irqs > SLEEP_MS / 10) fails++;
+
+        // wall clock; the tick clocksource would only echo the ticks
+        if (clocksource_hz() > 1000) {
+            u32 wall = (u32)((clock_now_ns() - ns0) / 1000000);
+            if (wall + 1 < slept || wall > slept + 1) fails++;
+            kprintf("tickless sleep=%d ticks=%d wall=%d irqs=%d\r\n",
+                    SLEEP_MS, slept, wall, irqs);
+            continue;
+        }
+        kprintf("tickless sleep=%d ticks=%d irqs=%d\r\n",
+                SLEEP_MS, slept, irqs);
+    }
+
+    kprintf("tickless %s\r\n", fails ? "FAIL" : "PASS");
+    task_exit();
+}
@@ -0,0 +1,91 @@
+/*
+ * wq_test.c - wait queues and blocking msg receive
+ * A signal between wq_prepare() and wq_wait() must not be lost, a
+ * timeout must not fire early, wake_one must pick the most urgent
+ * waiter, and a blocked receiver must get every message in order.
+ */
+
+#include "kernel/types.h"
+#include "kernel/sched.h"
+#include "kernel/msg.h"
+#include "kernel/timer.h"
+#include "kernel/kprintf.h"
+
+#define WQ_MSGS    500
+#define WQ_TIMEOUT 20
+
+static wait_queue_t test_wq;
+static msg_queue_t test_q;
+static volatile u32 wq_fails;
+static volatile u32 wq_live;
+static volatile u32 wake_order;     // waiter priorities, in wake order
+
+static void waiter(void) {
+    u32 snap = wq_prepare(&test_wq);
+    if (!wq_wait(&test_wq, snap, WAIT_FOREVER)) wq_fails++;
+    wake_order = (wake_order << 8) | task_current()->priority;
+    wq_live--;
+    task_exit();
+}
+
+static void receiver(void) {
+    for (u32 i = 0; i < WQ_MSGS; i++) {
+        msg_t m;
+        if (!msg_recv_timeout(&test_q, &m, WAIT_FOREVER)) wq_fails++;
+        if (m.data[0] != (u8)i || m.data[1] != (u8)(i >> 8)) wq_fails++;
+    }
+    wq_live--;
+    task_exit();
+}
+
+static void sender(void) {
+    msg_t m = { { 0 } };
+    for (u32 i = 0; i < WQ_MSGS; i++) {
+        m.data[0] = (u8)i;
+        m.data[1] = (u8)(i >> 8);
+        while (!msg_send(&test_q, &m)) task_yield();
+        if (i % 7 == 0) task_yield();   // let the receiver drain and block
+    }
+    wq_live--;
+    task_exit();
+}
+
+void wq_test_task(void) {
+    msg_t m;
+    wq_init(&test_wq);
+    msg_init(&test_q);
+
+    // signalled between prepare and wait: returns at once
+    u32 snap = wq_prepare(&test_wq);
+    if (wq_wake_one(&test_wq)) wq_fails++;          // nobody parked
+    if (!wq_wait(&test_wq, snap, WAIT_FOREVER)) wq_fails++;
+
+    // empty queue: 0 after the full timeout, and at once when polling
+    u32 t0 = timer_ticks();
+    if (msg_recv_timeout(&test_q, &m, WQ_TIMEOUT)) wq_fails++;
+    if (timer_ticks() - t0 < WQ_TIMEOUT) wq_fails++;
+    if (msg_recv_timeout(&test_q, &m, 0)) wq_fails++;
+
+    // both park before we signal: the more urgent one goes first
+    wake_order = 0;
+    wq_live = 2;
+    task_create_prio(waiter, 0, 256, SCHED_PRIO_DEFAULT - 1);
+    task_create_prio(waiter, 0, 256, SCHED_PRIO_DEFAULT - 2);
+    task_sleep(5);
+    if (wq_wake_one(&test_wq) != 1) wq_fails++;
+    while (wq_live == 2) task_yield();
+    if (wq_wake_all(&test_wq) != 1) wq_fails++;
+    while (wq_live) task_yield();
+    if (wake_order != (((SCHED_PRIO_DEFAULT - 2) << 8) | (SCHED_PRIO_DEFAULT - 1))) {
+        wq_fails++;
+    }
+
+    wq_live = 2;
+    task_create_prio(receiver, 0, 256, SCHED_PRIO_DEFAULT - 1);
+    task_create_prio(sender, 0, 256, SCHED_PRIO_DEFAULT - 1);
+    while (wq_live) task_yield();
+
+    kprintf("wq msgs=%d fails=%d\r\n", WQ_MSGS, wq_fails);
+    kprintf("wq %s\r\n", wq_fails ? "FAIL" : "PASS");
+    task_exit();
+}
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""
+klog_decode.py - expand KLOG_RAW=1 records using the kernel ELF
+Format strings come from the .klog_fmt section (a record's fmt field is
+the string's address); %s arguments are looked up in any loaded section.
+
+    klog_decode.py build/kernel.elf capture.bin
+    cat /dev/ttyUSB0 | klog_decode.py build/kernel.elf -
+"""
+
+import struct
+import sys
+
+KLOG_SYNC = 0x474F4C4B
+REC_SIZE = 32           # klog_rec_t
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF":
+            sys.exit(f"{path}: not an ELF file")
+        self.is64 = data[4] == 2
+        self.end = "<" if data[5] == 1 else ">"
+        if self.is64:
+            shoff, = struct.unpack_from(self.end + "Q", data, 0x28)
+            shentsize, shnum, shstrndx = struct.unpack_from(self.end + "HHH", data, 0x3A)
+        else:
+            shoff, = struct.unpack_from(self.end + "I", data, 0x20)
+            shentsize, shnum, shstrndx = struct.unpack_from(self.end + "HHH", data, 0x2E)
+
+        sections = []
+        for i in range(shnum):
+            off = shoff + i * shentsize
+            if self.is64:
+                name, typ, flags, addr, offset, size = struct.unpack_from(self.end + "IIQQQQ", data, off)
+            else:
+                name, typ, flags, addr, offset, size = struct.unpack_from(self.end + "IIIIII", data, off)
+            sections.append((name, typ, flags, addr, offset, size))
+
+        strtab = sections[shstrndx]
+        self.sections = {}
+        self.loaded = []
+        for name, typ, flags, addr, offset, size in sections:
+            n = data[strtab[4] + name:data.index(b"\0", strtab[4] + name)].decode()
+            body = b"" if typ == SHT_NOBITS else data[offset:offset + size]
+            self.sections[n] = (addr, body)
+            if flags & SHF_ALLOC and body:
+                self.loaded.append((addr, body))
+
+    def cstring(self, addr):
+        for base, body in self.loaded:
+            if base <= addr < base + len(body):
+                start = addr - base
+                end = body.find(b"\0", start)
+                return body[start:end if end >= 0 else len(body)].decode(errors="replace")
+        return None
+
+
+def format_record(fmt, args):
+    """The kprintf subset: %x %d %s %c, each taking one 32-bit argument."""
+    out, i, n = [], 0, 0
+    while i < len(fmt):
+        c = fmt[i]
+        if c == "%" and i + 1 < len(fmt) and fmt[i + 1] in "xdsc":
+            v = args[n] if n < len(args) else 0
+            conv = fmt[i + 1]
+            if conv == "x":
+                out.append(f"{v:08X}")
+            elif conv == "d":
+                out.append(str(v))
+            elif conv == "c":
+                out.append(chr(v & 0xFF))
+            else:
+                s = ELF.cstring(v)
+                out.append(s if s is not None else f"<0x{v:08x}>")
+            n += 1
+            i += 2
+        else:
+            out.append(c)
+            i += 1
+    return "".join(out)
+
+
+def decode(stream):
+    end = ELF.end
+    sync = struct.pack(end + "I", KLOG_SYNC)
+    fmt_base, fmt_body = ELF.sections.get(".klog_fmt", (0, b""))
+    if not fmt_body:
+        sys.exit("no .klog_fmt section: is KLOG used in this image?")
+
+    buf = b""
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            break
+        buf += chunk
+        while True:
+            at = buf.find(sync)
+            if at < 0 or len(buf) - at < 4 + REC_SIZE:
+                buf = buf[at:] if at >= 0 else buf[-3:]
+                break
+            rec = buf[at + 4:at + 4 + REC_SIZE]
+            buf = buf[at + 4 + REC_SIZE:]
+            fmt, nargs, cpu, lost, ts = struct.unpack_from(end + "IBBHQ", rec, 0)
+            args = struct.unpack_from(end + "4I", rec, 16)[:min(nargs, 4)]
+            if lost:
+                print(f"[cpu{cpu}: {lost} lost]")
+            if not fmt_base <= fmt < fmt_base + len(fmt_body):
+                print(f"[{ts / 1e9:.9f}] cpu{cpu}: <bad format id 0x{fmt:08x}>")
+                continue
+            start = fmt - fmt_base
+            text = fmt_body[start:fmt_body.index(b"\0", start)].decode(errors="replace")
+            text = format_record(text, args)
+            print(f"[{ts / 1e9:.9f}] cpu{cpu}: {text.rstrip()}")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit(__doc__.strip())
+    ELF = Elf(sys.argv[1])
+    src = sys.stdin.buffer if sys.argv[2] == "-" else open(sys.argv[2], "rb")
+    decode(src)